@@ -0,0 +1,145 @@
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "spscqueue.h"
+#include "threadconfig.h"
+
+#ifndef ASYNCLOGGER_H
+#define ASYNCLOGGER_H
+
+
+
+    //one fixed-size log entry. the payload is copied to its stream's file as is
+    struct LogRecord {
+        static const size_t MAX_PAYLOAD = 24;
+
+        uint32_t stream;
+        uint16_t size;
+        uint16_t reserved;
+        char payload[MAX_PAYLOAD];
+    };
+
+
+    //what a producer does when its ring is full
+    enum LogFullPolicy {
+        LOG_DROP,   // count the record as dropped and move on, the producer never waits
+        LOG_BLOCK   // wait for the logger thread (spins, then yields)
+    };
+
+
+    //binary log files written by a dedicated thread.
+    //every producer thread gets its own lock-free ring, so log() is a copy into shared memory and
+    //never a syscall. the logger thread batches records per stream and writes each stream's buffer
+    //out with one write() when it fills up or the rings go quiet. files are opened by the logger
+    //thread too, so openStream() is just bookkeeping
+    class AsyncLogger {
+
+    private:
+        static const size_t FLUSH_SIZE = 1 << 16;  // bytes a stream buffers before it is written out
+        static const int SPINS_BEFORE_YIELD = 1000; // LOG_BLOCK producers spin this long, then yield
+        static const int IDLE_SLEEP_US = 200;       // logger thread nap when every ring is empty
+
+        struct Producer {
+            SPSCQueue<LogRecord> ring;
+            alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> dropped{0}; // written by the producer only
+        };
+
+        struct Stream {
+            std::string path;
+            int fd = -1;
+            bool failed = false;        // could not open or write, records are discarded
+            std::vector<char> buffer;
+        };
+
+        LogFullPolicy policy = LOG_DROP;
+        std::vector<std::unique_ptr<Producer>> producers;
+
+        //slots are filled in by openStream() before any record can name them, and a record only reaches
+        //the logger thread through a ring, so the ring's release/acquire publishes the slot to drain().
+        //flushAll() walks the slots without a record, books open streams while the logger runs, so it
+        //only goes up to streamCount, which openStream() stores with release once the slot is filled
+        std::vector<std::unique_ptr<Stream>> streams;
+        std::mutex openMutex;           // openStream() callers among themselves
+        std::atomic<size_t> streamCount{0};
+
+        std::thread thread;
+        std::string threadName;         // placement applied by the logger thread when it starts
+        ThreadPlacement placement;
+        RuntimeStatus* runtimeStatus = nullptr;
+        std::atomic<bool> stopRequested{false};
+        bool running = false;
+
+        //logger thread side
+        std::atomic<uint64_t> recordsWritten{0};
+        std::atomic<uint64_t> writeCalls{0};
+        std::atomic<uint64_t> writeErrors{0};
+
+        void run();
+        bool drain(); //moves everything queued into stream buffers, false if there was nothing
+        void flush(Stream &stream);
+        void flushAll();
+
+    public:
+        AsyncLogger() {}
+
+        AsyncLogger(const AsyncLogger&) = delete;
+        AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+        ~AsyncLogger(); //stops the thread, everything logged before is written
+
+        int initialize(size_t producer_count, size_t ring_capacity, size_t max_streams, LogFullPolicy full_policy);
+
+        //registers a file (truncated when the logger thread opens it). returns the stream id, -1 if
+        //max_streams are already in use. safe from any thread
+        int openStream(const std::string &path);
+
+        //where the logger thread runs, so it stays off the matching cores. call before start()
+        inline void setPlacement(const std::string &name, const ThreadPlacement &where, RuntimeStatus* status) {
+            threadName = name;
+            placement = where;
+            runtimeStatus = status;
+        }
+
+        void start();
+
+        void stop(); //drains the rings, writes and closes every file
+
+        //hot path, from producer thread `producer` only. false if the record was dropped
+        inline bool log(size_t producer, uint32_t stream, const void* data, size_t size) {
+            LogRecord record;
+            record.stream = stream;
+            record.size = static_cast<uint16_t>(size < LogRecord::MAX_PAYLOAD ? size : LogRecord::MAX_PAYLOAD);
+            record.reserved = 0;
+            std::memcpy(record.payload, data, record.size);
+
+            Producer &p = *producers[producer];
+            if (p.ring.tryPush(record)) return true;
+            if (policy == LOG_DROP) {
+                p.dropped.store(p.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return false;
+            }
+            for (int spins = 0; !p.ring.tryPush(record); ++spins) {
+                if (spins < SPINS_BEFORE_YIELD) cpuRelax();
+                else std::this_thread::yield();
+            }
+            return true;
+        }
+
+        uint64_t dropped() const;
+        inline uint64_t written() const { return recordsWritten.load(std::memory_order_relaxed); }
+        inline uint64_t writes() const { return writeCalls.load(std::memory_order_relaxed); }
+        inline uint64_t errors() const { return writeErrors.load(std::memory_order_relaxed); }
+        inline LogFullPolicy fullPolicy() const { return policy; }
+
+        static bool parsePolicy(const std::string &name, LogFullPolicy &out);
+    };
+
+
+
+#endif
@@ -4,6 +4,10 @@
 #include <cstring>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <vector>
+#include "protocol.h"
+#include "recvbuffer.h"
+#include "shmtransport.h"
 
 #ifndef CLIENT_H
 #define CLIENT_H
@@ -17,13 +21,81 @@ private:
     std::string server_ip;
     int server_port;
 
+    static const size_t REPORT_BUFFER_SIZE = 1 << 18;
+    RecvBuffer reportBuffer; // execution reports from the server, decoded in place
+    bool binaryMode = false;
+
+    static const size_t SEND_BUFFER_SIZE = 1 << 16;
+    std::vector<char> sendBuffer;   // orders queued by queue_order, already encoded
+    size_t sendLength = 0;
+    size_t queuedOrders = 0;
+    uint64_t ordersSent = 0;        // by flush_orders
+    uint64_t bytesSent = 0;
+    uint64_t sendCalls = 0;
+
+    //shared memory mode: client_fd is the doorbell socket, the rings replace send()/recv()
+    static const int SHM_SPIN_US = 50; // poll_reports spins this long before it sleeps on the doorbell
+    ShmSegment shm;
+    int shmSlot = -1;
+    ShmRing shmOut;     // orders to the server
+    ShmRing shmIn;      // reports from the server
+
+    bool shm_attached() const; //our slot is still active and the server still running
+    void wake_server();        //rings the server's doorbell if its event loop sleeps
+
 public:
     Client(const std::string &ip, int port);
 
+    ~Client(); //lets go of a shared memory slot that is still attached
+
     int connect_to_server();
 
+    //attaches to server_main's shared memory gateway `name` ("/orderbook") instead of connecting over tcp.
+    //everything else works the same, always in the binary protocol (send_hello() is a no-op).
+    //0 on success, 1 if there is no gateway by that name or every client slot is taken
+    int attach_shared_memory(const std::string &name);
+
+    inline bool shared_memory() const { return shmSlot >= 0; }
+
     int send_order(const std::string &order_str);
 
+    int send_hello(); //switches the connection to the binary protocol, must be the first thing sent
+
+    int send_order(const Order &order); //binary new order/cancel/modify, needs send_hello() first
+
+    //encodes the order onto the send batch in the connection's protocol (text lines name the symbol
+    //if `symbols` has it). false if the batch has no room left, flush_orders() first
+    bool queue_order(const Order &order, const SymbolTable* symbols = nullptr);
+
+    inline size_t queued_orders() const { return queuedOrders; }
+
+    //sends the whole batch, with as few send() calls as the socket allows. when the socket is full the
+    //reports waiting on it are read into `reports` so the server never blocks on us. 0 on success
+    int flush_orders(std::vector<ExecReport> &reports);
+
+    inline uint64_t orders_sent() const { return ordersSent; }
+
+    inline uint64_t bytes_sent() const { return bytesSent; }
+
+    inline uint64_t send_calls() const { return sendCalls; }
+
+    //waits up to timeout_ms (0 = just look) for execution reports and appends the complete ones.
+    //returns how many were added, or -1 if the connection is gone
+    int poll_reports(std::vector<ExecReport> &reports, int timeout_ms);
+
+    //one recv() without waiting, for callers that poll fd() themselves. same return as poll_reports
+    int read_reports(std::vector<ExecReport> &reports);
+
+    //the socket, or in shared memory mode the doorbell (only rung while armed, see arm_doorbell())
+    inline int fd() const { return client_fd; }
+
+    //shared memory mode, for callers that poll() fd() themselves: asks the server to ring the doorbell
+    //when it publishes reports. false if reports are already waiting, read them instead of sleeping.
+    //disarm_doorbell() after the wait either way
+    bool arm_doorbell();
+
+    void disarm_doorbell();
+
     void close_client();
 };
 
@@ -0,0 +1,62 @@
+#include <cstdint>
+#include <chrono>
+#if defined(ORDERBOOK_TSC_CLOCK) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define ORDERBOOK_CLOCK_IS_TSC 1
+#endif
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+
+
+    //timestamps for hot path instrumentation, in ticks.
+    //built with -DORDERBOOK_TSC_CLOCK (make CLOCK=tsc) on x86 a tick is one rdtsc count, which is a few ns
+    //to read instead of a steady_clock call; anywhere else a tick is a steady_clock nanosecond.
+    //ticks from different threads are comparable as long as the cpu has an invariant, synchronized tsc
+
+    extern double clockNanosPerTick; //set by calibrateClock(), 1.0 for steady_clock
+
+    //start of a measured section
+    inline uint64_t clockNow() {
+#ifdef ORDERBOOK_CLOCK_IS_TSC
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    //end of a measured section, waits for the work before it to finish
+    inline uint64_t clockNowOrdered() {
+#ifdef ORDERBOOK_CLOCK_IS_TSC
+        unsigned int aux;
+        return __rdtscp(&aux);
+#else
+        return clockNow();
+#endif
+    }
+
+    inline long long ticksToNanos(uint64_t ticks) {
+#ifdef ORDERBOOK_CLOCK_IS_TSC
+        return static_cast<long long>(static_cast<double>(ticks) * clockNanosPerTick);
+#else
+        return static_cast<long long>(ticks);
+#endif
+    }
+
+    //ticks from `since` to `now` as a 32 bit offset (saturates after ~4s of ns, more for tsc ticks)
+    inline uint32_t tickOffset(uint64_t since, uint64_t now) {
+        uint64_t d = (now > since) ? now - since : 0;
+        return (d > 0xFFFFFFFFULL) ? 0xFFFFFFFFU : static_cast<uint32_t>(d);
+    }
+
+    //measures the tick rate against steady_clock, call once at startup before taking timestamps.
+    //a no-op for the steady_clock source
+    void calibrateClock(int calibration_ms = 20);
+
+    const char* clockSourceName(); //"tsc" or "steady_clock"
+
+
+
+#endif
@@ -0,0 +1,153 @@
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "order.h"
+#include "orderbook.h"
+#include "orderchannel.h"
+#include "execution.h"
+#include "symboltable.h"
+#include "latencyhistogram.h"
+#include "clock.h"
+#include "asynclogger.h"
+#include "threadconfig.h"
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+
+    class Recovery;
+
+
+    //one order book per symbol, sharded over N matching threads. a symbol always goes to the
+    //same worker (symbol % N), so its orders are matched in the order the gateway submitted them,
+    //while different symbols match in parallel. every worker has its own inbound channel, so the
+    //gateway is the only producer of each and the handoff stays single producer / single consumer
+    class MatchingEngine {
+
+    private:
+        //legs of an order's trip, from the order's pipeline timestamps to the end of process()
+        enum PipelineStage {
+            STAGE_PARSE,         // recv() returned -> message decoded
+            STAGE_SUBMIT,        // decoded -> in the worker's queue
+            STAGE_QUEUE,         // in the queue -> worker took it
+            STAGE_MATCH,         // worker took it -> book done with it
+            STAGE_WIRE_TO_MATCH, // recv() returned -> book done with it
+            STAGE_COUNT
+        };
+
+        struct Worker {
+            OrderChannel inbound;
+            std::thread thread;
+            long long ordersProcessed = 0;
+            LatencyHistogram stages[STAGE_COUNT]; //orders that came off a socket
+        };
+
+        static void recordStages(Worker &worker, const Order &order, uint64_t matched);
+
+        const SymbolTable* symbols = nullptr;
+        std::vector<std::unique_ptr<Worker>> workers;
+
+        //indexed by symbol id. a book is built by its worker the first time the symbol trades, so a
+        //venue with thousands of listed but quiet instruments only pays for the ones that are active.
+        //each slot is only touched by the owning worker until stop() has joined it
+        std::vector<std::unique_ptr<OrderBook>> books;
+
+        BookEventSink* sink = nullptr;
+        MarketDataSink* marketData = nullptr;
+        size_t poolCapacity = 0;
+        int ladderWindow = OrderBook::DENSE_LADDER;
+        std::string logPrefix; //latency trace per book is <prefix>_<symbol>.bin, empty disables them
+        uint32_t traceEvery = 1;
+        LogFullPolicy tracePolicy = LOG_DROP;
+        std::unique_ptr<AsyncLogger> traceLogger; //one logger thread for every book's trace, a ring per worker
+        static const size_t TRACE_RING_CAPACITY = 1 << 16;
+
+        int fifoPriority = 0;           // workers' SCHED_FIFO priority, 0 for the default scheduler
+        int loggerCpu = -1;
+        bool prefaultBooks = false;     // workers build and touch all their books before taking orders
+        HugePagePolicy hugePages = HUGE_PAGES_OFF;
+        RuntimeStatus* runtimeStatus = nullptr;
+
+        void run(size_t worker, int cpu); //worker thread body, returns once its channel is stopped and drained
+
+        void startTraceLogger(); //the shared trace logger, if there is a log prefix and it isn't running yet
+
+        OrderBook* bookFor(uint32_t symbol, size_t worker); //worker side, builds the book on first use, nullptr if that failed
+
+    public:
+        MatchingEngine() {}
+
+        MatchingEngine(const MatchingEngine&) = delete;
+        MatchingEngine& operator=(const MatchingEngine&) = delete;
+
+        ~MatchingEngine(); //stops and joins the workers if the owner didn't
+
+        int initialize(const SymbolTable &symbol_table, size_t worker_count, ChannelMode mode,
+                       size_t queue_capacity, size_t pool_capacity, int ladder_window, const std::string &log_prefix);
+
+        //events of every book go here, tagged with the worker index. call before start()
+        inline void setEventSink(BookEventSink* event_sink) { sink = event_sink; }
+
+        //level changes of every book go here, tagged with the worker index and the symbol. call before start()
+        inline void setMarketDataSink(MarketDataSink* market_data) { marketData = market_data; }
+
+        //every nth latency of a book goes to its trace file (when there is a log prefix), through a logger
+        //thread that drops or blocks when it falls behind. call before start()
+        inline void setLatencyTrace(uint32_t every, LogFullPolicy policy) {
+            traceEvery = every;
+            tracePolicy = policy;
+        }
+
+        //how start() sets up its threads: workers get SCHED_FIFO at `fifo_priority` (0: not), the trace
+        //logger is pinned to `logger_cpu` (-1: not), and with `prefault_books` every worker builds its
+        //books and faults their memory in before its first order. results go to `status`. call before start()
+        inline void setRuntimeOptions(int fifo_priority, int logger_cpu, bool prefault_books, RuntimeStatus* status) {
+            fifoPriority = fifo_priority;
+            loggerCpu = logger_cpu;
+            prefaultBooks = prefault_books;
+            runtimeStatus = status;
+        }
+
+        //page size books ask for when they are built. call before start()
+        inline void setHugePages(HugePagePolicy policy) { hugePages = policy; }
+
+        //rebuilds the books from a journal directory before start(). every book is built on the calling
+        //thread, level changes go to the market data sink so its books start out right, events are dropped
+        //(the sessions they would go to are gone). call after the sinks are set, a book keeps the ones it
+        //was built with. returns the number of resting orders afterwards
+        size_t recover(const Recovery &recovered);
+
+        //launches the workers, cpus[i] (if given and >= 0) pins worker i
+        void start(const std::vector<int> &cpus);
+
+        inline size_t workerCount() const { return workers.size(); }
+
+        inline size_t symbolCount() const { return books.size(); }
+
+        inline size_t workerFor(uint32_t symbol) const { return symbol % workers.size(); }
+
+        //gateway side, single producer. the symbol must be < symbolCount(). stamps enqueuedAt for socket orders
+        inline void submit(Order &order) {
+            if (order.recvTime != 0) order.enqueuedAt = tickOffset(order.recvTime, clockNow());
+            workers[workerFor(order.symbol)]->inbound.push(order);
+        }
+
+        //same, but false instead of waiting when the worker's inbound ring is full
+        inline bool trySubmit(Order &order) {
+            if (order.recvTime != 0) order.enqueuedAt = tickOffset(order.recvTime, clockNow());
+            return workers[workerFor(order.symbol)]->inbound.tryPush(order);
+        }
+
+        void stop(); //workers drain what they were handed and exit, then get joined
+
+        long long totalOrdersProcessed() const; //only meaningful after stop()
+
+        void writeReport(const std::string &report_filename); //one section per active symbol, after stop()
+    };
+
+
+
+#endif
@@ -0,0 +1,86 @@
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#ifndef EXECUTION_H
+#define EXECUTION_H
+
+
+
+    //what happened to an order inside the book
+    enum ExecType : uint8_t {
+        EXEC_ACCEPTED = 1,  // new order done matching, `quantity` is what rests (0 if it fully traded)
+        EXEC_FILL = 2,      // trade, `quantity` at `price` against `counterId`
+        EXEC_CANCELLED = 3, // `quantity` is what was removed from the book, or what an ioc/fok/market order didn't trade
+        EXEC_MODIFIED = 4,  // `quantity`/`price` are the order's new values
+        EXEC_REJECTED = 5   // could not rest, a post-only order that would cross, or cancel/modify for an unknown id
+    };
+
+
+    //one event produced by OrderBook::process. a trade is a single event that names both sides,
+    //the gateway turns it into one execution report per side.
+    struct BookEvent {
+        uint64_t seq;               // book event sequence number, gapless per book (so per symbol)
+        uint64_t orderId;           // the order the event is about (the aggressor for trades)
+        uint64_t passiveId;         // trades only: the resting order that was hit
+        uint32_t session;           // gateway session owning orderId
+        uint32_t passiveSession;    // trades only: gateway session owning passiveId
+        int price;
+        int quantity;
+        uint8_t type;               // one of ExecType
+        bool buy;                   // side of orderId
+    };
+
+
+    //one side's view of a book event, as sent back to a client
+    struct ExecReport {
+        uint64_t seq;
+        uint64_t orderId;           // the client's order
+        uint64_t counterId;         // fills: the other side's order id
+        int price;
+        int quantity;
+        uint8_t type;               // one of ExecType
+        bool buy;
+    };
+
+
+    //change to the resting size at one price level, collected by OrderBook for market data.
+    //a sweep through a level is one delta, not one per fill
+    struct LevelDelta {
+        int price;
+        int quantity;               // signed change of the level's total resting quantity
+        int orders;                 // signed change of the number of orders resting there
+        bool buy;                   // bid level or ask level
+    };
+
+
+    //totals of one price level, as OrderBook::depth() reports them
+    struct DepthLevel {
+        int price;
+        uint32_t orders;
+        int64_t quantity;
+    };
+
+
+    //where matching threads hand their events. `producer` identifies the calling thread
+    //(0 .. producers-1) so an implementation can give each one its own single producer queue
+    class BookEventSink {
+    public:
+        virtual ~BookEventSink() {}
+
+        virtual void post_events(size_t producer, const std::vector<BookEvent> &events) = 0;
+    };
+
+
+    //where matching threads hand the level changes of one process() call on `symbol`'s book.
+    //same producer numbering as BookEventSink
+    class MarketDataSink {
+    public:
+        virtual ~MarketDataSink() {}
+
+        virtual void post_levels(size_t producer, uint32_t symbol, const std::vector<LevelDelta> &deltas) = 0;
+    };
+
+
+
+#endif
@@ -0,0 +1,331 @@
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "order.h"
+#include "orderbook.h"
+#include "spscqueue.h"
+#include "symboltable.h"
+#include "threadconfig.h"
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+
+
+    //journal directory layout, all fields little-endian:
+    //  journal-<first seq>.log    JournalFileHeader, the symbol names, then JournalRecords back to back.
+    //                             a record whose check doesn't match (a crash in the middle of a write)
+    //                             ends the journal, everything before it is good
+    //  snapshot-<seq>.snap        SnapshotHeader, the symbol names, then for every book a SnapshotBook
+    //                             followed by its resting orders (bids best first, then asks, fifo order
+    //                             within a level), then a SnapshotTrailer over everything before it
+    //symbol names are one per line in symbol id order, zero padded to 8 bytes, like in order files.
+    //recovery loads the newest snapshot that checks out and replays the records after its seq
+    struct JournalFileHeader {
+        char magic[8];          // JOURNAL_MAGIC
+        uint16_t version;       // JOURNAL_VERSION
+        uint16_t recordSize;    // sizeof(JournalRecord)
+        uint32_t symbolBytes;
+        uint64_t firstSeq;      // seq of the first record, also in the file name
+    };
+
+    //one accepted inbound message, as the gateway sequenced it
+    struct JournalRecord {
+        uint64_t seq;
+        uint64_t id;
+        uint32_t session;
+        uint32_t symbol;
+        int32_t price;
+        int32_t quantity;
+        uint8_t action;         // OrderAction
+        uint8_t buy;
+        uint8_t type;           // OrderType
+        uint8_t reserved;
+        uint32_t check;         // checksum of the bytes before it
+    };
+
+    struct SnapshotHeader {
+        char magic[8];          // SNAPSHOT_MAGIC
+        uint16_t version;       // JOURNAL_VERSION
+        uint16_t orderSize;     // sizeof(SnapshotOrder)
+        uint32_t symbolBytes;
+        uint64_t seq;           // last message the books include
+        uint64_t highestOrderId; // of every new order up to seq, so server assigned ids aren't handed out twice
+        uint32_t lastSession;   // highest session id up to seq
+        uint32_t books;
+        uint64_t orders;        // resting orders over all books
+    };
+
+    struct SnapshotBook {
+        uint32_t symbol;
+        uint32_t reserved;
+        uint64_t eventSeq;      // the book's last event seq, reports keep counting from it
+        uint64_t orders;
+    };
+
+    struct SnapshotOrder {
+        uint64_t id;
+        uint32_t session;
+        int32_t price;
+        int32_t quantity;
+        uint8_t buy;
+        uint8_t type;
+        uint16_t reserved;
+    };
+
+    struct SnapshotTrailer {
+        uint64_t check;         // checksum of everything before the trailer
+        uint64_t bytes;         // file size, trailer included
+    };
+
+    static_assert(sizeof(JournalFileHeader) == 24, "journal file header layout");
+    static_assert(sizeof(JournalRecord) == 40, "journal record layout");
+    static_assert(sizeof(SnapshotHeader) == 48, "snapshot header layout");
+    static_assert(sizeof(SnapshotBook) == 24, "snapshot book layout");
+    static_assert(sizeof(SnapshotOrder) == 24, "snapshot order layout");
+
+    static const char JOURNAL_MAGIC[8] = {'O', 'B', 'J', 'O', 'U', 'R', 'N', '\0'};
+    static const char SNAPSHOT_MAGIC[8] = {'O', 'B', 'S', 'N', 'A', 'P', 'S', '\0'};
+    static const uint16_t JOURNAL_VERSION = 1;
+
+
+    //when the journal writer makes what it wrote durable
+    enum JournalSync {
+        JOURNAL_SYNC_NONE,      // write() only: survives server_main dying, not the machine
+        JOURNAL_SYNC_BATCH,     // fdatasync after every group of records
+        JOURNAL_SYNC_INTERVAL   // fdatasync at most every sync interval, a crash loses at most that much
+    };
+
+    //"none", "batch" or a number of ms. false if it doesn't parse
+    bool parseJournalSync(const std::string &spec, JournalSync &sync, int &interval_ms);
+
+
+    //what recovery found in a journal directory: the newest good snapshot, read into memory as it is
+    //on disk, and the journaled messages after it
+    class Recovery {
+
+    public:
+        struct Book {
+            uint32_t symbol;
+            uint64_t eventSeq;
+            const SnapshotOrder* orders;    // into the snapshot buffer
+            size_t count;
+        };
+
+    private:
+        const uint8_t* mapped = nullptr;    // whole snapshot file, mapped read-only
+        size_t mappedSize = 0;
+
+        void unmap();
+
+        //0 if the file is good, 1 if it is damaged, 2 if it was written for a different symbol list
+        int readSnapshot(const std::string &path, const SymbolTable &symbols);
+        int readSegment(const std::string &path, const SymbolTable &symbols, uint64_t after);
+
+    public:
+        Recovery() {}
+        Recovery(const Recovery&) = delete;
+        Recovery& operator=(const Recovery&) = delete;
+        ~Recovery() { unmap(); }
+
+        std::vector<Book> books;
+        std::vector<Order> tail;            // journaled messages after the snapshot, in seq order
+        std::string snapshotFile;           // empty if there was no usable snapshot
+        uint64_t snapshotSeq = 0;
+        uint64_t lastSeq = 0;               // last message recovered, the gateway goes on from the next one
+        uint64_t highestOrderId = 0;
+        uint32_t lastSession = 0;
+        size_t restingOrders = 0;           // in the snapshot
+        size_t segments = 0;                // journal segments read
+        size_t damagedRecords = 0;          // segments cut short by a record that didn't check out
+
+        //recovery stops at the first record that doesn't check out, what comes after it can't be applied
+        //on top of a gap. the journal cuts that segment back to `cutOffset` and sets the later segments
+        //aside before it writes, so new records go on from lastSeq without anything in between
+        std::string cutSegment;             // empty if every segment read to its end
+        uint64_t cutOffset = 0;
+        std::vector<std::string> unusedSegments;
+
+        //reads `dir`. nothing there (or no directory at all) is a fresh start, not an error.
+        //1 (with a message on stderr) if the files were written with a different symbol list
+        int load(const std::string &dir, const SymbolTable &symbols);
+
+        //rebuilds books: every snapshot order is inserted into book_for(symbol), then the tail is processed
+        //through them. `after` gets the book after every batch of inserts and every replayed message,
+        //to drain what the book collected. books book_for can't make (nullptr) are skipped
+        void replay(const std::function<OrderBook*(uint32_t)> &book_for,
+                    const std::function<void(uint32_t, OrderBook&)> &after) const;
+
+        inline bool empty() const { return snapshotFile.empty() && tail.empty(); }
+    };
+
+
+    //write-ahead journal with group commit, plus periodic snapshots, from threads of its own.
+    //the event loop hands every sequenced message over through a ring and goes on, it never waits for
+    //the disk unless the ring is full. the writer thread takes whatever has piled up, writes it with one
+    //write() and syncs per the policy, so the busier the gateway the bigger the groups. it then passes the
+    //records to the snapshot thread, which keeps its own copy of every book by processing them the way
+    //the matching workers do (matching is deterministic) and turns the copies into a snapshot image every
+    //snapshot interval. a third thread writes the image out, so the snapshot thread goes back to taking
+    //records while the disk works and the writer never waits on a snapshot. the matching threads never
+    //see any of this
+    class Journal {
+
+    private:
+        static const size_t SEGMENT_BYTES = 256 << 20; // a segment is closed and a new one started past this
+        static const size_t MAX_BATCH = 1 << 14;       // records per write()
+        static const int SPINS_BEFORE_YIELD = 1000;    // the event loop waits for ring space, records are never dropped
+        static const int IDLE_SLEEP_US = 20;           // nap when there is nothing to write or apply
+        static const size_t HOLD_EVERY = 1 << 14;      // orders put in an image between looks at the ring
+        static const size_t HOLD_LIMIT = 1 << 22;      // records held at most, past that the ring fills up again
+
+        std::string dir;
+        const SymbolTable* symbols = nullptr;
+        std::vector<char> symbolBlock;                  // names as they go in file headers
+        int lockFd = -1;
+
+        JournalSync syncPolicy = JOURNAL_SYNC_BATCH;
+        std::chrono::steady_clock::duration syncInterval{0};
+        std::chrono::steady_clock::duration snapshotInterval{0}; // 0: only when stopping
+
+        SPSCQueue<JournalRecord> inbound;               // event loop -> writer
+        SPSCQueue<JournalRecord> applied;               // writer -> snapshot thread, once written
+
+        //writer thread
+        int segmentFd = -1;
+        size_t segmentBytes = 0;
+        std::vector<JournalRecord> batch;
+        std::chrono::steady_clock::time_point lastSync;
+        bool syncPending = false;
+
+        //snapshot thread, its copy of the books
+        size_t poolCapacity = 0;
+        int ladderWindow = OrderBook::DENSE_LADDER;
+        std::vector<std::unique_ptr<OrderBook>> books;
+        std::shared_ptr<const Recovery> recovered;      // released once the copies are rebuilt
+        uint64_t lastApplied = 0;
+        uint64_t highestOrderId = 0;
+        uint32_t lastSession = 0;
+        std::vector<char> snapshotBuffer;               // the image being built, swapped with ioBuffer when handed over
+        std::vector<JournalRecord> held;                // taken off the ring while an image was built, applied after
+
+        //snapshot i/o thread. ioPending is set when an image is handed over and cleared once it is on
+        //disk, the snapshot thread only builds the next one while it is clear
+        std::vector<char> ioBuffer;
+        uint64_t ioSeq = 0;
+        uint64_t ioOrders = 0;
+        std::mutex ioMutex;
+        std::condition_variable ioWake;                 // an image to write, stop, or an image written
+        std::atomic<bool> ioPending{false};
+        bool ioStop = false;
+        std::atomic<uint64_t> lastSnapshotSeq{0};       // newest snapshot on disk
+
+        std::thread writerThread;
+        std::thread snapshotThread;
+        std::thread snapshotIoThread;
+        ThreadPlacement placement;
+        RuntimeStatus* runtimeStatus = nullptr;
+        std::atomic<bool> writerStop{false};
+        std::atomic<bool> snapshotStop{false};
+        bool running = false;
+
+        //event loop side
+        uint64_t appendWaits = 0;           // appends that found the ring full
+
+        //writer and snapshot thread side, read by the report after stop()
+        uint64_t recordsWritten = 0;
+        uint64_t batches = 0;
+        uint64_t largestBatch = 0;
+        uint64_t syncs = 0;
+        uint64_t segmentsOpened = 0;
+        uint64_t writeErrors = 0;
+        uint64_t snapshotsWritten = 0;
+        uint64_t snapshotErrors = 0;
+        uint64_t lastSnapshotOrders = 0;
+        uint64_t lastSnapshotBytes = 0;
+        double lastSnapshotBuildMs = 0;
+        double lastSnapshotWriteMs = 0;
+
+        void runWriter();
+        void runSnapshots();
+        size_t writeBatch();                // takes up to MAX_BATCH records off the ring and writes them
+        bool openSegment(uint64_t first_seq);
+        void closeSegment();
+        void sync();
+        void apply(const JournalRecord &record);
+        OrderBook* bookFor(uint32_t symbol);
+        void queueSnapshot();               // builds an image of the copies and hands it to the i/o thread
+        void holdApplied();                 // empties the ring into `held` without touching the copies
+        void catchUp();                     // applies `held`
+        void runSnapshotWrites();
+        void writeSnapshot();               // i/o thread: ioBuffer to disk
+        void prune(uint64_t keep_seq);      // removes snapshots and segments nothing after keep_seq needs
+
+    public:
+        Journal() {}
+
+        Journal(const Journal&) = delete;
+        Journal& operator=(const Journal&) = delete;
+
+        ~Journal(); //stops the threads
+
+        //creates `journal_dir` if needed and locks it, so two servers can't write the same journal.
+        //the book copies are built with the engine's pool capacity and ladder window so they fill up
+        //and reject the same way. `snapshot_ms` 0 only snapshots when stopping.
+        //0 on success, 1 (with a message on stderr) otherwise
+        int initialize(const std::string &journal_dir, const SymbolTable &symbol_table, size_t pool_capacity,
+                       int ladder_window, JournalSync sync, int sync_interval_ms, int snapshot_ms, size_t ring_capacity);
+
+        //where the journal threads run. call before start()
+        inline void setPlacement(const ThreadPlacement &where, RuntimeStatus* status) {
+            placement = where;
+            runtimeStatus = status;
+        }
+
+        //`from` (may be null) is what recovery found, the snapshot thread rebuilds its copies from it.
+        //a damaged journal recovery stopped in is cut back and set aside first (Recovery::cutSegment)
+        void start(const std::shared_ptr<const Recovery> &from);
+
+        //writes what was appended, then the snapshot thread catches up and writes a last snapshot.
+        //call after the event loop has exited
+        void stop();
+
+        //event loop side, single producer. the order must have been stamped with its seq
+        inline void append(const Order &o) {
+            JournalRecord r;
+            r.seq = o.seq;
+            r.id = o.id;
+            r.session = o.session;
+            r.symbol = o.symbol;
+            r.price = o.price;
+            r.quantity = o.quantity;
+            r.action = o.action;
+            r.buy = o.buy ? 1 : 0;
+            r.type = o.type;
+            r.reserved = 0;
+            r.check = 0; //filled in by the writer
+            if (inbound.tryPush(r)) return;
+            appendWaits++;
+            for (int spins = 0; !inbound.tryPush(r); ++spins) {
+                if (spins < SPINS_BEFORE_YIELD) cpuRelax();
+                else std::this_thread::yield();
+            }
+        }
+
+        inline const std::string& directory() const { return dir; }
+
+        void writeReport(std::ostream &out) const;
+    };
+
+
+
+#endif
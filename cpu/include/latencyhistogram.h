@@ -0,0 +1,73 @@
+#include <cstdint>
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+
+
+    //log-linear (hdr style) histogram of nanosecond latencies.
+    //values below 128 get exact buckets, every power of two above that is split into 64 linear
+    //buckets, so any recorded value is off by at most 1/64 (~1.6%). recording is a couple of shifts
+    //and an increment into a fixed 18KB table, nothing is allocated or written out while measuring
+    class LatencyHistogram {
+
+    private:
+        static const int SUB_BITS = 7;                      // 128 exact buckets, 64 per power of two after
+        static const uint64_t SUB_COUNT = 1ULL << SUB_BITS;
+        static const uint64_t HALF_COUNT = SUB_COUNT / 2;
+        static const int MAX_BITS = 40;                     // ~18 minutes, larger values are clamped
+        static const uint64_t MAX_VALUE = (1ULL << MAX_BITS) - 1;
+        static const size_t BUCKET_COUNT = SUB_COUNT + (MAX_BITS - SUB_BITS) * HALF_COUNT;
+
+        std::vector<uint64_t> counts;
+        uint64_t total = 0;
+        uint64_t minValue = 0;
+        uint64_t maxValue = 0;
+        long double sum = 0;
+
+        static inline size_t bucketOf(uint64_t v) {
+            if (v < SUB_COUNT) return static_cast<size_t>(v);
+            int shift = (63 - __builtin_clzll(v)) - (SUB_BITS - 1); // v >> shift lands in [64, 128)
+            return static_cast<size_t>(SUB_COUNT + (shift - 1) * HALF_COUNT + ((v >> shift) - HALF_COUNT));
+        }
+
+        static uint64_t highestInBucket(size_t bucket); //largest value that lands in bucket
+
+    public:
+        LatencyHistogram() : counts(BUCKET_COUNT, 0) {}
+
+        inline void record(long long nanos) {
+            uint64_t v = (nanos < 0) ? 0 : static_cast<uint64_t>(nanos);
+            if (v > MAX_VALUE) v = MAX_VALUE;
+            counts[bucketOf(v)]++;
+            if (total == 0 || v < minValue) minValue = v;
+            if (v > maxValue) maxValue = v;
+            sum += v;
+            total++;
+        }
+
+        void reset();
+
+        void merge(const LatencyHistogram &other);
+
+        inline uint64_t count() const { return total; }
+        inline uint64_t min() const { return minValue; }
+        inline uint64_t max() const { return maxValue; }
+        inline double mean() const { return total ? static_cast<double>(sum / total) : 0.0; }
+
+        //value at or below which `percent` of the recordings fall, 0 if nothing was recorded
+        uint64_t percentile(double percent) const;
+
+        //min/avg/max plus p50 .. p99.99, one "<label>: <value>" line each
+        void writeSummary(std::ostream &out) const;
+
+        //"<label> (ns): p50 .. p99 .. p99.9 .. max .." on one line
+        void writeLine(std::ostream &out, const char* label) const;
+    };
+
+
+
+#endif
@@ -0,0 +1,76 @@
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <map>
+#include <utility>
+#include <vector>
+#include "order.h"
+#include "execution.h"
+
+#ifndef MAPBOOK_H
+#define MAPBOOK_H
+
+
+
+    //textbook price-time book on std::map levels of std::list fifos.
+    //same rules and the same event stream as OrderBook, written for obviousness rather than speed:
+    //the benchmark uses it as the baseline and to check that faster books still match the same way
+    class MapOrderBook {
+
+    private:
+        static const int MIN_PRICE = 1;
+        static const int MAX_PRICE = 1000000;
+
+        typedef std::list<Order> Level;
+        std::map<int, Level, std::greater<int>> bids; // best (highest) first
+        std::map<int, Level> asks;                    // best (lowest) first
+
+        struct Location {
+            int price;
+            bool buy;
+            Level::iterator it;
+        };
+        typedef std::map<std::pair<uint32_t, uint64_t>, Location> Index;
+        Index index; // (session, id) -> where the order rests
+
+        std::vector<BookEvent> eventBuffer;
+        uint64_t eventSeq = 0;
+
+        static inline std::pair<uint32_t, uint64_t> key(uint64_t id, uint32_t session) { return std::make_pair(session, id); }
+
+        inline void emit(uint8_t type, uint64_t id, uint32_t session, bool buy, int price, int quantity) {
+            eventBuffer.push_back(BookEvent{++eventSeq, id, 0, session, 0, price, quantity, type, buy});
+        }
+
+        template <typename Side>
+        void sweep(Order &order, int limit, Side &side, bool crosses(int, int));
+
+        //quantity on `side` at prices that cross `limit`, summed order by order
+        template <typename Side>
+        static int64_t available(int limit, const Side &side, bool crosses(int, int));
+
+        void match(Order &order, uint8_t doneType);
+        bool rest(const Order &order);
+        void remove(Index::iterator it);
+        bool cancel(uint64_t id, uint32_t session);
+        void modify(uint64_t id, int quantity, int price, uint32_t session);
+
+    public:
+        int initialize();
+
+        void process(Order &order);
+
+        inline const std::vector<BookEvent>& events() const { return eventBuffer; }
+
+        inline void clearEvents() { eventBuffer.clear(); }
+
+        inline size_t restingOrders() const { return index.size(); }
+
+        //same as OrderBook::depth(), summed from the orders
+        size_t depth(bool bid_side, size_t n, std::vector<DepthLevel> &out) const;
+    };
+
+
+
+#endif
@@ -0,0 +1,209 @@
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <netinet/in.h>
+#include "execution.h"
+#include "spscqueue.h"
+#include "symboltable.h"
+#include "threadconfig.h"
+
+#ifndef MARKETDATA_H
+#define MARKETDATA_H
+
+
+
+    //market data datagrams, all fields little-endian:
+    //  MdPacketHeader, then `messages` messages back to back. every message starts with its type byte.
+    //level updates carry a gapless sequence number per symbol. a consumer that sees a gap (lost datagram)
+    //waits for the next snapshot of that symbol and applies the updates that come after its seq
+    struct MdPacketHeader {
+        uint32_t magic;         // MD_MAGIC
+        uint16_t messages;
+        uint16_t bytes;         // whole datagram, header included
+        uint64_t packetSeq;     // gapless per publisher
+    };
+
+    enum MdMessageType : uint8_t {
+        MD_LEVEL_UPDATE = 1,
+        MD_SNAPSHOT = 2
+    };
+
+    //one level's new totals. quantity 0 means the level is gone
+    struct MdLevelUpdate {
+        uint8_t type;           // MD_LEVEL_UPDATE
+        uint8_t buy;
+        uint16_t reserved;
+        uint32_t symbol;
+        uint64_t seq;
+        int32_t price;
+        uint32_t orders;
+        int64_t quantity;
+    };
+
+    //top levels of one book, followed by bidLevels then askLevels MdSnapshotLevels, best first.
+    //`seq` is the last level update sent for the symbol, the snapshot already includes it
+    struct MdSnapshot {
+        uint8_t type;           // MD_SNAPSHOT
+        uint8_t reserved;
+        uint16_t bidLevels;
+        uint16_t askLevels;
+        uint16_t reserved2;
+        uint32_t symbol;
+        uint64_t seq;
+    };
+
+    struct MdSnapshotLevel {
+        int32_t price;
+        uint32_t orders;
+        int64_t quantity;
+    };
+
+    static_assert(sizeof(MdPacketHeader) == 16, "market data packet header layout");
+    static_assert(sizeof(MdLevelUpdate) == 32, "market data level update layout");
+    static_assert(sizeof(MdSnapshot) == 24, "market data snapshot layout");
+    static_assert(sizeof(MdSnapshotLevel) == 16, "market data snapshot level layout");
+
+    static const uint32_t MD_MAGIC = 0x3150444D; // "MDP1"
+    static const size_t MD_MAX_PACKET = 1400;    // stays under an ethernet mtu when the group leaves the host
+    static const size_t MD_MAX_SNAPSHOT_DEPTH = (MD_MAX_PACKET - sizeof(MdPacketHeader) - sizeof(MdSnapshot)) /
+                                                sizeof(MdSnapshotLevel) / 2;
+
+    //"239.1.1.1:5001" -> address. false if it doesn't parse
+    bool parseEndpoint(const std::string &spec, sockaddr_in &out);
+
+
+    //publishes L2 depth over udp (multicast or unicast) from its own thread.
+    //matching workers hand over the level deltas of every process() call through a ring each and go
+    //on matching, the publisher keeps a shadow of every book's levels and sends the levels that changed.
+    //a worker that finds its ring full doesn't wait for the publisher either, it merges the deltas per
+    //level on the side and the publisher takes them once it has emptied the ring.
+    //a level that changes again before it went out is sent once with its latest totals, so when the
+    //socket backs up (consumers or the network can't keep up) updates conflate instead of queueing.
+    //snapshots of the top levels go out every snapshot interval so late joiners and consumers that
+    //lost a datagram can resync
+    class MarketDataPublisher : public MarketDataSink {
+
+    private:
+        static const int IDLE_SLEEP_US = 20;        // publisher nap when every ring is empty
+
+        struct QueuedDelta {
+            uint32_t symbol;
+            bool last;          // ends the deltas of one process() call
+            LevelDelta delta;
+        };
+
+        //where a worker's deltas go while its ring is full. deltas for one level add up, so there is one
+        //entry per level however far behind the publisher is. everything in here came after what is in
+        //the ring, and a worker merges a whole process() call at a time, so taking it all at once still
+        //gives a state the book was in
+        struct Overflow {
+            std::mutex mutex;
+            std::atomic<bool> active{false};                    // levels has something, later deltas go there too
+            std::unordered_map<uint64_t, QueuedDelta> levels;   // by symbol, side and price
+            uint64_t deltas = 0;                                // merged in here, worker side
+        };
+
+        struct Level {
+            int64_t quantity = 0;
+            int64_t orders = 0;
+            bool dirty = false; // waiting in `dirty`
+        };
+
+        struct ShadowBook {
+            std::map<int, Level, std::greater<int>> bids;   // best first
+            std::map<int, Level> asks;
+            uint64_t seq = 0;                               // last level update sent
+        };
+
+        struct DirtyLevel {
+            uint32_t symbol;
+            int price;
+            bool buy;
+        };
+
+        std::vector<ShadowBook> books;
+        std::vector<std::unique_ptr<SPSCQueue<QueuedDelta>>> rings; // one per matching worker
+        std::vector<std::unique_ptr<Overflow>> overflows;           // one per matching worker
+        std::unordered_map<uint64_t, QueuedDelta> overflowTaken;    // publisher side, swapped with an Overflow's levels
+        std::vector<DirtyLevel> dirty;      // levels changed since they were last sent, in change order
+        size_t snapshotDepth = 10;
+        uint64_t snapshotTicks = 0;         // 0: no snapshots
+        uint64_t lastSnapshot = 0;
+
+        int sock = -1;
+        sockaddr_in destination = {};
+        std::vector<uint8_t> packet;        // datagram being filled
+        uint16_t packetMessages = 0;
+        bool packetPending = false;         // complete, but the socket had no room for it
+        uint64_t packetSeq = 0;
+
+        std::thread thread;
+        std::string threadName;
+        ThreadPlacement placement;
+        RuntimeStatus* runtimeStatus = nullptr;
+        std::atomic<bool> stopRequested{false};
+        bool running = false;
+
+        //publisher thread side, read by the report after stop()
+        uint64_t deltasApplied = 0;
+        uint64_t updatesSent = 0;
+        uint64_t updatesConflated = 0;      // deltas that landed on a level already waiting to go out
+        uint64_t overflowsTaken = 0;        // times a worker's ring filled up and its overflow was picked up
+        uint64_t snapshotsSent = 0;
+        uint64_t packetsSent = 0;
+        uint64_t sendBlocked = 0;           // sends that found the socket buffer full
+        uint64_t sendErrors = 0;
+
+        void run();
+        size_t drain();                     // applies everything queued, returns the number of deltas
+        size_t takeOverflow(size_t producer); // applies what producer merged while its ring was full
+        void apply(const QueuedDelta &q);
+        bool publish();                     // false if the socket backed up before every dirty level went out
+        void snapshot();
+        bool reserve(size_t bytes);         // room for a message in the packet, sending the full one first
+        bool sendPacket();                  // false if it has to be retried
+
+    public:
+        MarketDataPublisher() {}
+
+        MarketDataPublisher(const MarketDataPublisher&) = delete;
+        MarketDataPublisher& operator=(const MarketDataPublisher&) = delete;
+
+        ~MarketDataPublisher(); //stops the thread
+
+        //datagrams go to `destination` (a multicast group is sent through `interface_ip`, and looped back
+        //so consumers on this host see it). `snapshot_ms` 0 turns snapshots off.
+        //0 on success, 1 (with a message on stderr) if the socket can't be set up
+        int initialize(const SymbolTable &symbol_table, size_t producer_count, size_t ring_capacity,
+                       const sockaddr_in &destination_addr, const std::string &interface_ip,
+                       int snapshot_ms, size_t snapshot_depth);
+
+        //where the publisher thread runs. call before start()
+        inline void setPlacement(const std::string &name, const ThreadPlacement &where, RuntimeStatus* status) {
+            threadName = name;
+            placement = where;
+            runtimeStatus = status;
+        }
+
+        void start();
+
+        void stop(); //publishes what the workers left and a last round of snapshots, call after the workers are gone
+
+        //matching thread side
+        void post_levels(size_t producer, uint32_t symbol, const std::vector<LevelDelta> &deltas) override;
+
+        void writeReport(std::ostream &out) const;
+    };
+
+
+
+#endif
@@ -0,0 +1,71 @@
+#include <cstddef>
+#include <string>
+
+#ifndef MEMORYCONFIG_H
+#define MEMORYCONFIG_H
+
+
+
+    //mlockall(MCL_CURRENT | MCL_FUTURE): nothing mapped now or later gets paged out, and later
+    //mappings are faulted in when they are made. returns 0 on success, an errno value otherwise
+    int lockAllMemory();
+
+    //writes to every page of [p, p + bytes) without changing its contents, so the page faults of
+    //first touch happen now instead of on the first order that lands there. returns `bytes`
+    size_t prefaultMemory(void* p, size_t bytes);
+
+
+    static const size_t HUGE_PAGE_SIZE = 2u << 20;
+
+    //what PageBuffer asks the kernel for
+    enum HugePagePolicy {
+        HUGE_PAGES_OFF,         // normal 4KB pages
+        HUGE_PAGES_TRANSPARENT, // madvise(MADV_HUGEPAGE) on a 2MB aligned mapping
+        HUGE_PAGES_EXPLICIT     // MAP_HUGETLB from the reserved pool (vm.nr_hugepages), transparent if that is empty
+    };
+
+    //what a PageBuffer actually got
+    enum PageBacking {
+        PAGES_NONE,
+        PAGES_SMALL,
+        PAGES_TRANSPARENT_HUGE,
+        PAGES_EXPLICIT_HUGE
+    };
+
+
+    //zero-filled anonymous mapping, huge-page backed when the policy asks for it and the kernel has them.
+    //large tables touched at random (order slabs, index tables, ladders) take a tlb miss on most accesses
+    //with 4KB pages, a 2MB page covers 512 times as much. every huge page request falls back to the next
+    //weaker one, so allocate() only fails when there is no memory at all
+    class PageBuffer {
+
+    private:
+        void* base = nullptr;
+        size_t length = 0;      // mapped bytes, a multiple of the page size used
+        PageBacking backing = PAGES_NONE;
+
+    public:
+        PageBuffer() = default;
+        PageBuffer(const PageBuffer&) = delete;
+        PageBuffer& operator=(const PageBuffer&) = delete;
+        ~PageBuffer() { release(); }
+
+        //replaces the current mapping. 0 on success, 1 (with a message on stderr) if nothing could be mapped
+        int allocate(size_t bytes, HugePagePolicy policy);
+
+        void release();
+
+        inline void* data() const { return base; }
+        inline size_t size() const { return length; }
+        inline PageBacking pageBacking() const { return backing; }
+    };
+
+
+    //"off", "thp" or "explicit", false for anything else
+    bool parseHugePagePolicy(const std::string &name, HugePagePolicy &out);
+
+    const char* pageBackingName(PageBacking backing);
+
+
+
+#endif
@@ -0,0 +1,48 @@
+#include <cstdint>
+
+#ifndef ORDER_H
+#define ORDER_H
+
+
+
+    //what an inbound message asks the book to do
+    enum OrderAction : uint8_t {
+        ORDER_NEW = 0,      // match, then rest whatever is left
+        ORDER_CANCEL = 1,   // remove resting order `id`
+        ORDER_MODIFY = 2    // change quantity and/or price of resting order `id`
+    };
+
+
+    //what a new order does with quantity that doesn't trade on arrival
+    enum OrderType : uint8_t {
+        ORDER_LIMIT = 0,        // trade up to its price, rest the rest
+        ORDER_IOC = 1,          // immediate or cancel: trade up to its price, cancel the rest
+        ORDER_FOK = 2,          // fill or kill: all of it trades right away up to its price, or none of it does
+        ORDER_MARKET = 3,       // trade at whatever prices the other side has, cancel the rest. price is ignored
+        ORDER_POST_ONLY = 4     // rest without trading, rejected if it would cross
+    };
+    static const uint8_t ORDER_TYPE_COUNT = 5;
+
+
+    struct Order {
+        uint64_t id;        // order id, unique among resting orders (0 is reserved for "no id")
+        uint64_t seq;       // gateway sequence number, the order messages were accepted in across all sessions
+        uint32_t session;   // gateway session the message came in on (0 for orders that didn't come from a client)
+        uint32_t symbol;    // instrument id (index into the engine's symbol table, 0 if there is only one)
+        int price;          // integer price (for modify: new price, 0 keeps the current one)
+        int quantity;       // quantity remaining (for modify: new remaining quantity)
+        bool buy;           // true for buy, false for sell
+        uint8_t action;     // one of OrderAction
+        uint8_t type = ORDER_LIMIT; // new orders: one of OrderType
+
+        //pipeline timestamps (clock.h ticks) for orders that came off a socket, recvTime 0 otherwise.
+        //the later points are offsets from recvTime so the order stays one cache line
+        uint64_t recvTime = 0;      // the recv() that delivered the message returned
+        uint32_t parsedAt = 0;      // message decoded
+        uint32_t enqueuedAt = 0;    // handed to the matching worker's queue
+        uint32_t dequeuedAt = 0;    // matching worker took it off the queue
+    };
+
+
+
+#endif
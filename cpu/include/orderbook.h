@@ -1,9 +1,18 @@
 #include <vector>
-#include <deque>
 #include <chrono>
 #include <fstream>
 #include <algorithm> // for std::min
 #include <iostream> 
+#include <limits>
+#include "order.h"
+#include "orderpool.h"
+#include "priceladder.h"
+#include "orderindex.h"
+#include "execution.h"
+#include "latencyhistogram.h"
+#include "clock.h"
+#include "asynclogger.h"
+#include <memory>
 
 
 #ifndef ORDERBOOK_H
@@ -12,14 +21,6 @@
 
 
 
-    struct Order {
-        bool buy;           // true for buy, false for sell
-        int price;          // integer price
-        int quantity;       // quantity remaining
-        // int client_id;      //id of client placing order (so if we match, we know who to tell)
-    };
-
-
     class OrderBook {
 
     private:
@@ -28,30 +29,92 @@
         static const int MAX_PRICE = 1000000; //1M means a max price of $10k per security
         static const int PRICE_RANGE = MAX_PRICE - MIN_PRICE + 1;
 
-        int bestBidIndex = -1; 
-        int bestAskIndex = -1; 
+        int bestBidPrice = -1; 
+        int bestAskPrice = -1; 
     
 
-        std::vector<std::deque<Order>> bids; // array of queues for buy orders
-        std::vector<std::deque<Order>> asks; // array of queues for sell orders
-
-        std::vector<long long> latencyLog; 
-        static const size_t BATCH_SIZE = 10000;
-        std::ofstream logFile;
+        static const size_t DEFAULT_POOL_CAPACITY = 1 << 22; //max resting orders across both sides
+
+        PriceLadder bids; // fifo heads/tails for buy orders, by price
+        PriceLadder asks; // fifo heads/tails for sell orders, by price
+        OrderPool pool; // every resting order lives here
+        OrderIndex orderIndex; // (session, order id) -> pool node, so cancels never scan a level
+
+        //events from the current process() call, only collected when enabled.
+        //reserved up front so a normal order never allocates; a huge sweep may grow it once
+        static const size_t EVENT_BUFFER_RESERVE = 1 << 16;
+        std::vector<BookEvent> eventBuffer;
+        bool eventsEnabled = false;
+        uint64_t eventSeq = 0;
+
+        //level changes from the current process() call, for market data. same reserve/drain rules as events
+        std::vector<LevelDelta> levelBuffer;
+        bool levelsEnabled = false;
+
+        //optional raw trace: every traceEvery-th latency goes to log_file_name, the histogram sees all of them.
+        //samples are handed to a logger thread, process() itself never writes to the file
+        static const size_t TRACE_RING_CAPACITY = 1 << 16; //samples in flight when the book runs its own logger
+        uint32_t traceEvery = 1;
+        uint32_t traceCountdown = 1;
+        AsyncLogger* logger = nullptr;           // shared one from attachLogger(), or ownLogger
+        std::unique_ptr<AsyncLogger> ownLogger;  // books without a shared logger start their own
+        size_t logProducer = 0;
+        int logStream = -1;                      // -1: no trace
         std::string log_file_name;
+        size_t poolCapacity;
+        int ladderWindow; //prices kept in each side's dense window, DENSE_LADDER for all of them
+        HugePagePolicy hugePages = HUGE_PAGES_OFF; //for the pool, the index and the ladder windows
 
 
         //these are for generating a report
-        long long totalLatencySum = 0;
+        LatencyHistogram latencyHistogram; //every process() call
         long long totalOrdersProcessed = 0;
-        long long minLatency = std::numeric_limits<long long>::max();
-        long long maxLatency = std::numeric_limits<long long>::lowest();
+        long long rejectedOrders = 0; //orders that could not rest (pool full, id already resting, price off the ladder)
+        long long cancelledOrders = 0;
+        long long modifiedOrders = 0;
+        long long unknownOrderIds = 0; //cancels/modifies for orders that are not resting
+        long long unfilledOrders = 0; //ioc/fok/market orders that had quantity left, cancelled instead of resting
+        long long postOnlyRejects = 0; //post-only orders that would have crossed
+
+
+
+        //matches a new order against the other side, then rests the remainder and reports it as doneType,
+        //or cancels it if the order type says it must not rest
+        void match(Order &order, uint8_t doneType);
+
+        void removeResting(uint32_t node); //unlinks a resting order and fixes up the level bookkeeping
+
+        //the seq counts even with events off, so a copy of the book (the journal's) numbers them like the live one
+        inline void emit(uint8_t type, uint64_t id, uint32_t session, bool buy, int price, int quantity) {
+            ++eventSeq;
+            if (!eventsEnabled) return;
+            eventBuffer.push_back(BookEvent{eventSeq, id, 0, session, 0, price, quantity, type, buy});
+        }
+
+        //keeps a level's totals in step with its fifo, and tells market data when enabled
+        inline void adjustLevel(PriceLevel &level, bool buy, int price, int quantity, int orders) {
+            level.quantity += quantity;
+            level.orders += orders;
+            if (!levelsEnabled || (quantity == 0 && orders == 0)) return;
+            levelBuffer.push_back(LevelDelta{price, quantity, orders, buy});
+        }
+
+        inline void emitTrade(const Order &aggressor, const Order &passive, int price, int quantity) {
+            ++eventSeq;
+            if (!eventsEnabled) return;
+            eventBuffer.push_back(BookEvent{eventSeq, aggressor.id, passive.id, aggressor.session, passive.session,
+                                            price, quantity, EXEC_FILL, aggressor.buy});
+        }
 
 
 
     public:
-        //default constructor
-        OrderBook(std::string& log_file) : log_file_name(log_file) {}
+        static const int DENSE_LADDER = 0; //ladder window covering the whole price range
+
+        //default constructor. a ladder window of a few thousand prices keeps a book small enough to
+        //run thousands of them, levels outside the window go to a sorted map
+        OrderBook(std::string& log_file, size_t pool_capacity = DEFAULT_POOL_CAPACITY, int ladder_window = DENSE_LADDER)
+            : log_file_name(log_file), poolCapacity(pool_capacity), ladderWindow(ladder_window) {}
 
         // convert price in regular form (4.56) to cents (456)
         inline int priceToCents(double priceDollars) {
@@ -67,18 +130,90 @@
 
         int initialize(); //gets everything ready
 
-        void flushLatencyData();
+        //commits the pool and index pages now instead of on first use, returns the bytes touched.
+        //the ladders are written by initialize() already
+        size_t prefault();
+
+        //trace through a logger shared with other books, as its producer `producer`. call before initialize()
+        inline void attachLogger(AsyncLogger* shared, size_t producer) {
+            logger = shared;
+            logProducer = producer;
+        }
+
+        //page size to ask for when initialize() allocates the book's tables, the report says what it got
+        inline void setHugePages(HugePagePolicy policy) { hugePages = policy; }
+
+        //raw trace keeps every nth latency (1: all of them), only matters when there is a log file
+        inline void setTraceSampling(uint32_t every) { traceEvery = traceCountdown = (every == 0) ? 1 : every; }
 
-        void insert(const Order& order); //adds order to orderbook
+        inline const LatencyHistogram& latencies() const { return latencyHistogram; }
+
+        //best n levels of one side with their totals, best first. `out` is cleared first and can be
+        //reused between calls. costs one bitmap scan per level, individual orders are never read
+        size_t depth(bool bid_side, size_t n, std::vector<DepthLevel> &out) const;
+
+        //total quantity resting at price on one side, 0 if none
+        inline int64_t quantityAt(bool bid_side, int price) const {
+            const PriceLevel* level = bid_side ? bids.find(price) : asks.find(price);
+            return level ? level->quantity : 0;
+        }
+
+        //calls fn(order) for every resting order, bids best first and then asks, in fifo order within a level
+        template <typename Fn>
+        void forEachResting(Fn fn) const {
+            auto level = [&](int, const PriceLevel &l) {
+                for (uint32_t node = l.head; node != OrderPool::NIL; node = pool[node].next) fn(pool[node].order);
+                return true;
+            };
+            bids.forEachBest(level);
+            asks.forEachBest(level);
+        }
+
+        inline size_t restingOrders() const { return pool.inUse(); }
+
+        //seq of the last event, and where to count on from for a book rebuilt from a snapshot
+        inline uint64_t eventSequence() const { return eventSeq; }
+        inline void setEventSequence(uint64_t seq) { eventSeq = seq; }
+
+        inline int bestBid() const { return bestBidPrice; } //-1 if there are no bids
+        inline int bestAsk() const { return bestAskPrice; } //-1 if there are no asks
+
+        bool insert(const Order& order); //adds order to orderbook, false if it could not rest
+
+        //warms up what inserting (session, id) will touch first. bulk loads call it a few orders ahead,
+        //since a big book's index misses the cache on nearly every insert
+        inline void prefetchInsert(uint64_t order_id, uint32_t session) const { orderIndex.prefetch(order_id, session); }
 
         void cleanup(); //cleans up levels
 
-        void finalize_log();
+        void finalize_log(); //stops the book's own logger thread, everything traced so far is on disk
 
-        void process(Order &order);
+        void process(Order &order); //handles a new, cancel or modify message
+
+        //turns on event collection. the caller must drain events() and clearEvents() after every process()
+        void enableEvents(bool enabled);
+
+        inline const std::vector<BookEvent>& events() const { return eventBuffer; }
+
+        inline void clearEvents() { eventBuffer.clear(); }
+
+        //turns on level change collection. the caller must drain levelDeltas() and clearLevelDeltas() after every process()
+        void enableLevelDeltas(bool enabled);
+
+        inline const std::vector<LevelDelta>& levelDeltas() const { return levelBuffer; }
+
+        inline void clearLevelDeltas() { levelBuffer.clear(); }
+
+        //removes a resting order, false if the session has no resting order with that id
+        bool cancel(uint64_t order_id, uint32_t session = 0);
+
+        //new_price 0 keeps the price. false if the session has no resting order with that id
+        bool modify(uint64_t order_id, int new_quantity, int new_price = 0, uint32_t session = 0);
 
         void writeReport(const std::string &report_filename);
 
+        void writeReport(std::ostream &out); //just the statistics, for reports that cover several books
+
     };
 
 
@@ -0,0 +1,62 @@
+#include <queue>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <condition_variable>
+#include "order.h"
+#include "spscqueue.h"
+
+#ifndef ORDERCHANNEL_H
+#define ORDERCHANNEL_H
+
+
+
+    //how orders get from the network thread to the matching thread
+    enum ChannelMode {
+        CHANNEL_MUTEX,  // std::queue + mutex + condition variable, one notify per order
+        CHANNEL_SPIN,   // lock-free ring, consumer busy-polls (lowest latency, burns a core)
+        CHANNEL_HYBRID  // lock-free ring, consumer spins for a while then parks until the producer rings
+    };
+
+
+    //single producer / single consumer handoff with a mode picked at startup
+    class OrderChannel {
+
+    private:
+        static const int SPIN_LIMIT = 20000; //empty polls before a hybrid consumer parks
+
+        ChannelMode mode = CHANNEL_MUTEX;
+
+        //mutex mode, also used to park the hybrid consumer
+        std::queue<Order> queue;
+        std::mutex mutex;
+        std::condition_variable cv;
+
+        //ring modes
+        SPSCQueue<Order> ring;
+        alignas(CACHE_LINE_SIZE) std::atomic<bool> parked{false}; // hybrid consumer is (about to be) asleep on cv
+        alignas(CACHE_LINE_SIZE) std::atomic<bool> stopped{false};
+
+        bool park(); //hybrid consumer sleeps until there is work or stop(), false if stopped
+
+    public:
+        int initialize(ChannelMode channel_mode, size_t capacity);
+
+        inline ChannelMode getMode() const { return mode; }
+
+        void push(const Order& order); //producer, waits for space if the ring is full
+
+        bool tryPush(const Order& order); //producer, false if the ring is full (mutex mode never is)
+
+        bool pop(Order& order); //consumer, waits per mode. false once stopped and drained
+
+        void stop(); //wakes the consumer, which drains what is left and then gets false from pop()
+
+        static bool parseMode(const std::string& name, ChannelMode& out);
+
+        static const char* modeName(ChannelMode m);
+    };
+
+
+
+#endif
@@ -0,0 +1,213 @@
+#include <cstdint>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "order.h"
+
+#ifndef ORDERFILE_H
+#define ORDERFILE_H
+
+
+
+    //legacy on-disk order record: a size_t count, then these with the compiler's padding (12 bytes).
+    //still read so old captures stay loadable, no longer written
+    struct StoredOrder {
+        bool buy;
+        int price;
+        int quantity;
+    };
+
+
+    //versioned order file, all fields little-endian:
+    //  OrderFileHeader
+    //  symbolBytes of symbol names, one per line, in symbol id order (then zero padding to 8 bytes)
+    //  recordCount OrderRecords of recordSize bytes each, or with ORDER_FILE_COMPRESSED a sequence of
+    //  blocks (OrderBlockHeader + encoded bytes) of at most blockRecords records each
+    struct OrderFileHeader {
+        char magic[8];          // ORDER_FILE_MAGIC, can't be mistaken for a legacy count
+        uint16_t version;       // ORDER_FILE_VERSION
+        uint16_t recordSize;    // sizeof(OrderRecord) when written, readers skip fields they don't know
+        uint32_t flags;         // ORDER_FILE_* flags
+        uint64_t recordCount;
+        uint64_t timeBase;      // unix time in ns that record timestamp 0 stands for (0 if unknown)
+        uint32_t blockRecords;  // records per compressed block
+        uint32_t symbolBytes;
+    };
+
+    //one order as written by the uncompressed format
+    struct OrderRecord {
+        uint64_t timestamp;     // ns after the header's timeBase
+        uint64_t id;
+        uint32_t symbol;
+        int32_t price;
+        int32_t quantity;
+        uint8_t action;         // OrderAction
+        uint8_t buy;
+        uint8_t type;           // OrderType, 0 (limit) in files written before it existed
+        uint8_t reserved;
+    };
+
+    struct OrderBlockHeader {
+        uint32_t records;
+        uint32_t bytes;         // encoded size after this header
+    };
+
+    static_assert(sizeof(OrderFileHeader) == 40, "order file header layout");
+    static_assert(sizeof(OrderRecord) == 32, "order record layout");
+
+    static const char ORDER_FILE_MAGIC[8] = {'O', 'R', 'D', 'F', 'I', 'L', 'E', '\0'};
+    //version 2 added the order type (OrderRecord::type, and a type byte after the tag of compressed
+    //new orders that aren't limit orders). version 1 files read as all limit orders
+    static const uint16_t ORDER_FILE_VERSION = 2;
+    static const uint32_t ORDER_FILE_COMPRESSED = 1u << 0;
+
+
+    //how OrderFileReader gets at the records
+    enum OrderFileMode {
+        ORDER_FILE_MMAP,    // map the whole file and read records in place, pages are dropped once read
+        ORDER_FILE_STREAM   // read() fixed-size chunks into one buffer, memory use doesn't depend on file size
+    };
+
+
+    //sequential reader for order files, legacy or versioned, raw or compressed.
+    //nothing is loaded up front: open() only reads the header, records are read (and decoded) as the
+    //caller gets to them, so replay starts right away and a capture never has to fit in memory
+    class OrderFileReader {
+
+    private:
+        enum Format { LEGACY, RAW, BLOCKED };
+
+        int fd = -1;
+        OrderFileMode mode = ORDER_FILE_MMAP;
+        Format format = LEGACY;
+        OrderFileHeader header = {};
+        std::vector<std::string> symbolNames;
+        size_t recordCount = 0;
+        size_t consumed = 0;            // records handed out in batches so far
+        size_t chunkRecords = 0;        // records per batch (legacy and raw files)
+        uint64_t lastTimestamp = 0;
+
+        //where the bytes come from
+        const uint8_t* mapped = nullptr;
+        size_t mappedSize = 0;
+        uint64_t fileSize = 0;
+        uint64_t readOffset = 0;        // next unread byte
+        uint64_t batchOffset = 0;       // first byte of the current batch
+        uint64_t releasedBytes = 0;     // prefix already given back to the kernel
+        std::vector<uint64_t> readBuffer; // stream mode, uint64_t so records in it are aligned
+
+        //current batch for next(), one of the two pointers is set
+        std::vector<OrderRecord> decoded;
+        const StoredOrder* legacyBatch = nullptr;
+        const OrderRecord* batch = nullptr;
+        size_t batchSize = 0;
+        size_t batchPos = 0;
+
+        const uint8_t* fetch(size_t bytes);
+        bool decodeBlock(const uint8_t* p, const uint8_t* end, size_t records);
+        size_t nextBatch();
+        void releaseConsumed();
+        int fail(const std::string &message);
+
+    public:
+        static const size_t DEFAULT_CHUNK_RECORDS = 1 << 16;
+
+        OrderFileReader() = default;
+        OrderFileReader(const OrderFileReader&) = delete;
+        OrderFileReader& operator=(const OrderFileReader&) = delete;
+        ~OrderFileReader();
+
+        //0 on success, 1 (with a message on stderr) if the file can't be opened or is damaged
+        int open(const std::string &filename, OrderFileMode file_mode = ORDER_FILE_MMAP,
+                 size_t chunk_records = DEFAULT_CHUNK_RECORDS);
+
+        void close();
+
+        inline size_t size() const { return recordCount; }
+
+        inline OrderFileMode fileMode() const { return mode; }
+
+        //0 for legacy files
+        inline uint16_t version() const { return format == LEGACY ? 0 : header.version; }
+
+        inline bool compressed() const { return format == BLOCKED; }
+
+        inline uint64_t timeBase() const { return header.timeBase; }
+
+        //names by symbol id, empty if the file doesn't carry any
+        inline const std::vector<std::string>& symbols() const { return symbolNames; }
+
+        //timestamp of the order next() returned last (0 for legacy files)
+        inline uint64_t timestamp() const { return lastTimestamp; }
+
+        //the next order, false at the end of the file (or on a read error).
+        //legacy files have no ids, they are numbered by position like loadOrdersFromFile always did
+        inline bool next(Order &o) {
+            if (batchPos == batchSize) {
+                batchSize = nextBatch();
+                batchPos = 0;
+                if (batchSize == 0) return false;
+            }
+            o.seq = consumed - batchSize + batchPos + 1; // 1-based position in the file
+            o.session = 0;
+            if (legacyBatch) {
+                const StoredOrder &r = legacyBatch[batchPos++];
+                o.id = o.seq;
+                o.symbol = 0;
+                o.action = ORDER_NEW;
+                o.type = ORDER_LIMIT;
+                o.buy = r.buy;
+                o.price = r.price;
+                o.quantity = r.quantity;
+            } else {
+                const OrderRecord &r = batch[batchPos++];
+                o.id = r.id;
+                o.symbol = r.symbol;
+                o.action = r.action;
+                o.type = r.type;
+                o.buy = r.buy != 0;
+                o.price = r.price;
+                o.quantity = r.quantity;
+                lastTimestamp = r.timestamp;
+            }
+            return true;
+        }
+
+        //"mmap" or "stream", false for anything else
+        static bool parseMode(const std::string &name, OrderFileMode &out);
+    };
+
+
+    //writes the versioned format. raw records can be mapped and read in place, compressed blocks
+    //are about a quarter of the size: every field is a varint delta from the previous record
+    class OrderFileWriter {
+
+    private:
+        std::ofstream out;
+        std::string fileName;
+        OrderFileHeader header = {};
+        std::vector<OrderRecord> pending;   // compressed mode: the block being filled
+        std::vector<uint8_t> encoded;
+
+        void flushBlock();
+
+    public:
+        static const uint32_t DEFAULT_BLOCK_RECORDS = 4096;
+
+        ~OrderFileWriter();
+
+        //0 on success, 1 (with a message on stderr) if the file can't be created
+        int open(const std::string &filename, bool compress = false, const std::vector<std::string> &symbols = {},
+                 uint64_t time_base = 0, uint32_t block_records = DEFAULT_BLOCK_RECORDS);
+
+        //`timestamp` is ns after the time base
+        void write(const Order &o, uint64_t timestamp = 0);
+
+        //finishes the last block and fills in the record count. 0 on success
+        int close();
+    };
+
+
+
+#endif
@@ -0,0 +1,102 @@
+#include <cstdint>
+#include <cstddef>
+#include "memoryconfig.h"
+
+#ifndef ORDERINDEX_H
+#define ORDERINDEX_H
+
+
+
+    //open addressing hash table from (session, order id) to pool node, preallocated at startup.
+    //ids only have to be unique within a session, so clients can number their orders independently.
+    //linear probing with backward shift deletion, so there are no tombstones to clean up.
+    class OrderIndex {
+
+    public:
+        static const uint32_t NOT_FOUND = 0xFFFFFFFF;
+
+    private:
+        struct Slot {
+            uint64_t id;    // 0 means the slot is empty, so 0 is never a valid order id
+            uint32_t session;
+            uint32_t node;
+        };
+
+        PageBuffer memory;
+        Slot* slots = nullptr;
+        size_t mask = 0;
+        size_t count = 0;
+
+        static inline size_t hash(uint64_t id, uint32_t session) { //fibonacci hashing, ids are often sequential
+            return static_cast<size_t>(((id ^ (uint64_t(session) << 40)) * 0x9E3779B97F4A7C15ULL) >> 17);
+        }
+
+        inline bool matches(const Slot& s, uint64_t id, uint32_t session) const {
+            return s.id == id && s.session == session;
+        }
+
+    public:
+        int initialize(size_t maxEntries, HugePagePolicy huge_pages = HUGE_PAGES_OFF); //table is sized so it never goes past 50% load
+
+        size_t prefault(); //commits every page of the table now (it stays empty), returns its size in bytes
+
+        inline size_t size() const { return count; }
+        inline PageBacking backing() const { return memory.pageBacking(); }
+
+        inline uint32_t find(uint64_t id, uint32_t session) const {
+            if (id == 0) return NOT_FOUND;
+            for (size_t i = hash(id, session) & mask;; i = (i + 1) & mask) {
+                if (slots[i].id == 0) return NOT_FOUND;
+                if (matches(slots[i], id, session)) return slots[i].node;
+            }
+        }
+
+        //pulls in the slot an insert/find of this key starts at, for loops that know their keys ahead of time
+        inline void prefetch(uint64_t id, uint32_t session) const {
+            __builtin_prefetch(&slots[hash(id, session) & mask], 1);
+        }
+
+        //returns false if the id is already present for this session, or is the reserved id 0
+        inline bool insert(uint64_t id, uint32_t session, uint32_t node) {
+            if (id == 0) return false;
+            size_t i = hash(id, session) & mask;
+            while (slots[i].id != 0) {
+                if (matches(slots[i], id, session)) return false;
+                i = (i + 1) & mask;
+            }
+            slots[i].id = id;
+            slots[i].session = session;
+            slots[i].node = node;
+            count++;
+            return true;
+        }
+
+        inline void erase(uint64_t id, uint32_t session) {
+            if (id == 0) return;
+            size_t i = hash(id, session) & mask;
+            for (;; i = (i + 1) & mask) {
+                if (slots[i].id == 0) return;
+                if (matches(slots[i], id, session)) break;
+            }
+
+            //shift later members of the probe run back so lookups never hit a false empty slot
+            size_t hole = i;
+            for (size_t j = (i + 1) & mask; slots[j].id != 0; j = (j + 1) & mask) {
+                size_t home = hash(slots[j].id, slots[j].session) & mask;
+                //move j into the hole unless its home lies cyclically in (hole, j]
+                bool stays = (hole <= j) ? (hole < home && home <= j) : (hole < home || home <= j);
+                if (!stays) {
+                    slots[hole] = slots[j];
+                    hole = j;
+                }
+            }
+            slots[hole].id = 0;
+            slots[hole].session = 0;
+            slots[hole].node = NOT_FOUND;
+            count--;
+        }
+    };
+
+
+
+#endif
@@ -0,0 +1,111 @@
+#include <cstdint>
+#include <cstddef>
+#include "order.h"
+#include "memoryconfig.h"
+
+#ifndef ORDERPOOL_H
+#define ORDERPOOL_H
+
+
+
+    //one resting order plus its intrusive links to its neighbours at the same price level
+    struct OrderNode {
+        Order order;
+        uint32_t next;      // next node in the level fifo (or in the free list), NIL if none
+        uint32_t prev;      // previous node in the level fifo, NIL if this is the head
+    };
+
+
+    //fifo of resting orders at one price level, stored as indices into the pool.
+    //the totals are kept up by OrderBook as orders rest, trade and leave, so depth never walks the fifo
+    struct PriceLevel {
+        uint32_t head = 0xFFFFFFFF;
+        uint32_t tail = 0xFFFFFFFF;
+        uint32_t orders = 0;    // orders in the fifo
+        int64_t quantity = 0;   // their remaining quantity
+
+        inline bool empty() const { return head == 0xFFFFFFFF; }
+    };
+
+
+    //fixed capacity slab of order nodes with a free list.
+    //nothing is allocated after initialize(), so resting an order never touches malloc.
+    class OrderPool {
+
+    public:
+        static const uint32_t NIL = 0xFFFFFFFF;
+
+    private:
+        PageBuffer memory;
+        OrderNode* nodes = nullptr;
+        size_t poolCapacity = 0;
+        uint32_t freeHead = NIL;    // head of the list of released nodes
+        uint32_t nextUnused = 0;    // nodes past this index have never been handed out
+        size_t used = 0;
+
+    public:
+        int initialize(size_t capacity, HugePagePolicy huge_pages = HUGE_PAGES_OFF); //allocates the slab, untouched pages are not committed
+
+        size_t prefault(); //commits every page of the slab now, returns its size in bytes
+
+        inline size_t capacity() const { return poolCapacity; }
+        inline PageBacking backing() const { return memory.pageBacking(); }
+        inline size_t inUse() const { return used; }
+
+        inline OrderNode& operator[](uint32_t idx) { return nodes[idx]; }
+        inline const OrderNode& operator[](uint32_t idx) const { return nodes[idx]; }
+
+        //returns NIL if the pool is exhausted
+        inline uint32_t allocate(const Order& order) {
+            uint32_t idx;
+            if (freeHead != NIL) {
+                idx = freeHead;
+                freeHead = nodes[idx].next;
+            } else if (nextUnused < poolCapacity) {
+                idx = nextUnused++;
+            } else return NIL;
+
+            nodes[idx].order = order;
+            nodes[idx].next = NIL;
+            nodes[idx].prev = NIL;
+            used++;
+            return idx;
+        }
+
+        inline void release(uint32_t idx) {
+            nodes[idx].next = freeHead;
+            freeHead = idx;
+            used--;
+        }
+
+        //append node to the back of a level
+        inline void pushBack(PriceLevel& level, uint32_t idx) {
+            nodes[idx].prev = level.tail;
+            if (level.tail == NIL) level.head = idx;
+            else nodes[level.tail].next = idx;
+            level.tail = idx;
+        }
+
+        //unlink the front node of a level and give it back to the pool
+        inline void popFront(PriceLevel& level) {
+            uint32_t idx = level.head;
+            level.head = nodes[idx].next;
+            if (level.head == NIL) level.tail = NIL;
+            else nodes[level.head].prev = NIL;
+            release(idx);
+        }
+
+        //unlink any node of a level (used by cancels) and give it back to the pool
+        inline void unlink(PriceLevel& level, uint32_t idx) {
+            OrderNode &node = nodes[idx];
+            if (node.prev == NIL) level.head = node.next;
+            else nodes[node.prev].next = node.next;
+            if (node.next == NIL) level.tail = node.prev;
+            else nodes[node.next].prev = node.prev;
+            release(idx);
+        }
+    };
+
+
+
+#endif
@@ -0,0 +1,109 @@
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#ifndef PRICEBITMAP_H
+#define PRICEBITMAP_H
+
+
+
+    //multi-level occupancy bitmap over price indices.
+    //level 0 has one bit per price, every level above has one bit per non-zero word below it,
+    //so finding the lowest/highest occupied price costs one word scan per level (4 for 1M prices).
+    class PriceBitmap {
+
+    private:
+        std::vector<std::vector<uint64_t>> levels; // levels[0] is the per-price level, levels.back() is a single word
+
+    public:
+        void initialize(size_t size); //clears everything, sized for prices [0, size)
+
+        inline void set(int idx) {
+            size_t i = static_cast<size_t>(idx);
+            for (auto &level : levels) {
+                uint64_t &word = level[i >> 6];
+                bool wasEmpty = (word == 0);
+                word |= (1ULL << (i & 63));
+                if (!wasEmpty) return; //summary bits above are already set
+                i >>= 6;
+            }
+        }
+
+        inline void clear(int idx) {
+            size_t i = static_cast<size_t>(idx);
+            for (auto &level : levels) {
+                uint64_t &word = level[i >> 6];
+                word &= ~(1ULL << (i & 63));
+                if (word != 0) return; //word still has occupied prices, summary stays set
+                i >>= 6;
+            }
+        }
+
+        inline bool test(int idx) const {
+            return (levels[0][static_cast<size_t>(idx) >> 6] >> (idx & 63)) & 1ULL;
+        }
+
+        //lowest occupied index, -1 if empty
+        inline int lowest() const {
+            if (levels.back()[0] == 0) return -1;
+            size_t i = 0;
+            for (size_t l = levels.size(); l-- > 0;) {
+                i = (i << 6) | static_cast<size_t>(__builtin_ctzll(levels[l][i]));
+            }
+            return static_cast<int>(i);
+        }
+
+        //highest occupied index, -1 if empty
+        inline int highest() const {
+            if (levels.back()[0] == 0) return -1;
+            size_t i = 0;
+            for (size_t l = levels.size(); l-- > 0;) {
+                i = (i << 6) | static_cast<size_t>(63 - __builtin_clzll(levels[l][i]));
+            }
+            return static_cast<int>(i);
+        }
+
+        //lowest occupied index above idx, -1 if none. climbs until a word has a bit past idx, then
+        //descends like lowest(), so a walk over n levels costs about n word scans
+        inline int above(int idx) const {
+            size_t i = static_cast<size_t>(idx) + 1; //first candidate at the current level
+            size_t l = 0;
+            for (; l < levels.size(); ++l) {
+                size_t w = i >> 6;
+                if (w >= levels[l].size()) return -1;
+                uint64_t bits = levels[l][w] & (~0ULL << (i & 63));
+                if (bits != 0) {
+                    i = (w << 6) | static_cast<size_t>(__builtin_ctzll(bits));
+                    break;
+                }
+                i = w + 1;
+            }
+            if (l == levels.size()) return -1;
+            while (l-- > 0) i = (i << 6) | static_cast<size_t>(__builtin_ctzll(levels[l][i]));
+            return static_cast<int>(i);
+        }
+
+        //highest occupied index below idx, -1 if none
+        inline int below(int idx) const {
+            if (idx <= 0) return -1;
+            size_t i = static_cast<size_t>(idx) - 1;
+            size_t l = 0;
+            for (; l < levels.size(); ++l) {
+                size_t w = i >> 6;
+                uint64_t bits = levels[l][w] & (~0ULL >> (63 - (i & 63)));
+                if (bits != 0) {
+                    i = (w << 6) | static_cast<size_t>(63 - __builtin_clzll(bits));
+                    break;
+                }
+                if (w == 0) return -1;
+                i = w - 1;
+            }
+            if (l == levels.size()) return -1;
+            while (l-- > 0) i = (i << 6) | static_cast<size_t>(63 - __builtin_clzll(levels[l][i]));
+            return static_cast<int>(i);
+        }
+    };
+
+
+
+#endif
@@ -0,0 +1,152 @@
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include "orderpool.h"
+#include "pricebitmap.h"
+#include "execution.h"
+#include "memoryconfig.h"
+
+#ifndef PRICELADDER_H
+#define PRICELADDER_H
+
+
+
+    //price -> fifo level for one side of a book.
+    //a dense window of levels (array + occupancy bitmap) covers the prices around the touch, levels
+    //outside it live in a sorted map. the window re-centers when the touch leaves it, so memory and
+    //startup follow the band an instrument trades in instead of the whole price range.
+    //a window as wide as the price range never overflows, which is the plain dense ladder
+    class PriceLadder {
+
+    private:
+        int minPrice = 0;
+        int maxPrice = -1;
+        int windowSize = 0;
+        int base = 0;                        // price of window slot 0
+        bool bidSide = false;                // best is the highest price (bids) or the lowest (asks)
+
+        PageBuffer windowMemory;
+        PriceLevel* window = nullptr;        // windowSize levels in windowMemory
+        PriceBitmap occupied;                // window slots with resting orders
+        size_t windowLevels = 0;             // occupied slots, so we know when the window has emptied
+        std::map<int, PriceLevel> overflow;  // occupied levels outside the window, sorted by price
+        long long recenters = 0;
+
+        inline bool inWindow(int price) const { return price >= base && price - base < windowSize; }
+
+        //moves the window so it is centered on price (clamped to the price range)
+        void recenter(int price);
+
+        int windowBest() const; // -1 if the window is empty
+
+    public:
+        //prices [min_price, max_price]. window_size <= 0 or >= the range gives a dense ladder.
+        //0 on success, 1 if the window could not be allocated
+        int initialize(int min_price, int max_price, int window_size, bool bid_side,
+                       HugePagePolicy huge_pages = HUGE_PAGES_OFF);
+
+        inline bool dense() const { return windowSize == maxPrice - minPrice + 1; }
+
+        //level at price for resting an order, created (and marked occupied) if nothing rests there yet.
+        //the reference is good until the next acquire()/release()
+        inline PriceLevel& acquire(int price) {
+            if (!inWindow(price)) {
+                //the touch moved past the window (or the window has nothing left): follow it
+                bool better = bidSide ? (price >= base + windowSize) : (price < base);
+                if (windowLevels == 0 || better) recenter(price);
+            }
+            if (inWindow(price)) {
+                int slot = price - base;
+                PriceLevel &level = window[static_cast<size_t>(slot)];
+                if (level.empty()) {
+                    occupied.set(slot);
+                    windowLevels++;
+                }
+                return level;
+            }
+            return overflow[price];
+        }
+
+        //the level at price, nullptr if nothing rests there
+        inline const PriceLevel* find(int price) const {
+            if (inWindow(price)) {
+                int slot = price - base;
+                return occupied.test(slot) ? &window[static_cast<size_t>(slot)] : nullptr;
+            }
+            auto it = overflow.find(price);
+            return (it == overflow.end()) ? nullptr : &it->second;
+        }
+
+        //calls fn(price, level) for every occupied level, best first, until it returns false
+        template <typename Fn>
+        void forEachBest(Fn fn) const {
+            //the window sits between the overflow levels on either side of it
+            if (bidSide) {
+                auto it = overflow.rbegin();
+                for (; it != overflow.rend() && it->first >= base + windowSize; ++it) {
+                    if (!fn(it->first, it->second)) return;
+                }
+                for (int slot = occupied.highest(); slot != -1; slot = occupied.below(slot)) {
+                    if (!fn(base + slot, window[static_cast<size_t>(slot)])) return;
+                }
+                for (; it != overflow.rend(); ++it) {
+                    if (!fn(it->first, it->second)) return;
+                }
+            } else {
+                auto it = overflow.begin();
+                for (; it != overflow.end() && it->first < base; ++it) {
+                    if (!fn(it->first, it->second)) return;
+                }
+                for (int slot = occupied.lowest(); slot != -1; slot = occupied.above(slot)) {
+                    if (!fn(base + slot, window[static_cast<size_t>(slot)])) return;
+                }
+                for (; it != overflow.end(); ++it) {
+                    if (!fn(it->first, it->second)) return;
+                }
+            }
+        }
+
+        //appends the best n levels, best first, and returns how many there were
+        size_t depth(size_t n, std::vector<DepthLevel> &out) const;
+
+        //quantity resting at `limit` or better, counting stops once it reaches `enough`
+        int64_t quantityThrough(int limit, int64_t enough) const;
+
+        //an occupied level, the price must have orders resting
+        inline PriceLevel& at(int price) {
+            if (inWindow(price)) return window[static_cast<size_t>(price - base)];
+            return overflow.find(price)->second;
+        }
+
+        //the level at price just became empty
+        inline void release(int price) {
+            if (inWindow(price)) {
+                occupied.clear(price - base);
+                windowLevels--;
+                if (windowLevels == 0 && !overflow.empty()) { //what is left is far away, bring it in
+                    recenter(bidSide ? overflow.rbegin()->first : overflow.begin()->first);
+                }
+            } else {
+                overflow.erase(price);
+            }
+        }
+
+        //highest bid / lowest ask, -1 if the side is empty
+        inline int best() const {
+            int inside = windowBest();
+            if (overflow.empty()) return inside;
+            int outside = bidSide ? overflow.rbegin()->first : overflow.begin()->first;
+            if (inside == -1) return outside;
+            return bidSide ? (outside > inside ? outside : inside) : (outside < inside ? outside : inside);
+        }
+
+        inline int windowWidth() const { return windowSize; }
+        inline int windowBase() const { return base; }
+        inline PageBacking backing() const { return windowMemory.pageBacking(); }
+        inline size_t overflowLevels() const { return overflow.size(); }
+        inline long long recenterCount() const { return recenters; }
+    };
+
+
+
+#endif
@@ -0,0 +1,236 @@
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include "order.h"
+#include "execution.h"
+#include "symboltable.h"
+
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+
+
+    //binary wire format. every message starts with a 4 byte header:
+    //  uint16 length (whole message, header included), uint8 type, uint8 reserved (0)
+    //all integers are little-endian and messages have a fixed size per type, so the
+    //server can decode them straight out of its receive buffer.
+    //
+    //a connection starts in text mode ("buy 100 4.56\n"). a client switches it to binary by
+    //sending a HELLO as its very first bytes; text lines can never start with a HELLO header.
+    //execution reports come back in whichever mode the connection is in.
+    //
+    //version 2 added the u32 symbol id to every order message; a HELLO with any other version
+    //is not accepted and the connection stays in text mode. the order type went into the first
+    //reserved byte of NEW_ORDER later on, 0 (a limit order) is what older clients always sent.
+
+    enum MessageType : uint8_t {
+        MSG_HELLO = 1,      // magic "OBX" + protocol version
+        MSG_NEW_ORDER = 2,  // id, price (cents), quantity, symbol, side, order type
+        MSG_CANCEL = 3,     // id, symbol
+        MSG_MODIFY = 4,     // id, new price (0 keeps it), new quantity, symbol
+        MSG_EXEC_REPORT = 5 // server -> client, one ExecReport
+    };
+
+    static const uint8_t PROTOCOL_VERSION = 2;
+    static const size_t HEADER_SIZE = 4;
+
+    static const size_t HELLO_SIZE = 8;       // header, 'O' 'B' 'X', version
+    static const size_t NEW_ORDER_SIZE = 28;  // header, u64 id, i32 price, i32 quantity, u32 symbol, u8 side, u8 type, 2 reserved
+    static const size_t CANCEL_SIZE = 16;     // header, u64 id, u32 symbol
+    static const size_t MODIFY_SIZE = 24;     // header, u64 id, i32 price, i32 quantity, u32 symbol
+    static const size_t EXEC_REPORT_SIZE = 40; // header, u8 type, u8 side, 2 reserved, u64 seq, u64 id, u64 counter id, i32 price, i32 quantity
+    static const size_t MAX_MESSAGE_SIZE = 40;
+    static const size_t MAX_TEXT_REPORT_SIZE = 96; // longest line formatTextReport can produce
+    static const size_t MAX_TEXT_ORDER_SIZE = 64;  // longest line formatTextOrder can produce, not counting the symbol name
+
+
+    //little-endian field access, compiles to a plain load/store on little-endian hosts
+    inline void putU16(char* p, uint16_t v) { p[0] = char(v); p[1] = char(v >> 8); }
+    inline void putU32(char* p, uint32_t v) { for (int i = 0; i < 4; ++i) p[i] = char(v >> (8 * i)); }
+    inline void putU64(char* p, uint64_t v) { for (int i = 0; i < 8; ++i) p[i] = char(v >> (8 * i)); }
+
+    inline uint16_t getU16(const char* p) {
+        const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+        return static_cast<uint16_t>(u[0] | (u[1] << 8));
+    }
+    inline uint32_t getU32(const char* p) {
+        const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+        return uint32_t(u[0]) | (uint32_t(u[1]) << 8) | (uint32_t(u[2]) << 16) | (uint32_t(u[3]) << 24);
+    }
+    inline uint64_t getU64(const char* p) {
+        return uint64_t(getU32(p)) | (uint64_t(getU32(p + 4)) << 32);
+    }
+
+
+    inline size_t encodeHeader(char* buf, size_t length, MessageType type) {
+        putU16(buf, static_cast<uint16_t>(length));
+        buf[2] = static_cast<char>(type);
+        buf[3] = 0;
+        return HEADER_SIZE;
+    }
+
+    inline size_t encodeHello(char* buf) {
+        encodeHeader(buf, HELLO_SIZE, MSG_HELLO);
+        buf[4] = 'O';
+        buf[5] = 'B';
+        buf[6] = 'X';
+        buf[7] = static_cast<char>(PROTOCOL_VERSION);
+        return HELLO_SIZE;
+    }
+
+    //encodes a new order, cancel or modify depending on order.action. returns bytes written (<= MAX_MESSAGE_SIZE)
+    inline size_t encodeOrder(char* buf, const Order& order) {
+        switch (order.action) {
+            case ORDER_CANCEL:
+                encodeHeader(buf, CANCEL_SIZE, MSG_CANCEL);
+                putU64(buf + 4, order.id);
+                putU32(buf + 12, order.symbol);
+                return CANCEL_SIZE;
+            case ORDER_MODIFY:
+                encodeHeader(buf, MODIFY_SIZE, MSG_MODIFY);
+                putU64(buf + 4, order.id);
+                putU32(buf + 12, static_cast<uint32_t>(order.price));
+                putU32(buf + 16, static_cast<uint32_t>(order.quantity));
+                putU32(buf + 20, order.symbol);
+                return MODIFY_SIZE;
+            default:
+                encodeHeader(buf, NEW_ORDER_SIZE, MSG_NEW_ORDER);
+                putU64(buf + 4, order.id);
+                putU32(buf + 12, static_cast<uint32_t>(order.price));
+                putU32(buf + 16, static_cast<uint32_t>(order.quantity));
+                putU32(buf + 20, order.symbol);
+                buf[24] = order.buy ? 1 : 0;
+                buf[25] = static_cast<char>(order.type);
+                buf[26] = buf[27] = 0;
+                return NEW_ORDER_SIZE;
+        }
+    }
+
+    //true if buf starts with a complete, valid HELLO for our protocol version
+    inline bool isHello(const char* buf, size_t len) {
+        return len >= HELLO_SIZE && getU16(buf) == HELLO_SIZE && buf[2] == MSG_HELLO &&
+               buf[4] == 'O' && buf[5] == 'B' && buf[6] == 'X' && static_cast<uint8_t>(buf[7]) == PROTOCOL_VERSION;
+    }
+
+    //values an order must have to reach a book, for both protocols: a new order needs a positive
+    //quantity and, unless it is a market order, a positive price. a modify may go down to 0 (a cancel)
+    //and keep its price (0), but neither can be negative, which is what a u32 past 2^31 turns into
+    inline bool orderValuesValid(const Order& order) {
+        if (order.action == ORDER_NEW) return order.quantity > 0 && (order.price > 0 || order.type == ORDER_MARKET);
+        if (order.action == ORDER_MODIFY) return order.quantity >= 0 && order.price >= 0;
+        return true;
+    }
+
+    //result of decoding one message from a receive buffer
+    enum DecodeStatus {
+        DECODE_OK,          // `order` is filled in
+        DECODE_INCOMPLETE,  // need more bytes
+        DECODE_SKIPPED,     // well framed but not an order (or not understood), skip it
+        DECODE_INVALID,     // an order with id 0 or values that fail orderValuesValid(), `order` is filled in to reject it
+        DECODE_ERROR        // framing is broken, the stream can't be trusted anymore
+    };
+
+    //decodes the message at buf without copying it. `consumed` is the message length for OK/SKIPPED/INVALID.
+    //binary orders always carry their own id, 0 is reserved and never reaches a book
+    inline DecodeStatus decodeMessage(const char* buf, size_t len, Order& order, size_t& consumed) {
+        if (len < HEADER_SIZE) return DECODE_INCOMPLETE;
+        size_t msgLen = getU16(buf);
+        if (msgLen < HEADER_SIZE) return DECODE_ERROR;
+        if (len < msgLen) return DECODE_INCOMPLETE;
+        consumed = msgLen;
+
+        switch (static_cast<uint8_t>(buf[2])) {
+            case MSG_NEW_ORDER:
+                if (msgLen != NEW_ORDER_SIZE) return DECODE_ERROR;
+                order.id = getU64(buf + 4);
+                order.action = ORDER_NEW;
+                order.price = static_cast<int>(getU32(buf + 12));
+                order.quantity = static_cast<int>(getU32(buf + 16));
+                order.symbol = getU32(buf + 20);
+                order.buy = (buf[24] != 0);
+                order.type = static_cast<uint8_t>(buf[25]); //the book rejects types it doesn't know
+                return (order.id != 0 && orderValuesValid(order)) ? DECODE_OK : DECODE_INVALID;
+            case MSG_CANCEL:
+                if (msgLen != CANCEL_SIZE) return DECODE_ERROR;
+                order.id = getU64(buf + 4);
+                order.symbol = getU32(buf + 12);
+                order.action = ORDER_CANCEL;
+                order.type = ORDER_LIMIT;
+                order.buy = false;
+                order.price = 0;
+                order.quantity = 0;
+                return order.id != 0 ? DECODE_OK : DECODE_INVALID;
+            case MSG_MODIFY:
+                if (msgLen != MODIFY_SIZE) return DECODE_ERROR;
+                order.id = getU64(buf + 4);
+                order.action = ORDER_MODIFY;
+                order.type = ORDER_LIMIT;
+                order.buy = false;
+                order.price = static_cast<int>(getU32(buf + 12));
+                order.quantity = static_cast<int>(getU32(buf + 16));
+                order.symbol = getU32(buf + 20);
+                return (order.id != 0 && orderValuesValid(order)) ? DECODE_OK : DECODE_INVALID;
+            default:
+                return DECODE_SKIPPED;
+        }
+    }
+
+
+    inline size_t encodeExecReport(char* buf, const ExecReport& report) {
+        encodeHeader(buf, EXEC_REPORT_SIZE, MSG_EXEC_REPORT);
+        buf[4] = static_cast<char>(report.type);
+        buf[5] = report.buy ? 1 : 0;
+        buf[6] = buf[7] = 0;
+        putU64(buf + 8, report.seq);
+        putU64(buf + 16, report.orderId);
+        putU64(buf + 24, report.counterId);
+        putU32(buf + 32, static_cast<uint32_t>(report.price));
+        putU32(buf + 36, static_cast<uint32_t>(report.quantity));
+        return EXEC_REPORT_SIZE;
+    }
+
+    //client side counterpart of decodeMessage for the server -> client direction
+    inline DecodeStatus decodeExecReport(const char* buf, size_t len, ExecReport& report, size_t& consumed) {
+        if (len < HEADER_SIZE) return DECODE_INCOMPLETE;
+        size_t msgLen = getU16(buf);
+        if (msgLen < HEADER_SIZE) return DECODE_ERROR;
+        if (len < msgLen) return DECODE_INCOMPLETE;
+        consumed = msgLen;
+        if (static_cast<uint8_t>(buf[2]) != MSG_EXEC_REPORT) return DECODE_SKIPPED;
+        if (msgLen != EXEC_REPORT_SIZE) return DECODE_ERROR;
+
+        report.type = static_cast<uint8_t>(buf[4]);
+        report.buy = (buf[5] != 0);
+        report.seq = getU64(buf + 8);
+        report.orderId = getU64(buf + 16);
+        report.counterId = getU64(buf + 24);
+        report.price = static_cast<int>(getU32(buf + 32));
+        report.quantity = static_cast<int>(getU32(buf + 36));
+        return DECODE_OK;
+    }
+
+    //text form of a report, newline included: "<type> <side> <id> <qty> <price> <counter id> <seq>\n",
+    //e.g. "fill buy 42 100 4.56 17 9001\n". returns bytes written, at most MAX_TEXT_REPORT_SIZE
+    size_t formatTextReport(char* buf, const ExecReport& report);
+
+    //parses one text report line (without the newline)
+    bool parseTextReport(const char* begin, const char* end, ExecReport& report);
+
+
+    //parses one text line ("buy [type] 100 4.56 [id] [symbol]", "cancel <id> [symbol]", "modify <id> <qty> [price] [symbol]")
+    //in place, without allocating. new orders without an id get id 0, the caller decides how to assign one.
+    //type is limit (the default), ioc, fok, market or post. market orders still carry a price, it is ignored.
+    //values orderValuesValid() refuses fail the parse
+    //a missing symbol means symbol 0; a named one has to be in `symbols` (no table means none are accepted)
+    bool parseTextOrder(const char* begin, const char* end, Order &o, const SymbolTable* symbols = nullptr);
+
+    bool parseTextOrder(const std::string &line, Order &o, const SymbolTable* symbols = nullptr);
+
+    //the line parseTextOrder reads back as `o`, newline included. the symbol name is added when `symbols`
+    //has one for o.symbol. returns bytes written, at most MAX_TEXT_ORDER_SIZE + the name's length
+    size_t formatTextOrder(char* buf, const Order &o, const SymbolTable* symbols = nullptr);
+
+
+
+#endif
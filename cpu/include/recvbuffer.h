@@ -0,0 +1,60 @@
+#include <cstddef>
+#include <cstring>
+#include <memory>
+
+#ifndef RECVBUFFER_H
+#define RECVBUFFER_H
+
+
+
+    //one large reusable receive buffer. recv() writes straight into the free tail, complete
+    //messages are parsed where they sit, and the partial message at the end is only moved back
+    //to the front when the free tail gets too small to be worth a recv.
+    class RecvBuffer {
+
+    private:
+        std::unique_ptr<char[]> data;
+        size_t bufCapacity = 0;
+        size_t start = 0;   // first unparsed byte
+        size_t end = 0;     // one past the last received byte
+        size_t minFree = 0; // compact once less than this is left at the tail
+
+    public:
+        int initialize(size_t capacity, size_t min_free = 4096) {
+            data.reset(new char[capacity]);
+            bufCapacity = capacity;
+            minFree = (min_free < capacity) ? min_free : capacity / 2;
+            start = end = 0;
+            return 0;
+        }
+
+        inline size_t capacity() const { return bufCapacity; }
+
+        //where the next recv() should write, and how much room it has
+        inline char* writePtr() { return data.get() + end; }
+        inline size_t writable() const { return bufCapacity - end; }
+        inline void commit(size_t n) { end += n; }
+
+        //received bytes that have not been parsed yet
+        inline const char* readPtr() const { return data.get() + start; }
+        inline size_t readable() const { return end - start; }
+        inline bool full() const { return start == 0 && end == bufCapacity; }
+
+        inline void consume(size_t n) {
+            start += n;
+            if (start == end) start = end = 0; //everything parsed, rewind for free
+        }
+
+        //call after parsing, before the next recv()
+        inline void compact() {
+            if (writable() >= minFree || start == 0) return;
+            size_t pending = end - start;
+            std::memmove(data.get(), data.get() + start, pending);
+            start = 0;
+            end = pending;
+        }
+    };
+
+
+
+#endif
@@ -1,51 +1,179 @@
 #include <iostream>
 #include <cstring>
-#include <queue>
 #include <unistd.h>
 #include <arpa/inet.h>
-#include <sstream>
-#include <mutex>
-#include <thread>
-#include <condition_variable>
-#include "orderbook.h"
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "engine.h"
+#include "spscqueue.h"
+#include "execution.h"
+#include "protocol.h"
+#include "recvbuffer.h"
+#include "symboltable.h"
+#include "shmtransport.h"
+#include "journal.h"
+#include "clock.h"
 
 #ifndef SERVER_H
 #define SERVER_H
 
 
 
-class Server {
+//one connected client and where its parser left off
+struct Session {
+    int fd = -1;
+    uint32_t id = 0;
+    bool protocolChosen = false; // set once the first bytes of the connection have been seen
+    bool binaryMode = false;     // client opened with a HELLO
+    bool binaryError = false;    // binary framing broke, connection gets dropped
+    uint64_t invalidLines = 0;   // text lines that didn't parse, only the first is printed
+    RecvBuffer recvBuffer;       // recv() lands here directly, messages are parsed in place
+    uint64_t recvTime = 0;       // clock ticks when the last recv() returned, stamped on what it delivered
+
+    std::vector<char> outBuffer; // execution reports waiting to be sent
+    size_t outOffset = 0;        // bytes of outBuffer already sent
+    bool queuedForFlush = false; // already in the loop's list of sessions to flush
+    bool readPaused = false;     // stopped reading because the client isn't reading its reports
+    bool writeWatched = false;   // waiting for EPOLLOUT because the socket buffer was full (shm: for ring room)
+
+    int shmSlot = -1;            // client slot of a shared memory session, -1 for tcp
+    ShmRing shmIn;               // orders from the client
+    ShmRing shmOut;              // reports to the client
+};
+
+
+
+class Server : public BookEventSink {
 private:
     static const int PORT = 5000;
-    static const int BUFF_SIZE = 1024;
-    int server_fd, client_fd;
+    static const size_t SESSION_BUFFER_SIZE = 1 << 18; // per session receive buffer
+    static const int MAX_EVENTS = 256;                 // epoll events handled per wakeup
+    static const int EPOLL_TIMEOUT_MS = 100;           // how often the loop looks at the stop flag
+    static const uint64_t LISTEN_KEY = 0;              // epoll key of the listening socket, sessions use their id
+    static const uint64_t WAKE_KEY = ~0ULL;            // epoll key of the eventfd the matching thread rings
+    static const uint64_t SHM_KEY = ~0ULL - 1;         // epoll key of the shared memory doorbell
+    static const int SHM_RETRY_MS = 1;                 // loop timeout while a shm client's report ring is full
+    static const int SHM_PID_CHECK_MS = 100;           // how often slots are checked for clients that died attached
+    static const size_t SHM_READ_BUDGET = 256;         // messages taken from one shm session per loop iteration
+    static const size_t REPORT_QUEUE_SIZE = 1 << 16;   // book events in flight from each matching worker
+    static const int SUBMIT_SPINS_BEFORE_YIELD = 1000; // full inbound ring polls before the event loop yields
+    static const size_t OUT_RESERVE = 1 << 16;         // initial per session report buffer
+    static const size_t OUT_HIGH_WATER = 8 << 20;      // stop reading a session whose unsent reports pass this
+
+    int server_fd;
+    int epoll_fd;
+    int wake_fd;
     sockaddr_in server_addr;
-    sockaddr_in client_addr;
 
-    std::queue<Order>* orderQueue;
-    std::mutex* orderMutex;
-    std::condition_variable* orderCV;
+    std::unordered_map<uint32_t, std::unique_ptr<Session>> sessions;
+    uint32_t nextSessionId = 1;
+    std::atomic<bool> stopRequested;
+
+    MatchingEngine* engine;
+    const SymbolTable* symbols; //resolves the symbol names of text orders
+
+    //book events coming back from the matching workers, one queue per worker so each stays single
+    //producer. the loop only needs to be woken through wake_fd when it is (about to be) asleep in
+    //epoll_wait, so a busy loop never costs a syscall
+    std::vector<std::unique_ptr<SPSCQueue<BookEvent>>> reportQueues;
+    alignas(CACHE_LINE_SIZE) std::atomic<bool> loopSleeping{false};
+    std::vector<uint32_t> flushList; // sessions with reports appended since the last flush
+
+    //shared memory gateway, off unless enableSharedMemory() was called
+    ShmSegment shm;
+    int shm_doorbell_fd = -1;
+    bool shmBusyPoll = false;               // never sleep, so clients never have to ring
+    std::vector<uint32_t> shmSessions;      // client slot -> session id, 0 if none
+    uint64_t lastPidCheck = 0;
+
+    //ids handed to orders that arrive without one, kept out of the range clients normally use
+    static const uint64_t SERVER_ID_BASE = 1ULL << 63;
+    uint64_t nextOrderId;
+    uint64_t nextSeq = 1; //every accepted message gets the next one, in the order the loop saw them
+
+    Journal* journal = nullptr; //every accepted message is appended once its worker has it, if set
+
+    void accept_clients(); //accepts everything pending on the listening socket
+
+    void read_session(Session &session); //one recv plus parsing, closes the session on eof/error
+
+    //opens sessions for newly attached shm clients, closes the ones that left, and reads every shm session
+    void poll_shared_memory();
+
+    bool shm_work_pending() const; //a shm client has orders queued or attached/left since the last poll
+
+    bool shm_backlog() const; //a shm client's report ring was full when we last flushed it
+
+    void read_shm_session(Session &session); //takes up to SHM_READ_BUDGET orders from the session's ring
+
+    size_t push_shm_reports(Session &session); //copies pending reports into the session's ring, returns bytes moved
+
+    void close_session(uint32_t session_id);
+
+    void close_all();
+
+    void drain_reports(); //turns queued book events into per session reports
+
+    bool reports_pending() const;
+
+    void deliver(uint32_t session_id, const ExecReport &report); //appends one encoded report
+
+    void flush_session(Session &session); //one send() of pending reports, may close the session
+
+    void update_interest(Session &session); //epoll flags from the session's read/write state
+
+    //stamps the order with its session and sequence number and hands it to its symbol's worker
+    void submit(Session &session, Order &o);
+
+    void reject(Session &session, const Order &o); //answers an order that never reached a book
+
+    //parses every complete message in the session's buffer, false if the connection should be dropped
+    bool parseReceived(Session &session);
+
+    //decodes one binary message and hands it to the book. false if incomplete or broken
+    bool handleBinaryMessage(Session &session, const char* data, size_t len, size_t &consumed);
 
 public:
 
     Server();
+
+    ~Server(); //closes whatever is still open
     
     int initialize();
 
-    void setSharedResources(std::queue<Order>* q,std::mutex* m,std::condition_variable* cv);
+    //also takes clients through POSIX shared memory `name` ("/orderbook"), up to client_slots at a time
+    //with ring_slots messages each way. busy_poll keeps the event loop spinning instead of waiting in
+    //epoll_wait, so clients never have to ring its doorbell. call after initialize(), 0 on success
+    int enableSharedMemory(const std::string &name, size_t client_slots, size_t ring_slots, bool busy_poll);
 
-    bool parseOrderLine(const std::string &line, Order &o);
+    //call before run_event_loop(), the engine must have been initialized
+    void setSharedResources(MatchingEngine* matching_engine, const SymbolTable* symbol_table);
 
-    int wait_for_client_connection();
+    //journals every accepted message. call before run_event_loop()
+    inline void setJournal(Journal* message_journal) { journal = message_journal; }
+
+    //goes on from a recovered journal: the next message gets last_seq + 1, and new sessions and server
+    //assigned order ids stay clear of the ones the recovered orders use. call before run_event_loop()
+    void resume(uint64_t last_seq, uint64_t highest_order_id, uint32_t last_session);
+
+    bool parseOrderLine(const char* begin, const char* end, Order &o);
+
+    bool parseOrderLine(const std::string &line, Order &o);
 
-    void listen_to_client();
+    //non-blocking epoll loop over the listening socket and every session, until stop_server().
+    //the calling thread is placed first (results go to `status` if given)
+    void run_event_loop(const ThreadPlacement &placement = ThreadPlacement(), RuntimeStatus* status = nullptr);
 
+    void stop_server(); //asks the event loop to close everything and return, safe from any thread
 
-    void stop_server();
+    //matching worker side: queues the events of one process() call for delivery to their sessions
+    void post_events(size_t producer, const std::vector<BookEvent> &events) override;
 
 
 };
 
 
 
-#endif // SERVER_H
\ No newline at end of file
+#endif // SERVER_H
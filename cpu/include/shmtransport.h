@@ -0,0 +1,160 @@
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <sys/types.h>
+#include "protocol.h"
+#include "spscqueue.h"
+
+#ifndef SHMTRANSPORT_H
+#define SHMTRANSPORT_H
+
+
+
+    //shared memory transport for clients on the same host as server_main.
+    //the server creates one POSIX shm segment (shm_open name, e.g. "/orderbook") with a fixed number of
+    //client slots. every slot has two single-producer/single-consumer rings, orders in and execution
+    //reports out, each message being one binary protocol message in a 64 byte ring slot. nothing goes
+    //through the kernel while both sides are awake: a side that runs out of work marks itself asleep
+    //and waits on a doorbell, an abstract unix datagram socket named after the segment, and the other
+    //side only sends to it when it sees that mark (the same handshake as the server's wake eventfd)
+    static const uint64_t SHM_MAGIC = 0x314D485342524F4FULL; // "OOBRSHM1"
+    static const uint32_t SHM_VERSION = 1;
+    static const size_t SHM_SLOT_SIZE = 64;
+    static_assert(MAX_MESSAGE_SIZE <= SHM_SLOT_SIZE, "every binary message fits in one ring slot");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+                  "atomics shared between processes must not hide a lock");
+
+    //client slot states. a client claims a free slot and makes it active, either side moves it to
+    //closing, and only the server frees it (after resetting the rings) once the client can't touch it
+    enum ShmClientState : uint32_t {
+        SHM_CLIENT_FREE = 0,
+        SHM_CLIENT_CLAIMED = 1,  // a client is setting up its doorbell
+        SHM_CLIENT_ACTIVE = 2,
+        SHM_CLIENT_CLOSING = 3,  // the client left, the server frees the slot on its next scan
+        SHM_CLIENT_DROPPED = 4   // the server closed the session, freed once the client closes or exits
+    };
+
+    struct alignas(CACHE_LINE_SIZE) ShmSlot {
+        char bytes[SHM_SLOT_SIZE];
+    };
+
+    struct ShmRingControl {
+        alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> head; // next slot to read, written by the consumer
+        alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> tail; // next slot to write, written by the producer
+    };
+
+    struct ShmClientControl {
+        alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> state;   // ShmClientState
+        int32_t pid;                                            // the client process, for noticing it died
+        uint32_t generation;                                    // bumped every time the slot is freed
+        alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> sleeping; // the client waits on its doorbell for reports
+        ShmRingControl toServer;
+        ShmRingControl toClient;
+    };
+
+    struct ShmSegmentHeader {
+        uint64_t magic;             // SHM_MAGIC, written last
+        uint32_t version;           // SHM_VERSION
+        uint32_t clientSlots;
+        uint32_t ringSlots;         // per ring, a power of two
+        int32_t serverPid;
+        uint64_t segmentBytes;
+        alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> running;        // cleared when the server shuts down
+        alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> serverSleeping; // the event loop is (about to be) in epoll_wait
+    };
+
+
+    //one end of a ring in the segment. the indices stay in the segment, the cached copy of the other
+    //side's index stays in this process so the shared line is only read when the ring looks full/empty
+    class ShmRing {
+
+    private:
+        ShmRingControl* control = nullptr;
+        ShmSlot* slots = nullptr;
+        uint64_t mask = 0;
+        uint64_t next = 0;          // producer: next slot to fill, consumer: next slot to read
+        uint64_t cachedOther = 0;
+
+    public:
+        //picks up the ring where it is. `producer` says which end this process is
+        void bind(ShmRingControl* ring_control, ShmSlot* ring_slots, uint64_t slot_count, bool producer);
+
+        inline uint64_t capacity() const { return mask + 1; }
+
+        //producer side: room for one more message (nullptr if full). commit() counts it, publish()
+        //makes everything committed visible at once, so a batch costs one store to the shared line
+        inline char* reserve() {
+            if (next - cachedOther > mask) {
+                cachedOther = control->head.load(std::memory_order_acquire);
+                if (next - cachedOther > mask) return nullptr;
+            }
+            return slots[next & mask].bytes;
+        }
+        inline void commit() { next++; }
+        inline void publish() { control->tail.store(next, std::memory_order_release); }
+
+        //consumer side: the next message (nullptr if none), and dropping it
+        inline const char* front() {
+            if (next == cachedOther) {
+                cachedOther = control->tail.load(std::memory_order_acquire);
+                if (next == cachedOther) return nullptr;
+            }
+            return slots[next & mask].bytes;
+        }
+        inline void pop() { control->head.store(++next, std::memory_order_release); }
+
+        //consumer side, but only a snapshot
+        inline bool empty() const { return control->head.load(std::memory_order_relaxed) == control->tail.load(std::memory_order_acquire); }
+    };
+
+
+    //the mapped segment. the server creates it, clients attach to it by name
+    class ShmSegment {
+
+    private:
+        std::string segmentName;
+        void* base = nullptr;
+        size_t length = 0;
+        bool owner = false;         // created it, unlinks the name on close
+
+    public:
+        ShmSegment() {}
+        ShmSegment(const ShmSegment&) = delete;
+        ShmSegment& operator=(const ShmSegment&) = delete;
+        ~ShmSegment() { close(); }
+
+        //server side. a segment left behind by a server that died is replaced, one whose server is
+        //still running is not. 0 on success, 1 (with a message on stderr) otherwise
+        int create(const std::string &name, size_t client_slots, size_t ring_slots);
+
+        //client side. 0 on success, 1 (with a message on stderr) if there is no usable segment
+        int attach(const std::string &name);
+
+        void close();
+
+        inline bool mapped() const { return base != nullptr; }
+        inline const std::string& name() const { return segmentName; }
+        inline ShmSegmentHeader* header() const { return static_cast<ShmSegmentHeader*>(base); }
+        ShmClientControl* client(size_t slot) const;
+        ShmSlot* ringSlots(size_t slot, bool to_server) const;
+
+        //free slot -> ring indices back to 0, generation bumped, state FREE. server side only
+        void resetClient(size_t slot);
+    };
+
+
+    //doorbells: abstract unix datagram sockets, "<segment name>" for the server and
+    //"<segment name>.<slot>" for a client. every datagram is one ring, only the wakeup matters
+    int openDoorbell(const std::string &segment_name, int slot); //slot -1: the server's. -1 on failure
+    void ringDoorbell(int doorbell_fd, const std::string &segment_name, int slot);
+    void drainDoorbell(int doorbell_fd);
+
+    bool processAlive(pid_t pid);
+
+    //false on a single cpu, where spinning on a ring only delays the process that would fill it
+    bool spinningHelps();
+
+
+
+#endif
@@ -0,0 +1,100 @@
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+
+
+    static const size_t CACHE_LINE_SIZE = 64;
+
+
+    //tells the core we are in a spin loop (saves power, frees the sibling hyperthread)
+    inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+
+    //bounded lock-free single-producer/single-consumer ring.
+    //head and tail live on separate cache lines, and each side keeps a cached copy of the other
+    //side's index so it only touches the shared line when the ring looks full/empty.
+    template <typename T>
+    class SPSCQueue {
+
+    private:
+        std::unique_ptr<T[]> slots;
+        size_t mask = 0;
+
+        alignas(CACHE_LINE_SIZE) std::atomic<size_t> head{0}; // next slot to read, written by the consumer
+        size_t cachedTail = 0;                                 // consumer's view of tail
+
+        alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail{0}; // next slot to write, written by the producer
+        size_t cachedHead = 0;                                 // producer's view of head
+
+    public:
+        //capacity is rounded up to a power of two. not thread safe, call before either side starts
+        void initialize(size_t capacity) {
+            size_t size = 2;
+            while (size < capacity) size <<= 1;
+            slots.reset(new T[size]);
+            mask = size - 1;
+            head.store(0, std::memory_order_relaxed);
+            tail.store(0, std::memory_order_relaxed);
+            cachedHead = cachedTail = 0;
+        }
+
+        inline size_t capacity() const { return mask + 1; }
+
+        //producer side, false if the ring is full
+        inline bool tryPush(const T& item) {
+            size_t t = tail.load(std::memory_order_relaxed);
+            if (t - cachedHead > mask) {
+                cachedHead = head.load(std::memory_order_acquire);
+                if (t - cachedHead > mask) return false;
+            }
+            slots[t & mask] = item;
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        //consumer side, false if the ring is empty
+        inline bool tryPop(T& item) {
+            size_t h = head.load(std::memory_order_relaxed);
+            if (h == cachedTail) {
+                cachedTail = tail.load(std::memory_order_acquire);
+                if (h == cachedTail) return false;
+            }
+            item = slots[h & mask];
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        //consumer side, pointer to the next item without removing it (nullptr if empty)
+        inline T* front() {
+            size_t h = head.load(std::memory_order_relaxed);
+            if (h == cachedTail) {
+                cachedTail = tail.load(std::memory_order_acquire);
+                if (h == cachedTail) return nullptr;
+            }
+            return &slots[h & mask];
+        }
+
+        //consumer side, drops the item returned by front()
+        inline void pop() {
+            head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        //safe from either side, but only a snapshot
+        inline bool empty() const {
+            return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+        }
+    };
+
+
+
+#endif
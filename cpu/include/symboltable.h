@@ -0,0 +1,51 @@
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#ifndef SYMBOLTABLE_H
+#define SYMBOLTABLE_H
+
+
+
+    //instrument names <-> dense symbol ids, fixed at startup.
+    //lookups take a string_view so the parser can resolve a token without building a string
+    class SymbolTable {
+
+    public:
+        static const uint32_t NOT_FOUND = 0xFFFFFFFF;
+
+    private:
+        std::deque<std::string> names; // deque so the views in `ids` stay valid as names are added
+        std::unordered_map<std::string_view, uint32_t> ids;
+
+    public:
+        //returns the new id, or the existing one if the name is already there
+        uint32_t add(const std::string &name) {
+            auto it = ids.find(name);
+            if (it != ids.end()) return it->second;
+            names.push_back(name);
+            uint32_t id = static_cast<uint32_t>(names.size() - 1);
+            ids.emplace(std::string_view(names.back()), id);
+            return id;
+        }
+
+        inline uint32_t find(std::string_view name) const {
+            auto it = ids.find(name);
+            return (it == ids.end()) ? NOT_FOUND : it->second;
+        }
+
+        inline const std::string& name(uint32_t id) const { return names[id]; }
+
+        inline size_t size() const { return names.size(); }
+
+        //comma separated list ("AAPL,MSFT") or a file with one name per line, false if nothing usable.
+        //names must start with a letter
+        bool load(const std::string &spec);
+    };
+
+
+
+#endif
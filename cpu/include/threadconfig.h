@@ -0,0 +1,50 @@
+#include <cstddef>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#ifndef THREADCONFIG_H
+#define THREADCONFIG_H
+
+
+
+    //how a latency critical thread wants to run. the defaults leave the thread as the os made it
+    struct ThreadPlacement {
+        int cpu = -1;           // pin to this cpu, -1 leaves the affinity alone
+        int fifoPriority = 0;   // 1-99 switches to SCHED_FIFO at that priority, 0 leaves the scheduler alone
+    };
+
+
+    //which startup settings took effect and which didn't (usually for want of privileges), so a run
+    //can be told apart from one that really had its cores to itself. safe to record from any thread
+    class RuntimeStatus {
+
+    private:
+        mutable std::mutex lock;
+        std::vector<std::string> lines;
+        size_t failed = 0;
+
+    public:
+        //`error` is 0 for success or an errno value
+        void record(const std::string &what, int error);
+
+        size_t failures() const;
+
+        void write(std::ostream &out) const;
+    };
+
+
+    //pins the calling thread to one cpu. returns 0 on success, an errno value otherwise
+    int pinCurrentThread(int cpu);
+
+    //SCHED_FIFO at `priority` for the calling thread. returns 0 on success, an errno value otherwise
+    int setCurrentThreadFifo(int priority);
+
+    //names the calling thread `name` (shown by top -H and perf) and applies `placement`.
+    //every step is logged and, with a status, recorded there. returns how many steps failed
+    int placeCurrentThread(const std::string &name, const ThreadPlacement &placement, RuntimeStatus* status);
+
+
+
+#endif
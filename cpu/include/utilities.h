@@ -4,8 +4,7 @@
 #include <algorithm>
 #include <iostream> 
 #include "orderbook.h"
-
-
+#include "orderfile.h"
 
 
 
@@ -30,6 +29,11 @@ inline std::vector<Order> generateRandomOrders(
 
     for (size_t i = 0; i < count; ++i) {
         Order o;
+        o.id = i + 1;
+        o.seq = i + 1;
+        o.session = 0;
+        o.symbol = 0;
+        o.action = ORDER_NEW;
         o.buy = (sideDist(gen) == 1);
         o.price = priceDist(gen);
         o.quantity = qtyDist(gen);
@@ -40,47 +44,30 @@ inline std::vector<Order> generateRandomOrders(
     return orders;
 }
 
-//write orders to binary file
-inline bool saveOrdersToFile(const std::string &filename, const std::vector<Order> &orders) {
-    std::ofstream outFile(filename, std::ios::binary | std::ios::out);
-    if (!outFile) {
-        std::cerr << "could not open file to write: " << filename << "\n";
-        return false;
-    }
-
-    //# of orders
-    size_t count = orders.size();
-    outFile.write(reinterpret_cast<const char*>(&count), sizeof(count));
-
-    //all orders
-    outFile.write(reinterpret_cast<const char*>(orders.data()), count * sizeof(Order));
-
-    outFile.close();
-    return true;
+//write orders to a versioned order file (see orderfile.h), block-compressed if asked.
+//`symbols` names the symbol ids the orders use, if there is more than one
+inline bool saveOrdersToFile(const std::string &filename, const std::vector<Order> &orders, bool compress = false,
+                             const std::vector<std::string> &symbols = {}) {
+    OrderFileWriter writer;
+    if (writer.open(filename, compress, symbols) != 0) return false;
+    for (const Order &o : orders) writer.write(o);
+    return writer.close() == 0;
 }
 
-//load orders from binary file
+//load a whole order file into memory. replays that only walk the file once should iterate an
+//OrderFileReader instead and skip the copy
 inline bool loadOrdersFromFile(const std::string &filename, std::vector<Order> &orders) {
-    std::ifstream inFile(filename, std::ios::binary | std::ios::in);
-    if (!inFile) {
-        std::cerr << "could not open file to read: " << filename << "\n";
-        return false;
-    }
-
-    size_t count;
-    inFile.read(reinterpret_cast<char*>(&count), sizeof(count));
-    if (!inFile) {
-        std::cerr << "could not read count from file\n";
-        return false;
-    }
-
-    orders.resize(count);
-    inFile.read(reinterpret_cast<char*>(orders.data()), count * sizeof(Order));
-    if (!inFile) {
+    OrderFileReader reader;
+    if (reader.open(filename) != 0) return false;
+
+    //ids are the 1-based position in the file
+    orders.clear();
+    orders.resize(reader.size());
+    size_t loaded = 0;
+    while (loaded < orders.size() && reader.next(orders[loaded])) loaded++;
+    if (loaded != orders.size()) {
         std::cerr << "could not read orders from file\n";
         return false;
     }
-
-    inFile.close();
     return true;
 }
@@ -0,0 +1,35 @@
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "order.h"
+
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+
+
+    //seeded order flow for benchmarks. the same profile, count, seed and symbol count always give
+    //the same orders, so two runs (or two book implementations) see exactly the same input
+    struct WorkloadSpec {
+        std::string profile = "gaussian";
+        size_t count = 1000000;
+        uint64_t seed = 1;
+        uint32_t symbols = 16;  // only the multi-symbol profile uses more than one
+    };
+
+
+    //names understood by generateWorkload, with a one line description each
+    struct WorkloadProfile {
+        const char* name;
+        const char* description;
+    };
+
+    const std::vector<WorkloadProfile>& workloadProfiles();
+
+    //fills `orders` (ids 1..n, session 1), false if the profile is unknown
+    bool generateWorkload(const WorkloadSpec &spec, std::vector<Order> &orders);
+
+
+
+#endif
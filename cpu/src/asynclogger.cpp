@@ -0,0 +1,158 @@
+#include "asynclogger.h"
+#include <iostream>
+#include <chrono>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+AsyncLogger::~AsyncLogger() {
+    stop();
+}
+
+
+
+int AsyncLogger::initialize(size_t producer_count, size_t ring_capacity, size_t max_streams, LogFullPolicy full_policy) {
+    policy = full_policy;
+    producers.clear();
+    for (size_t i = 0; i < producer_count; ++i) {
+        std::unique_ptr<Producer> producer(new Producer());
+        producer->ring.initialize(ring_capacity);
+        producers.push_back(std::move(producer));
+    }
+    streams.clear();
+    streams.resize(max_streams);
+    streamCount.store(0, std::memory_order_relaxed);
+    return 0;
+}
+
+
+
+int AsyncLogger::openStream(const std::string &path) {
+    std::lock_guard<std::mutex> lock(openMutex);
+    size_t id = streamCount.load(std::memory_order_relaxed);
+    if (id == streams.size()) {
+        std::cerr << "no log stream left for " << path << "\n";
+        return -1;
+    }
+    std::unique_ptr<Stream> stream(new Stream());
+    stream->path = path;
+    streams[id] = std::move(stream);
+    streamCount.store(id + 1, std::memory_order_release); //the logger thread may look at the slot from now on
+    return static_cast<int>(id);
+}
+
+
+
+void AsyncLogger::start() {
+    if (running) return;
+    stopRequested.store(false);
+    running = true;
+    thread = std::thread(&AsyncLogger::run, this);
+}
+
+
+
+void AsyncLogger::stop() {
+    if (!running) return;
+    stopRequested.store(true);
+    if (thread.joinable()) thread.join();
+    running = false;
+}
+
+
+
+uint64_t AsyncLogger::dropped() const {
+    uint64_t total = 0;
+    for (const auto &producer : producers) total += producer->dropped.load(std::memory_order_relaxed);
+    return total;
+}
+
+
+
+bool AsyncLogger::drain() {
+    bool any = false;
+    LogRecord record;
+    for (auto &producer : producers) {
+        while (producer->ring.tryPop(record)) {
+            any = true;
+            Stream &stream = *streams[record.stream];
+            if (stream.failed) continue;
+            stream.buffer.insert(stream.buffer.end(), record.payload, record.payload + record.size);
+            recordsWritten.store(recordsWritten.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            if (stream.buffer.size() >= FLUSH_SIZE) flush(stream);
+        }
+    }
+    return any;
+}
+
+
+
+void AsyncLogger::flush(Stream &stream) {
+    if (stream.buffer.empty() || stream.failed) return;
+    if (stream.fd < 0) {
+        stream.fd = open(stream.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (stream.fd < 0) {
+            std::cerr << "could not open log file " << stream.path << "\n";
+            stream.failed = true;
+            stream.buffer.clear();
+            return;
+        }
+        stream.buffer.reserve(FLUSH_SIZE + LogRecord::MAX_PAYLOAD);
+    }
+
+    size_t done = 0;
+    while (done < stream.buffer.size()) {
+        ssize_t n = write(stream.fd, stream.buffer.data() + done, stream.buffer.size() - done);
+        writeCalls.store(writeCalls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            writeErrors.store(writeErrors.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            std::cerr << "could not write log file " << stream.path << "\n";
+            stream.failed = true;
+            break;
+        }
+        done += static_cast<size_t>(n);
+    }
+    stream.buffer.clear();
+}
+
+
+
+void AsyncLogger::flushAll() {
+    size_t count = streamCount.load(std::memory_order_acquire);
+    for (size_t i = 0; i < count; ++i) flush(*streams[i]);
+}
+
+
+
+void AsyncLogger::run() {
+    if (!threadName.empty()) placeCurrentThread(threadName, placement, runtimeStatus);
+    while (!stopRequested.load(std::memory_order_acquire)) {
+        if (!drain()) { //quiet, get what is buffered onto disk and nap
+            flushAll();
+            std::this_thread::sleep_for(std::chrono::microseconds(IDLE_SLEEP_US));
+        }
+    }
+
+    //producers are done by the time stop() is called, take what they left
+    while (drain()) {}
+    flushAll();
+    size_t count = streamCount.load(std::memory_order_acquire);
+    for (size_t i = 0; i < count; ++i) {
+        Stream &stream = *streams[i];
+        if (stream.fd >= 0) {
+            close(stream.fd);
+            stream.fd = -1;
+        }
+    }
+}
+
+
+
+bool AsyncLogger::parsePolicy(const std::string &name, LogFullPolicy &out) {
+    if (name == "drop") out = LOG_DROP;
+    else if (name == "block") out = LOG_BLOCK;
+    else return false;
+    return true;
+}
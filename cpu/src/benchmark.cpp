@@ -0,0 +1,335 @@
+// benchmark.cpp
+// replays seeded workloads through several book implementations and reports throughput and
+// per-order latency percentiles, as a table and optionally as json
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include "orderbook.h"
+#include "mapbook.h"
+#include "workload.h"
+#include "latencyhistogram.h"
+#include "clock.h"
+#include "utilities.h"
+
+
+//one timed pass of one implementation over one workload
+struct RepResult {
+    double seconds = 0;
+    double ordersPerSecond = 0;
+    uint64_t checksum = 0;
+    uint64_t events = 0;
+};
+
+
+struct ImplResult {
+    std::string impl;
+    std::vector<RepResult> reps;
+    LatencyHistogram latencies; //every timed order of every rep
+    bool consistent = true;     //all reps produced the same events
+};
+
+
+static const uint64_t FNV_OFFSET = 1469598103934665603ULL;
+static const uint64_t FNV_PRIME = 1099511628211ULL;
+
+//fnv-1a over what a client would see, so two books agree only if they matched the same way
+static inline uint64_t hashEvents(uint64_t h, const std::vector<BookEvent> &events) {
+    for (const BookEvent &e : events) {
+        uint64_t fields[5] = {e.orderId, e.passiveId, static_cast<uint64_t>(static_cast<uint32_t>(e.price)),
+                              static_cast<uint64_t>(static_cast<uint32_t>(e.quantity)), static_cast<uint64_t>(e.type) | (e.buy ? 0x100ULL : 0)};
+        for (uint64_t f : fields) {
+            h ^= f;
+            h *= FNV_PRIME;
+        }
+    }
+    return h;
+}
+
+
+//the final depth of every book goes into the checksum too, so level totals have to agree as well
+static const size_t DEPTH_CHECK_LEVELS = 20;
+
+template <typename Book>
+static uint64_t hashDepth(uint64_t h, const Book &book) {
+    std::vector<DepthLevel> levels;
+    for (bool bid : {true, false}) {
+        book.depth(bid, DEPTH_CHECK_LEVELS, levels);
+        for (const DepthLevel &l : levels) {
+            uint64_t fields[3] = {static_cast<uint64_t>(static_cast<uint32_t>(l.price)), l.orders, static_cast<uint64_t>(l.quantity)};
+            for (uint64_t f : fields) {
+                h ^= f;
+                h *= FNV_PRIME;
+            }
+        }
+    }
+    return h;
+}
+
+
+//the books under test, built fresh for every rep so no run inherits another's state
+static std::unique_ptr<OrderBook> makeOrderBook(size_t pool, int window, HugePagePolicy huge_pages) {
+    std::string no_log;
+    std::unique_ptr<OrderBook> book(new OrderBook(no_log, pool, window));
+    book->setHugePages(huge_pages);
+    if (book->initialize() != 0) return nullptr;
+    book->enableEvents(true);
+    return book;
+}
+
+static std::unique_ptr<MapOrderBook> makeMapBook() {
+    std::unique_ptr<MapOrderBook> book(new MapOrderBook());
+    book->initialize();
+    return book;
+}
+
+//one book per symbol, every order timed on its own
+template <typename Book, typename Factory>
+static bool runOnce(const std::vector<Order> &orders, uint32_t symbols, Factory make, RepResult &result, LatencyHistogram *latencies) {
+    std::vector<std::unique_ptr<Book>> books;
+    for (uint32_t s = 0; s < symbols; ++s) {
+        books.push_back(make());
+        if (!books.back()) return false;
+    }
+
+    uint64_t checksum = FNV_OFFSET;
+    uint64_t events = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const Order &in : orders) {
+        Order o = in; //process() works the quantity down
+        Book &book = *books[o.symbol];
+        uint64_t t0 = clockNow();
+        book.process(o);
+        uint64_t t1 = clockNowOrdered();
+        if (latencies) latencies->record(ticksToNanos(t1 - t0));
+        checksum = hashEvents(checksum, book.events());
+        events += book.events().size();
+        book.clearEvents();
+    }
+    auto end = std::chrono::steady_clock::now();
+    for (const auto &book : books) checksum = hashDepth(checksum, *book);
+
+    result.seconds = std::chrono::duration<double>(end - start).count();
+    result.ordersPerSecond = result.seconds > 0 ? static_cast<double>(orders.size()) / result.seconds : 0;
+    result.checksum = checksum;
+    result.events = events;
+    return true;
+}
+
+
+template <typename Book, typename Factory>
+static bool runImpl(const std::string &name, const std::vector<Order> &orders, uint32_t symbols, int warmup, int reps,
+                    Factory make, ImplResult &out) {
+    out.impl = name;
+    RepResult rep;
+    for (int i = 0; i < warmup; ++i) {
+        if (!runOnce<Book>(orders, symbols, make, rep, nullptr)) return false;
+    }
+    for (int i = 0; i < reps; ++i) {
+        if (!runOnce<Book>(orders, symbols, make, rep, &out.latencies)) return false;
+        if (!out.reps.empty() && rep.checksum != out.reps.front().checksum) out.consistent = false;
+        out.reps.push_back(rep);
+    }
+    return true;
+}
+
+
+static double median(std::vector<double> v) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    size_t n = v.size();
+    return (n % 2) ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2.0;
+}
+
+
+static std::string hex(uint64_t v) {
+    std::ostringstream oss;
+    oss << std::hex << v;
+    return oss.str();
+}
+
+
+static void printTable(const std::string &profile, const std::vector<ImplResult> &results) {
+    std::cout << "\nprofile " << profile << "\n";
+    std::cout << "impl        median ops/s    p50 ns   p99 ns  p99.9 ns    max ns  checksum\n";
+    for (const ImplResult &r : results) {
+        std::vector<double> ops;
+        for (const RepResult &rep : r.reps) ops.push_back(rep.ordersPerSecond);
+        char line[256];
+        snprintf(line, sizeof(line), "%-10s %13.0f %9llu %8llu %9llu %9llu  %s%s\n", r.impl.c_str(), median(ops),
+                 (unsigned long long)r.latencies.percentile(50.0), (unsigned long long)r.latencies.percentile(99.0),
+                 (unsigned long long)r.latencies.percentile(99.9), (unsigned long long)r.latencies.max(),
+                 r.reps.empty() ? "-" : hex(r.reps.front().checksum).c_str(), r.consistent ? "" : " (differs between reps!)");
+        std::cout << line;
+    }
+    for (const ImplResult &r : results) {
+        if (!r.reps.empty() && !results.front().reps.empty() && r.reps.front().checksum != results.front().reps.front().checksum) {
+            std::cout << "warning: " << r.impl << " does not match " << results.front().impl << " on " << profile << "\n";
+        }
+    }
+}
+
+
+static void writeJson(std::ostream &out, const WorkloadSpec &spec, size_t orders, int warmup,
+                      const std::vector<ImplResult> &results, bool first) {
+    if (!first) out << ",\n";
+    out << "  {\"profile\": \"" << spec.profile << "\", \"seed\": " << spec.seed << ", \"orders\": " << orders
+        << ", \"symbols\": " << spec.symbols << ", \"warmup\": " << warmup << ", \"clock\": \"" << clockSourceName()
+        << "\", \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const ImplResult &r = results[i];
+        std::vector<double> ops;
+        for (const RepResult &rep : r.reps) ops.push_back(rep.ordersPerSecond);
+        out << "    {\"impl\": \"" << r.impl << "\", \"median_ops_per_sec\": " << median(ops)
+            << ", \"mean_ns\": " << r.latencies.mean()
+            << ", \"p50_ns\": " << r.latencies.percentile(50.0)
+            << ", \"p90_ns\": " << r.latencies.percentile(90.0)
+            << ", \"p99_ns\": " << r.latencies.percentile(99.0)
+            << ", \"p99_9_ns\": " << r.latencies.percentile(99.9)
+            << ", \"p99_99_ns\": " << r.latencies.percentile(99.99)
+            << ", \"max_ns\": " << r.latencies.max()
+            << ", \"checksum\": \"" << (r.reps.empty() ? "" : hex(r.reps.front().checksum)) << "\""
+            << ", \"matches_first_impl\": " << ((r.reps.empty() || results.front().reps.empty() ||
+                                                 r.reps.front().checksum == results.front().reps.front().checksum) ? "true" : "false")
+            << ", \"consistent\": " << (r.consistent ? "true" : "false")
+            << ", \"reps\": [";
+        for (size_t k = 0; k < r.reps.size(); ++k) {
+            const RepResult &rep = r.reps[k];
+            out << (k ? ", " : "") << "{\"seconds\": " << rep.seconds << ", \"ops_per_sec\": " << rep.ordersPerSecond
+                << ", \"events\": " << rep.events << "}";
+        }
+        out << "]}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]}";
+}
+
+
+static void usage(const char* prog) {
+    std::cerr << "usage: " << prog << " [--profile name|all] [--orders n] [--seed n] [--symbols n] [--reps n] [--warmup n]\n"
+              << "       [--impl dense,window,map] [--window n] [--huge-pages off|thp|explicit] [--file orders.bin] [--json out.json]\n"
+              << "profiles:\n";
+    for (const WorkloadProfile &p : workloadProfiles()) std::cerr << "  " << p.name << ": " << p.description << "\n";
+    std::cerr << "impls:\n"
+              << "  dense: OrderBook with the full price ladder\n"
+              << "  window: OrderBook with a windowed ladder (--window prices, default 4096)\n"
+              << "  map: std::map/std::list reference book\n"
+              << "--huge-pages backs the OrderBook pools, indexes and ladders with 2MB pages (default: off).\n"
+              << "--file replays an order file instead of a generated profile.\n";
+}
+
+
+int main(int argc, char *argv[]) {
+    WorkloadSpec spec;
+    std::string profileArg = "gaussian";
+    std::string implArg = "dense,window,map";
+    std::string fileName;
+    std::string jsonName;
+    int reps = 5;
+    int warmup = 1;
+    int window = 4096;
+    HugePagePolicy hugePages = HUGE_PAGES_OFF;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--profile" && i + 1 < argc) profileArg = argv[++i];
+            else if (arg == "--orders" && i + 1 < argc) spec.count = static_cast<size_t>(std::stoull(argv[++i]));
+            else if (arg == "--seed" && i + 1 < argc) spec.seed = std::stoull(argv[++i]);
+            else if (arg == "--symbols" && i + 1 < argc) spec.symbols = static_cast<uint32_t>(std::stoul(argv[++i]));
+            else if (arg == "--reps" && i + 1 < argc) reps = std::stoi(argv[++i]);
+            else if (arg == "--warmup" && i + 1 < argc) warmup = std::stoi(argv[++i]);
+            else if (arg == "--impl" && i + 1 < argc) implArg = argv[++i];
+            else if (arg == "--window" && i + 1 < argc) window = std::stoi(argv[++i]);
+            else if (arg == "--huge-pages" && i + 1 < argc && parseHugePagePolicy(argv[i + 1], hugePages)) i++;
+            else if (arg == "--file" && i + 1 < argc) fileName = argv[++i];
+            else if (arg == "--json" && i + 1 < argc) jsonName = argv[++i];
+            else {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+    } catch (const std::exception &e) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::string> impls;
+    std::istringstream implList(implArg);
+    for (std::string name; std::getline(implList, name, ',');) {
+        if (name != "dense" && name != "window" && name != "map") {
+            std::cerr << "unknown impl: " << name << "\n";
+            return EXIT_FAILURE;
+        }
+        impls.push_back(name);
+    }
+
+    std::vector<std::string> profiles;
+    if (!fileName.empty()) profiles.push_back("file");
+    else if (profileArg == "all") {
+        for (const WorkloadProfile &p : workloadProfiles()) profiles.push_back(p.name);
+    } else profiles.push_back(profileArg);
+
+    calibrateClock();
+    std::cout << "clock: " << clockSourceName() << ", " << reps << " reps after " << warmup << " warm-up\n";
+
+    std::ofstream json;
+    if (!jsonName.empty()) {
+        json.open(jsonName);
+        if (!json) {
+            std::cerr << "could not open " << jsonName << "\n";
+            return EXIT_FAILURE;
+        }
+        json.precision(12);
+        json << "[\n";
+    }
+
+    for (size_t p = 0; p < profiles.size(); ++p) {
+        WorkloadSpec run = spec;
+        run.profile = profiles[p];
+        std::vector<Order> orders;
+        if (!fileName.empty()) {
+            if (!loadOrdersFromFile(fileName, orders)) return EXIT_FAILURE;
+            run.symbols = 1;
+        } else if (!generateWorkload(run, orders)) {
+            std::cerr << "unknown profile: " << run.profile << "\n";
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+        uint32_t symbols = 1;
+        for (const Order &o : orders) symbols = std::max(symbols, o.symbol + 1);
+        run.symbols = symbols;
+        size_t pool = orders.size() + 1; //never full, so every impl rests the same orders
+
+        std::vector<ImplResult> results;
+        for (const std::string &impl : impls) {
+            ImplResult r;
+            bool ok;
+            if (impl == "map") ok = runImpl<MapOrderBook>(impl, orders, symbols, warmup, reps, makeMapBook, r);
+            else {
+                int w = (impl == "dense") ? OrderBook::DENSE_LADDER : window;
+                ok = runImpl<OrderBook>(impl, orders, symbols, warmup, reps, [pool, w, hugePages]() { return makeOrderBook(pool, w, hugePages); }, r);
+            }
+            if (!ok) {
+                std::cerr << "could not set up " << impl << " books\n";
+                return EXIT_FAILURE;
+            }
+            results.push_back(r);
+        }
+
+        printTable(run.profile, results);
+        if (json.is_open()) writeJson(json, run, orders.size(), warmup, results, p == 0);
+    }
+
+    if (json.is_open()) {
+        json << "\n]\n";
+        std::cout << "\nresults written to " << jsonName << "\n";
+    }
+    return EXIT_SUCCESS;
+}
@@ -1,6 +1,18 @@
 #include "client.h"
+#include <poll.h>
+#include <cerrno>
+#include <chrono>
+#include <thread>
 
-Client::Client(const std::string &ip, int port) : server_ip(ip), server_port(port), client_fd(-1) {}
+Client::Client(const std::string &ip, int port) : server_ip(ip), server_port(port), client_fd(-1) {
+    reportBuffer.initialize(REPORT_BUFFER_SIZE);
+    sendBuffer.resize(SEND_BUFFER_SIZE);
+}
+
+
+Client::~Client() {
+    if (shared_memory()) close_client();
+}
 
 
 int Client::connect_to_server() {
@@ -25,7 +37,59 @@ int Client::connect_to_server() {
     return 0;
 }
 
+int Client::attach_shared_memory(const std::string &name) {
+    if (shm.attach(name) != 0) {
+        std::cerr << "no order gateway at shared memory " << name << "\n";
+        return 1;
+    }
+    ShmSegmentHeader* header = shm.header();
+    if (!header->running.load() || !processAlive(header->serverPid)) {
+        std::cerr << "the server behind shared memory " << name << " is not running\n";
+        shm.close();
+        return 1;
+    }
+
+    for (uint32_t slot = 0; slot < header->clientSlots; ++slot) {
+        ShmClientControl* control = shm.client(slot);
+        uint32_t expected = SHM_CLIENT_FREE;
+        if (!control->state.compare_exchange_strong(expected, SHM_CLIENT_CLAIMED)) continue;
+        control->pid = static_cast<int32_t>(getpid());
+
+        client_fd = openDoorbell(name, static_cast<int>(slot));
+        if (client_fd < 0) {
+            control->state.store(SHM_CLIENT_CLOSING, std::memory_order_release);
+            shm.close();
+            return 1;
+        }
+        shmSlot = static_cast<int>(slot);
+        shmOut.bind(&control->toServer, shm.ringSlots(slot, true), header->ringSlots, true);
+        shmIn.bind(&control->toClient, shm.ringSlots(slot, false), header->ringSlots, false);
+        binaryMode = true;
+        control->state.store(SHM_CLIENT_ACTIVE, std::memory_order_release);
+        wake_server(); //so it opens our session now rather than at its next timeout
+        std::cout << "attached to shared memory " << name << " (client slot " << slot << ")\n";
+        return 0;
+    }
+    std::cerr << "all " << header->clientSlots << " client slots of " << name << " are taken\n";
+    shm.close();
+    return 1;
+}
+
+bool Client::shm_attached() const {
+    return shm.client(static_cast<size_t>(shmSlot))->state.load(std::memory_order_acquire) == SHM_CLIENT_ACTIVE &&
+           shm.header()->running.load(std::memory_order_acquire);
+}
+
+void Client::wake_server() {
+    std::atomic_thread_fence(std::memory_order_seq_cst); //pairs with the event loop's fence before it sleeps
+    if (shm.header()->serverSleeping.load(std::memory_order_relaxed)) ringDoorbell(client_fd, shm.name(), -1);
+}
+
 int Client::send_order(const std::string &order_str) {
+    if (shared_memory()) {
+        std::cerr << "text orders need a tcp connection, shared memory carries binary orders only\n";
+        return 1;
+    }
     ssize_t bytes_sent = send(client_fd, order_str.c_str(), order_str.size(), 0);
     if (bytes_sent < 0) {
         std::cerr << "could not send\n";
@@ -34,6 +98,238 @@ int Client::send_order(const std::string &order_str) {
     return 0;
 }
 
+int Client::send_hello() {
+    if (shared_memory()) return 0; //always binary
+    char msg[HELLO_SIZE];
+    encodeHello(msg);
+    if (send(client_fd, msg, HELLO_SIZE, 0) < 0) {
+        std::cerr << "could not send\n";
+        return 1;
+    }
+    binaryMode = true;
+    return 0;
+}
+
+int Client::send_order(const Order &order) {
+    if (shared_memory()) {
+        char* slot;
+        while ((slot = shmOut.reserve()) == nullptr) { //ring full: wait for the server like a full socket would
+            if (!shm_attached()) {
+                std::cerr << "server closed the connection\n";
+                return 1;
+            }
+            wake_server();
+            std::this_thread::yield();
+        }
+        encodeOrder(slot, order);
+        shmOut.commit();
+        shmOut.publish();
+        wake_server();
+        return 0;
+    }
+    char msg[MAX_MESSAGE_SIZE];
+    size_t len = encodeOrder(msg, order);
+    if (send(client_fd, msg, len, 0) < 0) {
+        std::cerr << "could not send\n";
+        return 1;
+    }
+    return 0;
+}
+
+bool Client::queue_order(const Order &order, const SymbolTable* symbols) {
+    size_t room = sendBuffer.size() - sendLength;
+    if (binaryMode) {
+        if (room < MAX_MESSAGE_SIZE) return false;
+        sendLength += encodeOrder(&sendBuffer[sendLength], order);
+    } else {
+        size_t nameLength = (symbols && order.symbol < symbols->size()) ? symbols->name(order.symbol).size() : 0;
+        if (room < MAX_TEXT_ORDER_SIZE + nameLength) return false;
+        sendLength += formatTextOrder(&sendBuffer[sendLength], order, symbols);
+    }
+    queuedOrders++;
+    return true;
+}
+
+int Client::flush_orders(std::vector<ExecReport> &reports) {
+    size_t offset = 0;
+    while (shared_memory() && offset < sendLength) {
+        //one ring slot per message, published together so the server sees the batch at once
+        char* slot = shmOut.reserve();
+        if (slot != nullptr) {
+            size_t len = getU16(&sendBuffer[offset]);
+            std::memcpy(slot, &sendBuffer[offset], len);
+            shmOut.commit();
+            offset += len;
+            continue;
+        }
+        //ring full: let the server at what we have and take our reports so it can keep going
+        shmOut.publish();
+        sendCalls++;
+        wake_server();
+        if (read_reports(reports) < 0) return 1;
+        if (spinningHelps()) cpuRelax();
+        else std::this_thread::yield();
+    }
+    if (shared_memory()) {
+        shmOut.publish();
+        sendCalls++;
+        wake_server();
+        bytesSent += sendLength;
+    }
+    while (offset < sendLength) {
+        ssize_t n = send(client_fd, &sendBuffer[offset], sendLength - offset, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n > 0) {
+            offset += static_cast<size_t>(n);
+            bytesSent += static_cast<uint64_t>(n);
+            sendCalls++;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            std::cerr << "could not send\n";
+            return 1;
+        }
+
+        //socket full: wait for room, draining reports meanwhile
+        pollfd pfd;
+        pfd.fd = client_fd;
+        pfd.events = POLLIN | POLLOUT;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR) return 1;
+        if ((pfd.revents & POLLIN) && read_reports(reports) < 0) return 1;
+        if (pfd.revents & (POLLERR | POLLHUP)) {
+            std::cerr << "connection lost while sending\n";
+            return 1;
+        }
+    }
+    ordersSent += queuedOrders;
+    sendLength = 0;
+    queuedOrders = 0;
+    return 0;
+}
+
+int Client::poll_reports(std::vector<ExecReport> &reports, int timeout_ms) {
+    if (shared_memory()) {
+        int added = read_reports(reports);
+        if (added != 0 || timeout_ms == 0) return added;
+
+        //reports usually come back within microseconds, a short spin saves the doorbell round trip
+        auto spinEnd = std::chrono::steady_clock::now() + std::chrono::microseconds(spinningHelps() ? SHM_SPIN_US : 0);
+        while (std::chrono::steady_clock::now() < spinEnd) {
+            if ((added = read_reports(reports)) != 0) return added;
+            cpuRelax();
+        }
+
+        if (arm_doorbell()) {
+            pollfd pfd;
+            pfd.fd = client_fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            poll(&pfd, 1, timeout_ms);
+        }
+        disarm_doorbell();
+        return read_reports(reports);
+    }
+    pollfd pfd;
+    pfd.fd = client_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int ready = poll(&pfd, 1, timeout_ms);
+    if (ready < 0) return (errno == EINTR) ? 0 : -1;
+    if (ready == 0) return 0;
+    return read_reports(reports);
+}
+
+bool Client::arm_doorbell() {
+    if (!shared_memory()) return true;
+    //the server rings after publishing if it sees this, so either it does or we see the reports here
+    shm.client(static_cast<size_t>(shmSlot))->sleeping.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return shmIn.empty() && shm_attached();
+}
+
+void Client::disarm_doorbell() {
+    if (!shared_memory()) return;
+    shm.client(static_cast<size_t>(shmSlot))->sleeping.store(0, std::memory_order_relaxed);
+    drainDoorbell(client_fd);
+}
+
+int Client::read_reports(std::vector<ExecReport> &reports) {
+    if (shared_memory()) {
+        int added = 0;
+        ExecReport report;
+        const char* message;
+        for (uint64_t n = 0; n < shmIn.capacity() && (message = shmIn.front()) != nullptr; ++n) {
+            size_t consumed = 0;
+            DecodeStatus status = decodeExecReport(message, SHM_SLOT_SIZE, report, consumed);
+            shmIn.pop();
+            if (status == DECODE_OK) {
+                reports.push_back(report);
+                added++;
+            } else if (status != DECODE_SKIPPED) {
+                std::cerr << "invalid report from server\n";
+                return -1;
+            }
+        }
+        if (added == 0 && !shm_attached() && shmIn.empty()) {
+            std::cerr << "server closed the connection\n";
+            return -1;
+        }
+        return added;
+    }
+    reportBuffer.compact();
+    ssize_t bytes_read = recv(client_fd, reportBuffer.writePtr(), reportBuffer.writable(), MSG_DONTWAIT);
+    if (bytes_read < 0) return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+    if (bytes_read == 0) {
+        std::cerr << "server closed the connection\n";
+        return -1;
+    }
+    reportBuffer.commit(static_cast<size_t>(bytes_read));
+
+    int added = 0;
+    ExecReport report;
+    if (binaryMode) {
+        size_t consumed = 0;
+        while (true) {
+            DecodeStatus status = decodeExecReport(reportBuffer.readPtr(), reportBuffer.readable(), report, consumed);
+            if (status == DECODE_INCOMPLETE) break;
+            if (status == DECODE_ERROR) {
+                std::cerr << "invalid report from server\n";
+                return -1;
+            }
+            if (status == DECODE_OK) {
+                reports.push_back(report);
+                added++;
+            }
+            reportBuffer.consume(consumed);
+        }
+        return added;
+    }
+
+    while (reportBuffer.readable() > 0) {
+        const char* line = reportBuffer.readPtr();
+        const char* newline = static_cast<const char*>(memchr(line, '\n', reportBuffer.readable()));
+        if (newline == nullptr) break;
+        if (parseTextReport(line, newline, report)) {
+            reports.push_back(report);
+            added++;
+        }
+        reportBuffer.consume(static_cast<size_t>(newline - line) + 1);
+    }
+    return added;
+}
+
 void Client::close_client() {
+    if (shared_memory()) {
+        //active or dropped, either way the server frees the slot once it sees we let go
+        ShmClientControl* control = shm.client(static_cast<size_t>(shmSlot));
+        uint32_t expected = SHM_CLIENT_ACTIVE;
+        if (!control->state.compare_exchange_strong(expected, SHM_CLIENT_CLOSING) && expected == SHM_CLIENT_DROPPED) {
+            control->state.compare_exchange_strong(expected, SHM_CLIENT_CLOSING);
+        }
+        ringDoorbell(client_fd, shm.name(), -1);
+        shm.close();
+        shmSlot = -1;
+    }
     close(client_fd);
 }
\ No newline at end of file
@@ -3,18 +3,34 @@
 #include <vector>
 #include <sstream>
 #include <cstdlib>
+#include <chrono>
+#include <thread>
 #include "client.h"
 #include "orderbook.h" 
 #include "utilities.h"
+#include "symboltable.h"
 
 
-//convert order to string for sending through buffer
-inline std::string orderToString(const Order &o) {
-    std::string side = o.buy ? "buy" : "sell";
-    double price_dollars = o.price / 100.0;
-    std::ostringstream oss;
-    oss << side << " " << o.quantity << " " << price_dollars;
-    return oss.str();
+static const int REPL_REPORT_WAIT_MS = 50;      // how long the REPL waits for reports after each order
+static const int FILE_REPORT_WAIT_MS = 500;     // file mode stops reading reports after this much silence
+static const size_t REPORT_POLL_INTERVAL = 256; // file mode checks for reports every this many orders
+static const size_t DEFAULT_BATCH = 256;        // file mode orders per send() unless --batch says otherwise
+
+
+//sleeps most of the way to `due` and spins the rest, sleeping alone overshoots by tens of microseconds
+inline void waitUntil(std::chrono::steady_clock::time_point due) {
+    auto remaining = due - std::chrono::steady_clock::now();
+    if (remaining > std::chrono::microseconds(200)) std::this_thread::sleep_for(remaining - std::chrono::microseconds(100));
+    while (std::chrono::steady_clock::now() < due) {}
+}
+
+//print execution reports the same way the text protocol sends them
+inline void printReports(const std::vector<ExecReport> &reports) {
+    char line[MAX_TEXT_REPORT_SIZE];
+    for (const auto &r : reports) {
+        size_t len = formatTextReport(line, r);
+        std::cout << "< " << std::string(line, len);
+    }
 }
 
 // Parse an order line from the REPL
@@ -26,31 +42,74 @@ inline bool parseOrderLine(const std::string &line, std::string &cmd) {
 
 int main(int argc, char *argv[]) {
     // Usage:
-    // ./client_main <server_ip> [file_name]
+    // ./client_main <server_ip> [file_name] [--binary] [--symbols list|file] [--read mmap|stream]
     // If file_name is provided, load orders from file and send them
     // If file_name is not provided, run REPL mode
+    // --binary switches the connection to the binary protocol
+    // --symbols is the server's symbol list, binary mode needs it to turn names into ids
+    // --read picks how the file is read: mapped (default) or in chunks
+    // --rate paces file mode to n orders/s (0, the default, sends as fast as the socket takes them)
+    // --batch is the most orders file mode puts in one send()
+    // --shm attaches to the server's shared memory gateway instead of connecting (implies --binary)
 
-    if (argc < 2) {
+    std::vector<std::string> positional;
+    bool binary = false;
+    SymbolTable symbols;
+    OrderFileMode read_mode = ORDER_FILE_MMAP;
+    double rate = 0;
+    size_t batch = DEFAULT_BATCH;
+    std::string shmName;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--binary") binary = true;
+        else if (arg == "--shm" && i + 1 < argc) shmName = argv[++i];
+        else if (arg == "--rate" && i + 1 < argc) rate = std::atof(argv[++i]);
+        else if (arg == "--batch" && i + 1 < argc) batch = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        else if (arg == "--symbols" && i + 1 < argc) symbols.load(argv[++i]);
+        else if (arg == "--read" && i + 1 < argc && OrderFileReader::parseMode(argv[i + 1], read_mode)) ++i;
+        else positional.push_back(arg);
+    }
+
+    if (positional.empty() || positional.size() > 2) {
         std::cerr << "usage:\n"
-                  << argv[0] << " <server_ip> [file_name]\n"
+                  << argv[0] << " <server_ip> [file_name] [--binary] [--symbols list|file] [--read mmap|stream]\n"
+                  << "       [--rate orders_per_sec] [--batch n] [--shm name]\n"
                   << "If file_name is provided, orders are loaded from it.\n"
-                  << "If no file_name is provided, orders are read interactively.\n";
+                  << "If no file_name is provided, orders are read interactively.\n"
+                  << "--binary sends orders in the binary protocol instead of text lines.\n"
+                  << "--symbols must list the symbols in the same order as the server's --symbols.\n"
+                  << "--read stream reads the file in chunks instead of mapping it (for files bigger than memory).\n"
+                  << "--rate sends the file at a steady n orders/s, without it orders go out as fast as possible.\n"
+                  << "--batch caps how many orders share one send() (default " << DEFAULT_BATCH << ", 1 sends each on its own).\n"
+                  << "--shm attaches to server_main --shm name on this host instead of connecting (server_ip is not used,\n"
+                  << "orders are binary).\n";
         return 1;
     }
 
-    std::string server_ip = argv[1];
+    std::string server_ip = positional[0];
     std::string file_name;
 
     Client c(server_ip, 5000);
-    if (c.connect_to_server() != 0) {
+    if (!shmName.empty()) {
+        if (c.attach_shared_memory(shmName) != 0) return 1;
+        binary = true;
+    } else if (c.connect_to_server() != 0) {
         std::cerr << "Could not connect to server at " << server_ip << ":5000\n";
         return 1;
     }
 
-    if (argc == 2) {
-        std::cout << "connected to " << server_ip << ":5000\n"
-                  << "format: buy <quantity> <price>\n"
-                  << "example: buy 100 4.56\n"
+    if (binary && c.send_hello() != 0) {
+        std::cerr << "could not switch to the binary protocol\n";
+        c.close_client();
+        return 1;
+    }
+
+    if (positional.size() == 1) {
+        std::cout << "connected to " << (shmName.empty() ? server_ip + ":5000" : shmName) << "\n"
+                  << "format: buy|sell [limit|ioc|fok|market|post] <quantity> <price> [id] [symbol]\n"
+                  << "        cancel <id> [symbol]\n"
+                  << "        modify <id> <quantity> [price] [symbol]\n"
+                  << "example: buy 100 4.56 42 AAPL\n"
                   << "press ctrl+D (EOF) or enter an empty line to quit.\n";
 
         std::string line;
@@ -59,31 +118,97 @@ int main(int argc, char *argv[]) {
             if (!std::getline(std::cin, line)) break;
             if (line.empty()) break;
 
-            std::string cmd;
-            if (!parseOrderLine(line, cmd)) {
-                std::cerr << "invalid order format, try again...\n";
-                continue;
-            }
+            if (binary) { //binary mode has to understand the line to encode it
+                Order o;
+                if (!parseTextOrder(line, o, &symbols)) {
+                    std::cerr << "invalid order format, try again...\n";
+                    continue;
+                }
+                if (c.send_order(o) != 0) std::cerr << "failed to send order: " << line << "\n";
+            } else {
+                std::string cmd;
+                if (!parseOrderLine(line, cmd)) {
+                    std::cerr << "invalid order format, try again...\n";
+                    continue;
+                }
 
-            if (c.send_order(cmd + "\n") != 0) {
-                std::cerr << "failed to send order: " << cmd << "\n";
+                if (c.send_order(cmd + "\n") != 0) {
+                    std::cerr << "failed to send order: " << cmd << "\n";
+                }
             }
+
+            //show whatever the server reports back for it
+            std::vector<ExecReport> reports;
+            while (c.poll_reports(reports, REPL_REPORT_WAIT_MS) > 0) {}
+            printReports(reports);
         }
 
-    } else if (argc == 3) {
-        file_name = argv[2];
-        std::vector<Order> orders;
-        if (!loadOrdersFromFile(file_name, orders)) {
-            std::cerr << "failed to load orders from " << file_name << "\n";
+    } else {
+        file_name = positional[1];
+        OrderFileReader orders; //sent as they are read, sending starts without loading the file
+        if (orders.open(file_name, read_mode) != 0) {
+            std::cerr << "failed to open orders file " << file_name << "\n";
             c.close_client();
             return 1;
         }
+        if (symbols.size() == 0) { //captures carry the symbol names their ids stand for
+            for (const std::string &name : orders.symbols()) symbols.add(name);
+        }
+
+        //reports are read while sending, otherwise the server stops taking orders once ours pile up
+        std::vector<ExecReport> reports;
+        long long counts[EXEC_REJECTED + 1] = {0};
+        auto tally = [&]() {
+            for (const auto &r : reports) counts[r.type <= EXEC_REJECTED ? r.type : 0]++;
+            reports.clear();
+        };
 
-        for (const auto &o : orders) {
-            std::string cmd = orderToString(o);
-            if (c.send_order(cmd + "\n") != 0) std::cerr << "failed to send order: " << cmd << "\n";
+        //orders are encoded into the client's batch and go out together once `batch` are queued. with a
+        //rate, order n is due at start + n / rate: whatever is queued goes out before waiting for it
+        const SymbolTable* names = symbols.size() ? &symbols : nullptr;
+        auto start = std::chrono::steady_clock::now();
+        double maxLagMs = 0; //how far behind schedule a paced run got
+        size_t sent = 0;
+        bool ok = true;
+        Order o;
+        while (ok && orders.next(o)) {
+            if (rate > 0) {
+                auto due = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(sent / rate));
+                auto now = std::chrono::steady_clock::now();
+                if (now < due) {
+                    if (c.queued_orders() > 0 && c.flush_orders(reports) != 0) ok = false;
+                    waitUntil(due);
+                } else {
+                    maxLagMs = std::max(maxLagMs, std::chrono::duration<double, std::milli>(now - due).count());
+                }
+            }
+            if (!c.queue_order(o, names)) { //batch buffer full
+                if (c.flush_orders(reports) != 0) ok = false;
+                c.queue_order(o, names);
+            }
+            if (c.queued_orders() >= batch && c.flush_orders(reports) != 0) ok = false;
+            if (++sent % REPORT_POLL_INTERVAL == 0 && c.poll_reports(reports, 0) > 0) tally();
         }
-        std::cout << "finished sending " << orders.size() << " orders from file " << file_name << "\n";
+        if (ok && c.queued_orders() > 0 && c.flush_orders(reports) != 0) ok = false;
+        if (!ok) std::cerr << "sending stopped after " << c.orders_sent() << " orders\n";
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << "finished sending " << c.orders_sent() << " orders from file " << file_name << "\n";
+        char line[256];
+        snprintf(line, sizeof(line), "sent in %.3f s: %.0f orders/s (target %s), %.1f MB/s, %llu send() calls, %.1f orders per call",
+                 seconds, seconds > 0 ? c.orders_sent() / seconds : 0.0, rate > 0 ? std::to_string(static_cast<long long>(rate)).c_str() : "max",
+                 seconds > 0 ? c.bytes_sent() / seconds / 1e6 : 0.0, static_cast<unsigned long long>(c.send_calls()),
+                 c.send_calls() ? static_cast<double>(c.orders_sent()) / c.send_calls() : 0.0);
+        std::cout << line;
+        if (rate > 0) std::cout << ", fell behind by up to " << maxLagMs << " ms";
+        std::cout << "\n";
+
+        //collect the stragglers until the server goes quiet
+        while (c.poll_reports(reports, FILE_REPORT_WAIT_MS) > 0) tally();
+        tally();
+        std::cout << "reports: " << counts[EXEC_ACCEPTED] << " accepted, " << counts[EXEC_FILL] << " fills, "
+                  << counts[EXEC_CANCELLED] << " cancelled, " << counts[EXEC_MODIFIED] << " modified, "
+                  << counts[EXEC_REJECTED] << " rejected\n";
     }
 
     c.close_client();
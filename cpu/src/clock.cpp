@@ -0,0 +1,34 @@
+#include "clock.h"
+#include <thread>
+
+
+double clockNanosPerTick = 1.0;
+
+
+
+void calibrateClock(int calibration_ms) {
+#ifdef ORDERBOOK_CLOCK_IS_TSC
+    //sleep rather than spin so a pinned or single cpu box isn't held up, the long window keeps
+    //the wakeup jitter well under a percent
+    auto wallStart = std::chrono::steady_clock::now();
+    uint64_t tickStart = clockNowOrdered();
+    std::this_thread::sleep_for(std::chrono::milliseconds(calibration_ms));
+    uint64_t tickEnd = clockNowOrdered();
+    auto wallEnd = std::chrono::steady_clock::now();
+
+    double nanos = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(wallEnd - wallStart).count());
+    if (tickEnd > tickStart) clockNanosPerTick = nanos / static_cast<double>(tickEnd - tickStart);
+#else
+    (void)calibration_ms;
+#endif
+}
+
+
+
+const char* clockSourceName() {
+#ifdef ORDERBOOK_CLOCK_IS_TSC
+    return "tsc";
+#else
+    return "steady_clock";
+#endif
+}
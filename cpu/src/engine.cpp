@@ -0,0 +1,261 @@
+#include "engine.h"
+#include "journal.h"
+#include "threadconfig.h"
+#include <fstream>
+#include <iostream>
+#include <cerrno>
+
+
+MatchingEngine::~MatchingEngine() {
+    stop();
+}
+
+
+
+int MatchingEngine::initialize(const SymbolTable &symbol_table, size_t worker_count, ChannelMode mode,
+                               size_t queue_capacity, size_t pool_capacity, int ladder_window, const std::string &log_prefix) {
+    if (symbol_table.size() == 0 || worker_count == 0) {
+        std::cerr << "matching engine needs at least one symbol and one worker\n";
+        return 1;
+    }
+    if (worker_count > symbol_table.size()) worker_count = symbol_table.size(); //extra workers would never get an order
+
+    symbols = &symbol_table;
+    poolCapacity = pool_capacity;
+    ladderWindow = ladder_window;
+    logPrefix = log_prefix;
+
+    books.clear();
+    books.resize(symbol_table.size());
+
+    workers.clear();
+    for (size_t i = 0; i < worker_count; ++i) {
+        std::unique_ptr<Worker> worker(new Worker());
+        if (worker->inbound.initialize(mode, queue_capacity) != 0) {
+            std::cerr << "could not initialize order channel of worker " << i << "\n";
+            return 1;
+        }
+        workers.push_back(std::move(worker));
+    }
+    return 0;
+}
+
+
+
+void MatchingEngine::startTraceLogger() {
+    if (logPrefix.empty() || traceLogger) return;
+    traceLogger.reset(new AsyncLogger());
+    traceLogger->initialize(workers.size(), TRACE_RING_CAPACITY, books.size(), tracePolicy);
+    ThreadPlacement placement;
+    placement.cpu = loggerCpu;
+    traceLogger->setPlacement("trace-logger", placement, runtimeStatus);
+    traceLogger->start();
+}
+
+
+
+size_t MatchingEngine::recover(const Recovery &recovered) {
+    startTraceLogger(); //so the rebuilt books trace through it like the ones built later
+    //this thread stands in for each book's worker until start(), the thread launch hands the books over
+    recovered.replay([this](uint32_t symbol) { return bookFor(symbol, workerFor(symbol)); },
+                     [this](uint32_t symbol, OrderBook &book) {
+                         book.clearEvents();
+                         if (marketData != nullptr && !book.levelDeltas().empty()) {
+                             marketData->post_levels(workerFor(symbol), symbol, book.levelDeltas());
+                             book.clearLevelDeltas();
+                         }
+                     });
+    size_t resting = 0;
+    for (const auto &book : books) {
+        if (book) resting += book->restingOrders();
+    }
+    return resting;
+}
+
+
+
+void MatchingEngine::start(const std::vector<int> &cpus) {
+    startTraceLogger();
+    for (size_t i = 0; i < workers.size(); ++i) {
+        int cpu = (i < cpus.size()) ? cpus[i] : -1;
+        workers[i]->thread = std::thread(&MatchingEngine::run, this, i, cpu);
+    }
+}
+
+
+
+OrderBook* MatchingEngine::bookFor(uint32_t symbol, size_t worker) {
+    std::unique_ptr<OrderBook> &slot = books[symbol];
+    if (slot) return slot.get();
+
+    std::string log_file = logPrefix.empty() ? std::string() : logPrefix + "_" + symbols->name(symbol) + ".bin";
+    std::unique_ptr<OrderBook> book(new OrderBook(log_file, poolCapacity, ladderWindow));
+    book->setTraceSampling(traceEvery);
+    book->setHugePages(hugePages);
+    if (traceLogger) book->attachLogger(traceLogger.get(), worker);
+    if (book->initialize() != 0) {
+        std::cerr << "could not initialize order book for " << symbols->name(symbol) << "\n";
+        return nullptr;
+    }
+    book->enableEvents(sink != nullptr);
+    book->enableLevelDeltas(marketData != nullptr);
+    slot = std::move(book);
+    return slot.get();
+}
+
+
+
+void MatchingEngine::run(size_t index, int cpu) {
+    Worker &worker = *workers[index];
+    ThreadPlacement placement;
+    placement.cpu = cpu;
+    placement.fifoPriority = fifoPriority;
+    placeCurrentThread("match-" + std::to_string(index), placement, runtimeStatus);
+
+    if (prefaultBooks) { //first touch from this thread, so the pages also land on its numa node
+        size_t bytes = 0, built = 0;
+        bool ok = true;
+        for (uint32_t symbol = 0; symbol < books.size(); ++symbol) {
+            if (workerFor(symbol) != index) continue;
+            OrderBook* book = bookFor(symbol, index);
+            if (book == nullptr) {
+                ok = false;
+                continue;
+            }
+            bytes += book->prefault();
+            built++;
+        }
+        std::string line = "match-" + std::to_string(index) + " prefaulted " + std::to_string(bytes >> 20) + " MB over " +
+                           std::to_string(built) + " book(s)";
+        std::cout << line << "\n";
+        if (runtimeStatus) runtimeStatus->record(line, ok ? 0 : ENOMEM);
+    }
+
+    std::vector<BookEvent> rejected; //for orders whose book could not be built
+    Order o;
+    while (worker.inbound.pop(o)) { //doesn't stop processing orders until the channel is drained
+        if (o.recvTime != 0) o.dequeuedAt = tickOffset(o.recvTime, clockNow());
+        OrderBook* book = bookFor(o.symbol, index);
+        if (book == nullptr) {
+            if (sink != nullptr) {
+                rejected.assign(1, BookEvent{0, o.id, 0, o.session, 0, o.price, o.quantity, EXEC_REJECTED, o.buy});
+                sink->post_events(index, rejected);
+            }
+            continue;
+        }
+
+        book->process(o);
+        worker.ordersProcessed++;
+        if (o.recvTime != 0) recordStages(worker, o, clockNowOrdered());
+        if (sink != nullptr) {
+            sink->post_events(index, book->events()); //fills and acks go back to the sessions that own the orders
+            book->clearEvents();
+        }
+        if (marketData != nullptr && !book->levelDeltas().empty()) {
+            marketData->post_levels(index, o.symbol, book->levelDeltas());
+            book->clearLevelDeltas();
+        }
+    }
+    std::cout << "matching worker " << index << " exited\n";
+}
+
+
+
+//offsets taken on different cores can be a few ticks out of order, never report that as a huge span
+static inline uint64_t span(uint32_t from, uint32_t to) {
+    return (to > from) ? to - from : 0;
+}
+
+
+
+void MatchingEngine::recordStages(Worker &worker, const Order &order, uint64_t matched) {
+    uint32_t done = tickOffset(order.recvTime, matched);
+    worker.stages[STAGE_PARSE].record(ticksToNanos(order.parsedAt));
+    worker.stages[STAGE_SUBMIT].record(ticksToNanos(span(order.parsedAt, order.enqueuedAt)));
+    worker.stages[STAGE_QUEUE].record(ticksToNanos(span(order.enqueuedAt, order.dequeuedAt)));
+    worker.stages[STAGE_MATCH].record(ticksToNanos(span(order.dequeuedAt, done)));
+    worker.stages[STAGE_WIRE_TO_MATCH].record(ticksToNanos(done));
+}
+
+
+
+void MatchingEngine::stop() {
+    for (auto &worker : workers) worker->inbound.stop(); //wake everyone first so they drain in parallel
+    for (auto &worker : workers) {
+        if (worker->thread.joinable()) worker->thread.join();
+    }
+    for (auto &book : books) {
+        if (book) book->finalize_log();
+    }
+    if (traceLogger) traceLogger->stop(); //workers are gone, so the rings only get drained now
+}
+
+
+
+long long MatchingEngine::totalOrdersProcessed() const {
+    long long total = 0;
+    for (const auto &worker : workers) total += worker->ordersProcessed;
+    return total;
+}
+
+
+
+void MatchingEngine::writeReport(const std::string &report_filename) {
+    std::ofstream reportFile(report_filename, std::ios::out);
+    if (!reportFile) {
+        std::cerr << "could not open report file " << report_filename << "\n";
+        return;
+    }
+
+    size_t active = 0;
+    LatencyHistogram all;
+    for (const auto &book : books) {
+        if (!book) continue;
+        active++;
+        all.merge(book->latencies());
+    }
+
+    reportFile << "Matching Engine Report\n";
+    reportFile << "-----------------------\n";
+    reportFile << "Workers: " << workers.size() << "\n";
+    reportFile << "Symbols: " << books.size() << " (" << active << " active)\n";
+    reportFile << "Total Orders Processed: " << totalOrdersProcessed() << "\n";
+    for (size_t i = 0; i < workers.size(); ++i) {
+        reportFile << "Worker " << i << " Orders Processed: " << workers[i]->ordersProcessed << "\n";
+    }
+    all.writeSummary(reportFile);
+    if (traceLogger) {
+        reportFile << "Latency Trace: " << traceLogger->written() << " samples written, " << traceLogger->dropped()
+                   << " dropped (" << (traceLogger->fullPolicy() == LOG_DROP ? "drop" : "block") << " when full), "
+                   << traceLogger->writes() << " write calls, " << traceLogger->errors() << " errors\n";
+    }
+
+    if (runtimeStatus) {
+        reportFile << "\nRuntime Setup (" << runtimeStatus->failures() << " failed)\n";
+        reportFile << "-----------------------\n";
+        runtimeStatus->write(reportFile);
+    }
+
+    LatencyHistogram stages[STAGE_COUNT];
+    for (const auto &worker : workers) {
+        for (int s = 0; s < STAGE_COUNT; ++s) stages[s].merge(worker->stages[s]);
+    }
+    if (stages[STAGE_WIRE_TO_MATCH].count() > 0) {
+        reportFile << "\nPipeline (" << clockSourceName() << ", " << clockNanosPerTick << " ns/tick, "
+                   << stages[STAGE_WIRE_TO_MATCH].count() << " orders)\n";
+        reportFile << "-----------------------\n";
+        stages[STAGE_PARSE].writeLine(reportFile, "Recv To Parsed");
+        stages[STAGE_SUBMIT].writeLine(reportFile, "Parsed To Enqueued");
+        stages[STAGE_QUEUE].writeLine(reportFile, "Queue Wait");
+        stages[STAGE_MATCH].writeLine(reportFile, "Dequeued To Matched");
+        stages[STAGE_WIRE_TO_MATCH].writeLine(reportFile, "Wire To Match");
+    }
+
+    for (uint32_t symbol = 0; symbol < books.size(); ++symbol) {
+        if (!books[symbol]) continue;
+        reportFile << "\n" << symbols->name(symbol) << " (worker " << workerFor(symbol) << ")\n";
+        reportFile << "-----------------------\n";
+        books[symbol]->writeReport(reportFile);
+    }
+    reportFile.close();
+}
@@ -0,0 +1,814 @@
+#include "journal.h"
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+//multiply/xorshift over 8 byte words. not cryptographic, it only has to catch torn and garbage writes.
+//four independent lanes so a snapshot of a few hundred MB is checked at memory speed, not at the
+//latency of one multiply chain
+static inline uint64_t mixWord(uint64_t h, uint64_t w) {
+    h = (h ^ w) * 0x100000001B3ULL;
+    return h ^ (h >> 29);
+}
+
+static uint64_t checksum(const void* data, size_t bytes) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    uint64_t lanes[4] = {0x9E3779B97F4A7C15ULL ^ bytes, 0xC2B2AE3D27D4EB4FULL, 0x165667B19E3779F9ULL, 0x27D4EB2F165667C5ULL};
+    size_t i = 0;
+    for (; i + 32 <= bytes; i += 32) {
+        uint64_t w[4];
+        std::memcpy(w, p + i, sizeof(w));
+        for (int l = 0; l < 4; ++l) lanes[l] = mixWord(lanes[l], w[l]);
+    }
+    uint64_t h = mixWord(mixWord(mixWord(lanes[0], lanes[1]), lanes[2]), lanes[3]);
+    for (; i + 8 <= bytes; i += 8) {
+        uint64_t w;
+        std::memcpy(&w, p + i, 8);
+        h = mixWord(h, w);
+    }
+    uint64_t w = 0;
+    std::memcpy(&w, p + i, bytes - i);
+    h = mixWord(h, w);
+    return h ^ (h >> 32);
+}
+
+static inline uint32_t recordCheck(const JournalRecord &r) {
+    return static_cast<uint32_t>(checksum(&r, offsetof(JournalRecord, check)));
+}
+
+
+
+//symbol names as they go in file headers, one per line in id order and padded to 8 bytes
+static std::vector<char> symbolNames(const SymbolTable &symbols) {
+    std::vector<char> block;
+    for (uint32_t i = 0; i < symbols.size(); ++i) {
+        block.insert(block.end(), symbols.name(i).begin(), symbols.name(i).end());
+        block.push_back('\n');
+    }
+    block.resize((block.size() + 7) / 8 * 8, '\0');
+    return block;
+}
+
+
+
+static size_t readFully(int fd, void* buffer, size_t bytes) {
+    size_t done = 0;
+    while (done < bytes) {
+        ssize_t n = read(fd, static_cast<char*>(buffer) + done, bytes - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += static_cast<size_t>(n);
+    }
+    return done;
+}
+
+static bool writeFully(int fd, const void* buffer, size_t bytes) {
+    size_t done = 0;
+    while (done < bytes) {
+        ssize_t n = write(fd, static_cast<const char*>(buffer) + done, bytes - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+//a new or renamed file is only there after a crash once its directory entry is on disk too
+static void syncDirectory(const std::string &dir) {
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return;
+    fsync(fd);
+    close(fd);
+}
+
+
+
+static std::string fileName(const std::string &dir, const char* prefix, uint64_t seq, const char* suffix) {
+    char name[64];
+    snprintf(name, sizeof(name), "%s%020" PRIu64 "%s", prefix, seq, suffix);
+    return dir + "/" + name;
+}
+
+//(seq, path) of the snapshots and journal segments in dir, oldest first. false if dir can't be read
+static bool listJournalDir(const std::string &dir, std::vector<std::pair<uint64_t, std::string>> &snapshots,
+                           std::vector<std::pair<uint64_t, std::string>> &segments) {
+    DIR* d = opendir(dir.c_str());
+    if (d == nullptr) return false;
+    while (dirent* entry = readdir(d)) {
+        std::string name = entry->d_name;
+        auto seqOf = [&](const std::string &prefix, const std::string &suffix, uint64_t &seq) {
+            if (name.size() != prefix.size() + 20 + suffix.size() || name.compare(0, prefix.size(), prefix) != 0 ||
+                name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) return false;
+            std::string digits = name.substr(prefix.size(), 20);
+            if (digits.find_first_not_of("0123456789") != std::string::npos) return false;
+            seq = std::strtoull(digits.c_str(), nullptr, 10);
+            return true;
+        };
+        uint64_t seq;
+        if (seqOf("snapshot-", ".snap", seq)) snapshots.emplace_back(seq, dir + "/" + name);
+        else if (seqOf("journal-", ".log", seq)) segments.emplace_back(seq, dir + "/" + name);
+    }
+    closedir(d);
+    std::sort(snapshots.begin(), snapshots.end());
+    std::sort(segments.begin(), segments.end());
+    return true;
+}
+
+
+
+bool parseJournalSync(const std::string &spec, JournalSync &sync, int &interval_ms) {
+    if (spec == "none") sync = JOURNAL_SYNC_NONE;
+    else if (spec == "batch") sync = JOURNAL_SYNC_BATCH;
+    else {
+        try {
+            interval_ms = std::stoi(spec);
+        } catch (const std::exception &e) {
+            return false;
+        }
+        if (interval_ms <= 0) return false;
+        sync = JOURNAL_SYNC_INTERVAL;
+    }
+    return true;
+}
+
+
+
+void Recovery::unmap() {
+    if (mapped != nullptr) munmap(const_cast<uint8_t*>(mapped), mappedSize);
+    mapped = nullptr;
+    mappedSize = 0;
+}
+
+
+
+//0 if the snapshot is good, 1 if it is damaged (an older one may do), 2 if it was written for other symbols
+int Recovery::readSnapshot(const std::string &path, const SymbolTable &symbols) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 1;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(SnapshotHeader) + sizeof(SnapshotTrailer)) {
+        close(fd);
+        return 1;
+    }
+    //mapped rather than read: the orders are used where they are, straight from the page cache
+    size_t size = static_cast<size_t>(st.st_size);
+    unmap();
+    void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return 1;
+    mapped = static_cast<const uint8_t*>(p);
+    mappedSize = size;
+    madvise(p, size, MADV_SEQUENTIAL);
+    const uint8_t* bytes = mapped;
+
+    SnapshotTrailer trailer;
+    std::memcpy(&trailer, bytes + size - sizeof(trailer), sizeof(trailer));
+    if (trailer.bytes != size || trailer.check != checksum(bytes, size - sizeof(trailer))) return 1;
+
+    SnapshotHeader header;
+    std::memcpy(&header, bytes, sizeof(header));
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 || header.version != JOURNAL_VERSION ||
+        header.orderSize != sizeof(SnapshotOrder)) return 1;
+    std::vector<char> names = symbolNames(symbols);
+    if (header.symbolBytes != names.size() || sizeof(header) + names.size() > size - sizeof(trailer) ||
+        std::memcmp(bytes + sizeof(header), names.data(), names.size()) != 0) return 2;
+
+    //everything is a multiple of 8 bytes, so the books and orders are aligned in the mapping
+    books.clear();
+    size_t off = sizeof(header) + names.size();
+    size_t end = size - sizeof(trailer);
+    for (uint32_t i = 0; i < header.books; ++i) {
+        SnapshotBook book;
+        if (off + sizeof(book) > end) return 1;
+        std::memcpy(&book, bytes + off, sizeof(book));
+        off += sizeof(book);
+        if (book.symbol >= symbols.size() || book.orders > (end - off) / sizeof(SnapshotOrder)) return 1;
+        books.push_back(Book{book.symbol, book.eventSeq, reinterpret_cast<const SnapshotOrder*>(bytes + off),
+                             static_cast<size_t>(book.orders)});
+        off += book.orders * sizeof(SnapshotOrder);
+    }
+    if (off != end) return 1;
+
+    snapshotFile = path;
+    snapshotSeq = lastSeq = header.seq;
+    highestOrderId = header.highestOrderId;
+    lastSession = header.lastSession;
+    restingOrders = static_cast<size_t>(header.orders);
+    return 0;
+}
+
+
+
+//same codes as readSnapshot(). a damaged record ends the journal (cutSegment) but keeps what came before it
+int Recovery::readSegment(const std::string &path, const SymbolTable &symbols, uint64_t after) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "could not open journal " << path << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    JournalFileHeader header;
+    std::vector<char> names = symbolNames(symbols);
+    std::vector<char> stored(names.size());
+    if (readFully(fd, &header, sizeof(header)) != sizeof(header) ||
+        std::memcmp(header.magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 || header.version != JOURNAL_VERSION ||
+        header.recordSize != sizeof(JournalRecord)) {
+        close(fd);
+        return 1;
+    }
+    if (header.symbolBytes != names.size() || readFully(fd, stored.data(), stored.size()) != stored.size() ||
+        stored != names) {
+        close(fd);
+        return 2;
+    }
+    segments++;
+
+    //seqs only go up within a segment and never skip backwards, so the record for seq `after` + 1 is at
+    //most that many records in. a binary search over the records up to there skips what the snapshot
+    //already has without reading it. a probe that doesn't check out falls back to reading it all
+    off_t first = static_cast<off_t>(sizeof(header) + names.size());
+    off_t at = first;
+    struct stat st;
+    if (after >= header.firstSeq && fstat(fd, &st) == 0 && st.st_size > first) {
+        uint64_t records = (static_cast<uint64_t>(st.st_size) - first) / sizeof(JournalRecord);
+        uint64_t lo = 0, hi = std::min<uint64_t>(records, after - header.firstSeq + 1);
+        while (lo < hi) {
+            uint64_t mid = lo + (hi - lo) / 2;
+            JournalRecord r;
+            if (pread(fd, &r, sizeof(r), first + static_cast<off_t>(mid * sizeof(r))) != sizeof(r) || r.check != recordCheck(r)) {
+                lo = 0;
+                break;
+            }
+            if (r.seq <= after) lo = mid + 1;
+            else hi = mid;
+        }
+        at = first + static_cast<off_t>(lo * sizeof(JournalRecord));
+        lseek(fd, at, SEEK_SET);
+    }
+
+    static const size_t CHUNK_RECORDS = 1 << 16;
+    std::vector<JournalRecord> chunk(CHUNK_RECORDS);
+    while (true) {
+        size_t bytes = readFully(fd, chunk.data(), chunk.size() * sizeof(JournalRecord));
+        size_t records = bytes / sizeof(JournalRecord);
+        for (size_t i = 0; i < records; ++i) {
+            const JournalRecord &r = chunk[i];
+            if (r.check != recordCheck(r)) {
+                damagedRecords++;
+                cutSegment = path;
+                cutOffset = static_cast<uint64_t>(at) + i * sizeof(JournalRecord);
+                std::cerr << "journal " << path << " has a damaged record after seq " << lastSeq << ", recovery stops there\n";
+                close(fd);
+                return 0;
+            }
+            if (r.seq <= after || r.seq <= lastSeq) continue; //in the snapshot already
+            Order o;
+            o.id = r.id;
+            o.seq = r.seq;
+            o.session = r.session;
+            o.symbol = r.symbol;
+            o.price = r.price;
+            o.quantity = r.quantity;
+            o.buy = r.buy != 0;
+            o.action = r.action;
+            o.type = r.type;
+            tail.push_back(o);
+            lastSeq = r.seq;
+            if (r.action == ORDER_NEW) highestOrderId = std::max(highestOrderId, r.id);
+            lastSession = std::max(lastSession, r.session);
+        }
+        if (bytes % sizeof(JournalRecord) != 0) { //the write a crash cut short
+            damagedRecords++;
+            cutSegment = path;
+            cutOffset = static_cast<uint64_t>(at) + records * sizeof(JournalRecord);
+            std::cerr << "journal " << path << " ends in a partial record after seq " << lastSeq << "\n";
+        }
+        if (bytes < chunk.size() * sizeof(JournalRecord)) break;
+        at += static_cast<off_t>(bytes);
+    }
+    close(fd);
+    return 0;
+}
+
+
+
+int Recovery::load(const std::string &dir, const SymbolTable &symbols) {
+    std::vector<std::pair<uint64_t, std::string>> snapshots, journals;
+    if (!listJournalDir(dir, snapshots, journals)) return 0; //no directory yet
+
+    //newest snapshot first, a damaged one (a crash while it was written, a bad disk) falls back to the one before
+    for (auto it = snapshots.rbegin(); it != snapshots.rend(); ++it) {
+        int status = readSnapshot(it->second, symbols);
+        if (status == 0) break;
+        if (status == 2) {
+            std::cerr << "snapshot " << it->second << " was written for a different symbol list\n";
+            return 1;
+        }
+        std::cerr << "snapshot " << it->second << " is damaged, trying an older one\n";
+    }
+    if (snapshotFile.empty()) {
+        unmap();
+        books.clear();
+    }
+
+    for (size_t i = 0; i < journals.size(); ++i) {
+        //everything in a segment comes before the next segment's first seq
+        if (i + 1 < journals.size() && journals[i + 1].first <= snapshotSeq + 1) continue;
+        int status = readSegment(journals[i].second, symbols, snapshotSeq);
+        if (status == 2) {
+            std::cerr << "journal " << journals[i].second << " was written for a different symbol list\n";
+            return 1;
+        }
+        if (status == 1) {
+            damagedRecords++;
+            std::cerr << "journal " << journals[i].second << " has no usable header, recovery stops there\n";
+            unusedSegments.push_back(journals[i].second);
+        }
+        if (status == 1 || !cutSegment.empty()) {
+            for (size_t j = i + 1; j < journals.size(); ++j) unusedSegments.push_back(journals[j].second);
+            break;
+        }
+    }
+    return 0;
+}
+
+
+
+void Recovery::replay(const std::function<OrderBook*(uint32_t)> &book_for,
+                      const std::function<void(uint32_t, OrderBook&)> &after) const {
+    static const size_t INSERT_BATCH = 4096;
+    static const size_t PREFETCH_AHEAD = 16; //index slots in flight, enough to cover a cache miss
+    for (const Book &b : books) {
+        OrderBook* book = book_for(b.symbol);
+        if (book == nullptr) continue;
+        book->setEventSequence(b.eventSeq);
+        //the orders come best level first and in fifo order, so plain inserts rebuild every queue as it was
+        Order o;
+        o.seq = 0;
+        o.symbol = b.symbol;
+        o.action = ORDER_NEW;
+        for (size_t i = 0; i < b.count; ++i) {
+            if (i + PREFETCH_AHEAD < b.count) book->prefetchInsert(b.orders[i + PREFETCH_AHEAD].id, b.orders[i + PREFETCH_AHEAD].session);
+            const SnapshotOrder &s = b.orders[i];
+            o.id = s.id;
+            o.session = s.session;
+            o.price = s.price;
+            o.quantity = s.quantity;
+            o.buy = s.buy != 0;
+            o.type = s.type;
+            book->insert(o);
+            if ((i + 1) % INSERT_BATCH == 0) after(b.symbol, *book);
+        }
+        after(b.symbol, *book);
+    }
+    for (const Order &message : tail) {
+        OrderBook* book = book_for(message.symbol);
+        if (book == nullptr) continue;
+        Order o = message;
+        book->process(o);
+        after(o.symbol, *book);
+    }
+}
+
+
+
+Journal::~Journal() {
+    stop();
+    if (lockFd >= 0) close(lockFd);
+}
+
+
+
+int Journal::initialize(const std::string &journal_dir, const SymbolTable &symbol_table, size_t pool_capacity,
+                        int ladder_window, JournalSync sync, int sync_interval_ms, int snapshot_ms, size_t ring_capacity) {
+    dir = journal_dir;
+    if (mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST) {
+        std::cerr << "could not create journal directory " << dir << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    if (lockFd >= 0) close(lockFd);
+    lockFd = open((dir + "/lock").c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+    if (lockFd < 0 || flock(lockFd, LOCK_EX | LOCK_NB) < 0) {
+        std::cerr << "could not lock journal directory " << dir << ": "
+                  << (errno == EWOULDBLOCK ? "another server is using it" : strerror(errno)) << "\n";
+        return 1;
+    }
+
+    symbols = &symbol_table;
+    symbolBlock = symbolNames(symbol_table);
+    poolCapacity = pool_capacity;
+    ladderWindow = ladder_window;
+    syncPolicy = sync;
+    syncInterval = std::chrono::milliseconds(sync_interval_ms);
+    snapshotInterval = std::chrono::milliseconds(snapshot_ms > 0 ? snapshot_ms : 0);
+    inbound.initialize(ring_capacity);
+    applied.initialize(ring_capacity);
+    batch.reserve(MAX_BATCH);
+    books.clear();
+    books.resize(symbol_table.size());
+    return 0;
+}
+
+
+
+void Journal::start(const std::shared_ptr<const Recovery> &from) {
+    if (running) return;
+    //the writer goes on from the last recovered seq, so nothing recovery didn't take may stay in its way
+    if (from) {
+        if (!from->cutSegment.empty() && truncate(from->cutSegment.c_str(), static_cast<off_t>(from->cutOffset)) < 0) {
+            std::cerr << "could not cut journal " << from->cutSegment << " back: " << strerror(errno) << "\n";
+        }
+        for (const std::string &path : from->unusedSegments) {
+            if (rename(path.c_str(), (path + ".unused").c_str()) < 0) {
+                std::cerr << "could not set journal " << path << " aside: " << strerror(errno) << "\n";
+            } else {
+                std::cerr << "journal " << path << " comes after the damage, renamed to " << path << ".unused\n";
+            }
+        }
+        if (!from->cutSegment.empty() || !from->unusedSegments.empty()) syncDirectory(dir);
+    }
+    recovered = from;
+    writerStop.store(false);
+    snapshotStop.store(false);
+    ioStop = false;
+    running = true;
+    writerThread = std::thread(&Journal::runWriter, this);
+    snapshotThread = std::thread(&Journal::runSnapshots, this);
+    snapshotIoThread = std::thread(&Journal::runSnapshotWrites, this);
+}
+
+
+
+void Journal::stop() {
+    if (!running) return;
+    writerStop.store(true);
+    if (writerThread.joinable()) writerThread.join();
+    snapshotStop.store(true); //only now, so it sees every record the writer passed on
+    if (snapshotThread.joinable()) snapshotThread.join();
+    {
+        std::lock_guard<std::mutex> lock(ioMutex);
+        ioStop = true; //after the last image was handed over, the i/o thread writes it before it exits
+    }
+    ioWake.notify_all();
+    if (snapshotIoThread.joinable()) snapshotIoThread.join();
+    running = false;
+}
+
+
+
+bool Journal::openSegment(uint64_t first_seq) {
+    std::string path = fileName(dir, "journal-", first_seq, ".log");
+    //a segment with this name can only hold records recovery didn't take, so it starts over
+    segmentFd = open(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, 0644);
+    if (segmentFd < 0) {
+        if (writeErrors++ == 0) std::cerr << "could not create journal " << path << ": " << strerror(errno) << "\n";
+        return false;
+    }
+    JournalFileHeader header;
+    std::memcpy(header.magic, JOURNAL_MAGIC, sizeof(header.magic));
+    header.version = JOURNAL_VERSION;
+    header.recordSize = sizeof(JournalRecord);
+    header.symbolBytes = static_cast<uint32_t>(symbolBlock.size());
+    header.firstSeq = first_seq;
+    if (!writeFully(segmentFd, &header, sizeof(header)) || !writeFully(segmentFd, symbolBlock.data(), symbolBlock.size())) {
+        if (writeErrors++ == 0) std::cerr << "could not write journal " << path << ": " << strerror(errno) << "\n";
+        close(segmentFd);
+        segmentFd = -1;
+        return false;
+    }
+    if (syncPolicy != JOURNAL_SYNC_NONE) syncDirectory(dir);
+    segmentBytes = sizeof(header) + symbolBlock.size();
+    segmentsOpened++;
+    return true;
+}
+
+
+
+void Journal::closeSegment() {
+    if (segmentFd < 0) return;
+    if (syncPending) sync();
+    close(segmentFd);
+    segmentFd = -1;
+}
+
+
+
+void Journal::sync() {
+    syncPending = false;
+    lastSync = std::chrono::steady_clock::now();
+    if (syncPolicy == JOURNAL_SYNC_NONE || segmentFd < 0) return;
+    if (fdatasync(segmentFd) < 0) {
+        if (writeErrors++ == 0) std::cerr << "could not sync journal in " << dir << ": " << strerror(errno) << "\n";
+        return;
+    }
+    syncs++;
+}
+
+
+
+size_t Journal::writeBatch() {
+    batch.clear();
+    JournalRecord r;
+    while (batch.size() < MAX_BATCH && inbound.tryPop(r)) {
+        r.check = recordCheck(r);
+        batch.push_back(r);
+    }
+    if (batch.empty()) return 0;
+
+    if (segmentFd >= 0 && segmentBytes >= SEGMENT_BYTES) closeSegment();
+    if (segmentFd >= 0 || openSegment(batch.front().seq)) {
+        size_t bytes = batch.size() * sizeof(JournalRecord);
+        if (writeFully(segmentFd, batch.data(), bytes)) {
+            segmentBytes += bytes;
+            recordsWritten += batch.size();
+            syncPending = true;
+        } else if (writeErrors++ == 0) {
+            std::cerr << "could not write journal in " << dir << ": " << strerror(errno) << "\n";
+        }
+    }
+    batches++;
+    largestBatch = std::max<uint64_t>(largestBatch, batch.size());
+
+    //the snapshot copies follow the books whether or not the write went through, they are what matching did
+    for (const JournalRecord &record : batch) {
+        for (int spins = 0; !applied.tryPush(record); ++spins) {
+            if (spins < SPINS_BEFORE_YIELD) cpuRelax();
+            else std::this_thread::yield();
+        }
+    }
+    return batch.size();
+}
+
+
+
+void Journal::runWriter() {
+    placeCurrentThread("journal-writer", placement, runtimeStatus);
+    lastSync = std::chrono::steady_clock::now();
+    while (!writerStop.load(std::memory_order_acquire)) {
+        //whatever piled up while the last write and sync ran goes out as one group
+        size_t written = writeBatch();
+        if (syncPending && (syncPolicy == JOURNAL_SYNC_BATCH ||
+                            (syncPolicy == JOURNAL_SYNC_INTERVAL && std::chrono::steady_clock::now() - lastSync >= syncInterval))) {
+            sync();
+        }
+        if (written == 0) std::this_thread::sleep_for(std::chrono::microseconds(IDLE_SLEEP_US));
+    }
+    //the event loop is gone, take what it left
+    while (writeBatch() > 0) {}
+    closeSegment();
+}
+
+
+
+OrderBook* Journal::bookFor(uint32_t symbol) {
+    std::unique_ptr<OrderBook> &slot = books[symbol];
+    if (slot) return slot.get();
+    std::string noTrace;
+    std::unique_ptr<OrderBook> book(new OrderBook(noTrace, poolCapacity, ladderWindow));
+    if (book->initialize() != 0) {
+        std::cerr << "could not initialize the journal's copy of " << symbols->name(symbol) << "\n";
+        return nullptr;
+    }
+    slot = std::move(book);
+    return slot.get();
+}
+
+
+
+void Journal::apply(const JournalRecord &r) {
+    lastApplied = r.seq;
+    if (r.action == ORDER_NEW) highestOrderId = std::max(highestOrderId, r.id);
+    lastSession = std::max(lastSession, r.session);
+    if (r.symbol >= books.size()) return;
+    OrderBook* book = bookFor(r.symbol);
+    if (book == nullptr) return;
+    Order o;
+    o.id = r.id;
+    o.seq = r.seq;
+    o.session = r.session;
+    o.symbol = r.symbol;
+    o.price = r.price;
+    o.quantity = r.quantity;
+    o.buy = r.buy != 0;
+    o.action = r.action;
+    o.type = r.type;
+    book->process(o);
+}
+
+
+
+void Journal::queueSnapshot() {
+    auto started = std::chrono::steady_clock::now();
+
+    //sized up front and filled in place, a book with millions of orders is one pass over its levels.
+    //the copies can't change until it is done, the image is every book as of one seq. records still
+    //come off the ring every so often, into `held`, so the writer never waits for the build
+    uint32_t bookCount = 0;
+    uint64_t orders = 0;
+    for (const auto &book : books) {
+        if (!book) continue;
+        bookCount++;
+        orders += book->restingOrders();
+    }
+    size_t size = sizeof(SnapshotHeader) + symbolBlock.size() + bookCount * sizeof(SnapshotBook) +
+                  orders * sizeof(SnapshotOrder) + sizeof(SnapshotTrailer);
+    snapshotBuffer.resize(size);
+    char* p = snapshotBuffer.data();
+
+    SnapshotHeader header;
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = JOURNAL_VERSION;
+    header.orderSize = sizeof(SnapshotOrder);
+    header.symbolBytes = static_cast<uint32_t>(symbolBlock.size());
+    header.seq = lastApplied;
+    header.highestOrderId = highestOrderId;
+    header.lastSession = lastSession;
+    header.books = bookCount;
+    header.orders = orders;
+    std::memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+    std::memcpy(p, symbolBlock.data(), symbolBlock.size());
+    p += symbolBlock.size();
+
+    for (uint32_t symbol = 0; symbol < books.size(); ++symbol) {
+        if (!books[symbol]) continue;
+        const OrderBook &book = *books[symbol];
+        SnapshotBook entry = {symbol, 0, book.eventSequence(), book.restingOrders()};
+        std::memcpy(p, &entry, sizeof(entry));
+        p += sizeof(entry);
+        size_t filled = 0;
+        book.forEachResting([&](const Order &o) {
+            SnapshotOrder s = {o.id, o.session, o.price, o.quantity, static_cast<uint8_t>(o.buy ? 1 : 0), o.type, 0};
+            std::memcpy(p, &s, sizeof(s));
+            p += sizeof(s);
+            if (++filled % HOLD_EVERY == 0) holdApplied();
+        });
+        holdApplied();
+    }
+    //the trailer's checksum is left to the i/o thread
+    lastSnapshotBuildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+
+    //the i/o thread is idle (ioPending is clear), so its buffer can be traded for this one
+    {
+        std::lock_guard<std::mutex> lock(ioMutex);
+        ioBuffer.swap(snapshotBuffer);
+        ioSeq = lastApplied;
+        ioOrders = orders;
+        ioPending.store(true);
+    }
+    ioWake.notify_all();
+}
+
+
+
+void Journal::holdApplied() {
+    //a snapshot thread that can't keep up at all slows the writer down like before, it doesn't grow this forever
+    JournalRecord r;
+    while (held.size() < HOLD_LIMIT && applied.tryPop(r)) held.push_back(r);
+}
+
+
+
+void Journal::catchUp() {
+    //in groups, looking at the ring in between, until the copies are back with the writer
+    size_t next = 0;
+    while (next < held.size()) {
+        size_t end = std::min(held.size(), next + MAX_BATCH);
+        for (; next < end; ++next) apply(held[next]);
+        holdApplied();
+    }
+    held.clear();
+}
+
+
+
+void Journal::runSnapshotWrites() {
+    placeCurrentThread("journal-snapshot-io", placement, runtimeStatus);
+    std::unique_lock<std::mutex> lock(ioMutex);
+    while (true) {
+        ioWake.wait(lock, [this] { return ioPending.load() || ioStop; });
+        if (!ioPending.load()) return; //stopping and nothing left to write
+        lock.unlock();
+        writeSnapshot();
+        lock.lock();
+        ioPending.store(false);
+        ioWake.notify_all(); //the last snapshot may be waiting for this one
+    }
+}
+
+
+
+void Journal::writeSnapshot() {
+    auto started = std::chrono::steady_clock::now();
+
+    SnapshotTrailer trailer;
+    trailer.check = checksum(ioBuffer.data(), ioBuffer.size() - sizeof(trailer));
+    trailer.bytes = ioBuffer.size();
+    std::memcpy(ioBuffer.data() + ioBuffer.size() - sizeof(trailer), &trailer, sizeof(trailer));
+
+    //written next to the others and renamed into place once it is on disk, so a crash never leaves a
+    //half written snapshot under a real name
+    std::string temporary = dir + "/snapshot.tmp";
+    std::string path = fileName(dir, "snapshot-", ioSeq, ".snap");
+    int fd = open(temporary.c_str(), O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, 0644);
+    bool ok = fd >= 0 && writeFully(fd, ioBuffer.data(), ioBuffer.size()) && fdatasync(fd) == 0;
+    if (fd >= 0) close(fd);
+    if (!ok || rename(temporary.c_str(), path.c_str()) < 0) {
+        if (snapshotErrors++ == 0) std::cerr << "could not write snapshot " << path << ": " << strerror(errno) << "\n";
+        unlink(temporary.c_str());
+        return; //lastSnapshotSeq stays, so the next interval tries again
+    }
+    syncDirectory(dir);
+
+    uint64_t previous = lastSnapshotSeq.load();
+    lastSnapshotSeq.store(ioSeq);
+    snapshotsWritten++;
+    lastSnapshotOrders = ioOrders;
+    lastSnapshotBytes = ioBuffer.size();
+    lastSnapshotWriteMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    prune(previous);
+}
+
+
+
+void Journal::prune(uint64_t keep_seq) {
+    //the newest two snapshots stay, and the journal back to the older one, so a damaged newest snapshot
+    //still leaves a way back
+    if (keep_seq == 0) return;
+    std::vector<std::pair<uint64_t, std::string>> snapshots, journals;
+    if (!listJournalDir(dir, snapshots, journals)) return;
+    for (const auto &s : snapshots) {
+        if (s.first < keep_seq) unlink(s.second.c_str());
+    }
+    for (size_t i = 0; i + 1 < journals.size(); ++i) { //the last segment may be the one being written
+        if (journals[i + 1].first <= keep_seq + 1) unlink(journals[i].second.c_str());
+    }
+}
+
+
+
+void Journal::runSnapshots() {
+    placeCurrentThread("journal-snapshot", placement, runtimeStatus);
+    if (recovered) { //the same books the matching workers start from
+        lastApplied = recovered->lastSeq;
+        lastSnapshotSeq.store(recovered->snapshotSeq);
+        highestOrderId = recovered->highestOrderId;
+        lastSession = recovered->lastSession;
+        recovered->replay([this](uint32_t symbol) { return bookFor(symbol); }, [](uint32_t, OrderBook&) {});
+        recovered.reset();
+    }
+
+    auto lastSnapshot = std::chrono::steady_clock::now();
+    while (!snapshotStop.load(std::memory_order_acquire)) {
+        size_t count = 0;
+        JournalRecord r;
+        while (count < MAX_BATCH && applied.tryPop(r)) {
+            apply(r);
+            count++;
+        }
+        //one still being written puts the next one off, records keep being applied meanwhile
+        if (snapshotInterval.count() > 0 && lastApplied != lastSnapshotSeq.load() && !ioPending.load() &&
+            std::chrono::steady_clock::now() - lastSnapshot >= snapshotInterval) {
+            queueSnapshot();
+            catchUp();
+            lastSnapshot = std::chrono::steady_clock::now();
+        }
+        if (count == 0) std::this_thread::sleep_for(std::chrono::microseconds(IDLE_SLEEP_US));
+    }
+
+    //the writer is done, so this is everything. a last snapshot makes the next start a plain load
+    JournalRecord r;
+    while (applied.tryPop(r)) apply(r);
+    {
+        std::unique_lock<std::mutex> lock(ioMutex);
+        ioWake.wait(lock, [this] { return !ioPending.load(); });
+    }
+    if (lastApplied != lastSnapshotSeq.load()) queueSnapshot();
+}
+
+
+
+void Journal::writeReport(std::ostream &out) const {
+    const char* policy = (syncPolicy == JOURNAL_SYNC_NONE) ? "never synced" :
+                         (syncPolicy == JOURNAL_SYNC_BATCH) ? "synced every batch" : "synced on an interval";
+    out << "Journal: " << dir << ", " << recordsWritten << " records in " << batches << " writes (largest "
+        << largestBatch << "), " << syncs << " syncs (" << policy << "), " << segmentsOpened << " segments, "
+        << writeErrors << " errors, " << appendWaits << " appends found the ring full\n";
+    out << "Snapshots: " << snapshotsWritten << " written, " << snapshotErrors << " errors";
+    if (snapshotsWritten > 0) {
+        out << ", last one " << lastSnapshotOrders << " resting orders, " << lastSnapshotBytes << " bytes, built in "
+            << lastSnapshotBuildMs << " ms and written in " << lastSnapshotWriteMs << " ms";
+    }
+    out << "\n";
+}
@@ -0,0 +1,135 @@
+// journal_test.cpp
+// checks that a restart carries on where the books were: orders go through the journal and through live
+// books side by side, then the books are rebuilt from the journal directory. every rebuilt book must have
+// the resting orders and the event seq of its live one, and the next report must number after the last one
+// a client saw before the restart.
+// prints every case that went wrong and exits non-zero if there was one
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdlib>
+#include <dirent.h>
+#include <unistd.h>
+#include "journal.h"
+
+
+static int failures = 0;
+
+static void removeDirectory(const std::string &dir) {
+    DIR* d = opendir(dir.c_str());
+    if (d == nullptr) return;
+    while (dirent* entry = readdir(d)) {
+        std::string name = entry->d_name;
+        if (name != "." && name != "..") unlink((dir + "/" + name).c_str());
+    }
+    closedir(d);
+    rmdir(dir.c_str());
+}
+
+static std::unique_ptr<OrderBook> newBook() {
+    std::string noTrace;
+    std::unique_ptr<OrderBook> book(new OrderBook(noTrace, 1 << 16));
+    if (book->initialize() != 0) return nullptr;
+    book->enableEvents(true);
+    return book;
+}
+
+
+int main() {
+    char pattern[] = "/tmp/journal_test_XXXXXX";
+    if (mkdtemp(pattern) == nullptr) {
+        std::cerr << "could not create a scratch directory\n";
+        return EXIT_FAILURE;
+    }
+    std::string dir = pattern;
+
+    SymbolTable symbols;
+    symbols.add("AAA");
+    symbols.add("BBB");
+
+    //crossing limit orders and a few cancels on both symbols, so both books trade, rest and reject
+    std::vector<std::unique_ptr<OrderBook>> live;
+    for (size_t s = 0; s < symbols.size(); ++s) live.push_back(newBook());
+    {
+        Journal journal;
+        if (live[0] == nullptr || live[1] == nullptr ||
+            journal.initialize(dir, symbols, 1 << 16, OrderBook::DENSE_LADDER, JOURNAL_SYNC_NONE, 0, 0, 1 << 12) != 0) {
+            removeDirectory(dir);
+            return EXIT_FAILURE;
+        }
+        journal.start(nullptr);
+        uint64_t rng = 12345;
+        for (uint64_t i = 1; i <= 20000; ++i) {
+            rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+            Order o;
+            o.seq = i;
+            o.session = 1 + (rng >> 60) % 3;
+            o.symbol = (rng >> 40) & 1;
+            o.buy = (rng >> 41) & 1;
+            o.type = ORDER_LIMIT;
+            if (i > 10 && (rng >> 50) % 8 == 0) {
+                o.action = ORDER_CANCEL;
+                o.id = i - 1 - (rng >> 20) % 10;
+                o.price = 0;
+                o.quantity = 0;
+            } else {
+                o.action = ORDER_NEW;
+                o.id = i;
+                o.price = 50000 + static_cast<int>((rng >> 24) % 41) - 20;
+                o.quantity = 1 + static_cast<int>((rng >> 32) % 100);
+            }
+            journal.append(o);
+            live[o.symbol]->process(o);
+            live[o.symbol]->clearEvents();
+        }
+        journal.stop(); //writes the final snapshot
+    }
+
+    Recovery recovered;
+    if (recovered.load(dir, symbols) != 0 || recovered.snapshotFile.empty()) {
+        failures++;
+        std::cout << "FAIL: no snapshot to recover from in " << dir << "\n";
+    }
+    std::vector<std::unique_ptr<OrderBook>> rebuilt;
+    for (size_t s = 0; s < symbols.size(); ++s) rebuilt.push_back(newBook());
+    recovered.replay([&](uint32_t symbol) { return rebuilt[symbol].get(); },
+                     [](uint32_t, OrderBook &book) { book.clearEvents(); });
+
+    for (uint32_t s = 0; s < symbols.size(); ++s) {
+        if (rebuilt[s]->restingOrders() != live[s]->restingOrders()) {
+            failures++;
+            std::cout << "FAIL: " << symbols.name(s) << " came back with " << rebuilt[s]->restingOrders()
+                      << " resting orders, expected " << live[s]->restingOrders() << "\n";
+        }
+        if (rebuilt[s]->eventSequence() != live[s]->eventSequence() || live[s]->eventSequence() == 0) {
+            failures++;
+            std::cout << "FAIL: " << symbols.name(s) << " came back at event seq " << rebuilt[s]->eventSequence()
+                      << ", expected " << live[s]->eventSequence() << "\n";
+        }
+
+        //the first report after the restart
+        Order o;
+        o.id = 1000000;
+        o.seq = 0;
+        o.session = 1;
+        o.symbol = s;
+        o.buy = true;
+        o.price = 50000;
+        o.quantity = 1;
+        o.action = ORDER_NEW;
+        o.type = ORDER_LIMIT;
+        rebuilt[s]->process(o);
+        const std::vector<BookEvent> &events = rebuilt[s]->events();
+        if (events.empty() || events.front().seq <= live[s]->eventSequence()) {
+            failures++;
+            std::cout << "FAIL: " << symbols.name(s) << " reported seq " << (events.empty() ? 0 : events.front().seq)
+                      << " after the restart, clients already saw " << live[s]->eventSequence() << "\n";
+        }
+    }
+
+    removeDirectory(dir);
+    if (failures == 0) std::cout << "all journal checks passed\n";
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,69 @@
+#include "latencyhistogram.h"
+#include <algorithm>
+
+
+uint64_t LatencyHistogram::highestInBucket(size_t bucket) {
+    if (bucket < SUB_COUNT) return bucket;
+    size_t above = bucket - SUB_COUNT;
+    int shift = static_cast<int>(above / HALF_COUNT) + 1;
+    uint64_t sub = HALF_COUNT + above % HALF_COUNT;
+    return ((sub + 1) << shift) - 1;
+}
+
+
+
+void LatencyHistogram::reset() {
+    std::fill(counts.begin(), counts.end(), 0);
+    total = 0;
+    minValue = 0;
+    maxValue = 0;
+    sum = 0;
+}
+
+
+
+void LatencyHistogram::merge(const LatencyHistogram &other) {
+    if (other.total == 0) return;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) counts[i] += other.counts[i];
+    if (total == 0 || other.minValue < minValue) minValue = other.minValue;
+    if (other.maxValue > maxValue) maxValue = other.maxValue;
+    sum += other.sum;
+    total += other.total;
+}
+
+
+
+uint64_t LatencyHistogram::percentile(double percent) const {
+    if (total == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(percent / 100.0 * static_cast<double>(total) + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > total) rank = total;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        seen += counts[i];
+        if (seen >= rank) return std::min(std::max(highestInBucket(i), minValue), maxValue); //exact at the ends
+    }
+    return maxValue;
+}
+
+
+
+void LatencyHistogram::writeSummary(std::ostream &out) const {
+    out << "Average Latency (ns): " << mean() << "\n";
+    if (total == 0) return;
+    out << "Min Latency (ns): " << minValue << "\n";
+    out << "p50 Latency (ns): " << percentile(50.0) << "\n";
+    out << "p90 Latency (ns): " << percentile(90.0) << "\n";
+    out << "p99 Latency (ns): " << percentile(99.0) << "\n";
+    out << "p99.9 Latency (ns): " << percentile(99.9) << "\n";
+    out << "p99.99 Latency (ns): " << percentile(99.99) << "\n";
+    out << "Max Latency (ns): " << maxValue << "\n";
+}
+
+
+
+void LatencyHistogram::writeLine(std::ostream &out, const char* label) const {
+    out << label << " (ns): p50 " << percentile(50.0) << ", p99 " << percentile(99.0)
+        << ", p99.9 " << percentile(99.9) << ", max " << maxValue << "\n";
+}
@@ -0,0 +1,291 @@
+// loadgen.cpp
+// drives server_main over several binary connections and measures order-to-ack round trips.
+// open loop (--rate): poisson arrivals on a fixed schedule, latency counts from when an order was
+// due, so time spent waiting behind a slow server shows up instead of being left out.
+// closed loop (default): every connection keeps --inflight orders outstanding.
+// --shm attaches every connection to the server's shared memory gateway instead, and spins on the
+// report rings the way a co-located client would instead of sleeping in poll()
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <random>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <poll.h>
+#include "client.h"
+#include "workload.h"
+#include "utilities.h"
+#include "latencyhistogram.h"
+#include "clock.h"
+
+
+static const int SERVER_PORT = 5000;
+static const double DRAIN_SECONDS = 2.0; //how long to wait for the last acks
+
+
+//one connection, its own copy of the workload and what it is still waiting on
+struct Connection {
+    std::unique_ptr<Client> client;
+    std::vector<Order> orders;
+    size_t next = 0;                    // next order to send
+    size_t outstanding = 0;
+    std::vector<uint64_t> dueTimes;     // intended send time of each queued order, until the flush
+    //requests for the same id are answered in order, so a fifo per id pairs acks with requests
+    std::unordered_map<uint64_t, std::deque<std::pair<uint64_t, uint64_t>>> waiting; // id -> (due, sent)
+    std::vector<ExecReport> reports;
+};
+
+
+struct Results {
+    LatencyHistogram fromDue;       // ack time - when the order was due (what a user of the server sees)
+    LatencyHistogram fromSend;      // ack time - when send() returned
+    uint64_t acked = 0;
+    uint64_t warmup = 0;            // acks still to skip before recording
+    uint64_t counts[EXEC_REJECTED + 1] = {0};
+};
+
+
+//an ack is the last report a request gets: fills can come before it, never after
+static inline bool isAck(uint8_t type) {
+    return type == EXEC_ACCEPTED || type == EXEC_CANCELLED || type == EXEC_MODIFIED || type == EXEC_REJECTED;
+}
+
+
+static void matchReports(Connection &c, Results &r) {
+    uint64_t now = clockNow();
+    for (const ExecReport &report : c.reports) {
+        r.counts[report.type <= EXEC_REJECTED ? report.type : 0]++;
+        if (!isAck(report.type)) continue;
+        auto it = c.waiting.find(report.orderId);
+        if (it == c.waiting.end()) continue; //not one of ours
+        std::pair<uint64_t, uint64_t> times = it->second.front();
+        it->second.pop_front();
+        if (it->second.empty()) c.waiting.erase(it);
+        c.outstanding--;
+        r.acked++;
+        if (r.warmup > 0) {
+            r.warmup--;
+            continue;
+        }
+        r.fromDue.record(ticksToNanos(now - std::min(now, times.first)));
+        r.fromSend.record(ticksToNanos(now - std::min(now, times.second)));
+    }
+    c.reports.clear();
+}
+
+
+static bool flush(Connection &c, Results &r) {
+    if (c.client->queued_orders() == 0) return true;
+    //registered first: acks for the start of the batch can be read while the rest is still going out
+    size_t first = c.next - c.dueTimes.size();
+    uint64_t sent = clockNow();
+    for (size_t i = 0; i < c.dueTimes.size(); ++i) {
+        c.waiting[c.orders[first + i].id].emplace_back(c.dueTimes[i], sent);
+    }
+    c.dueTimes.clear();
+    if (c.client->flush_orders(c.reports) != 0) return false;
+    matchReports(c, r); //anything read while the socket was full
+    return true;
+}
+
+
+static void queue(Connection &c, uint64_t due) {
+    c.client->queue_order(c.orders[c.next]);
+    c.dueTimes.push_back(due);
+    c.next++;
+    c.outstanding++;
+}
+
+
+static void usage(const char* prog) {
+    std::cerr << "usage: " << prog << " <server_ip> [--connections n] [--rate orders_per_sec] [--inflight n]\n"
+              << "       [--orders n] [--profile name] [--seed n] [--symbols n] [--file orders.bin] [--warmup n] [--shm name]\n"
+              << "--rate sends poisson arrivals at that total rate (open loop) and times acks from when each order was due.\n"
+              << "without it every connection keeps --inflight orders (default 1) in flight (closed loop).\n"
+              << "--orders is the total over all connections (default 100000, or all of --file on each), every connection replays its own copy\n"
+              << "of the --profile workload (seeded with --seed + connection) or of --file.\n"
+              << "the first --warmup acks are not recorded. multi-symbol profiles need server_main --symbols with enough symbols.\n"
+              << "--shm goes through server_main --shm name on this host instead of tcp (server_ip is not used).\n";
+}
+
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argv[1][0] == '-') {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    std::string server_ip = argv[1];
+    size_t connections = 1;
+    double rate = 0;
+    size_t inflight = 1;
+    size_t total = 0; //0: 100000, or the whole file
+    uint64_t warmup = 0;
+    std::string fileName;
+    std::string shmName;
+    WorkloadSpec spec;
+    spec.symbols = 1;
+
+    try {
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--connections" && i + 1 < argc) connections = std::max<size_t>(1, std::stoul(argv[++i]));
+            else if (arg == "--rate" && i + 1 < argc) rate = std::stod(argv[++i]);
+            else if (arg == "--inflight" && i + 1 < argc) inflight = std::max<size_t>(1, std::stoul(argv[++i]));
+            else if (arg == "--orders" && i + 1 < argc) total = std::stoull(argv[++i]);
+            else if (arg == "--profile" && i + 1 < argc) spec.profile = argv[++i];
+            else if (arg == "--seed" && i + 1 < argc) spec.seed = std::stoull(argv[++i]);
+            else if (arg == "--symbols" && i + 1 < argc) spec.symbols = static_cast<uint32_t>(std::stoul(argv[++i]));
+            else if (arg == "--file" && i + 1 < argc) fileName = argv[++i];
+            else if (arg == "--warmup" && i + 1 < argc) warmup = std::stoull(argv[++i]);
+            else if (arg == "--shm" && i + 1 < argc) shmName = argv[++i];
+            else {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+    } catch (const std::exception &e) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    calibrateClock();
+
+    std::vector<Order> fileOrders;
+    if (!fileName.empty() && !loadOrdersFromFile(fileName, fileOrders)) return EXIT_FAILURE;
+
+    if (total == 0) total = fileName.empty() ? 100000 : fileOrders.size() * connections;
+    std::vector<Connection> conns(connections);
+    size_t perConnection = total / connections;
+    for (size_t i = 0; i < connections; ++i) {
+        Connection &c = conns[i];
+        if (fileName.empty()) {
+            WorkloadSpec s = spec;
+            s.count = perConnection;
+            s.seed = spec.seed + i;
+            if (!generateWorkload(s, c.orders)) {
+                std::cerr << "unknown profile: " << spec.profile << "\n";
+                return EXIT_FAILURE;
+            }
+        } else {
+            c.orders.assign(fileOrders.begin(), fileOrders.begin() + std::min(perConnection, fileOrders.size()));
+        }
+        c.client.reset(new Client(server_ip, SERVER_PORT));
+        if (!shmName.empty()) {
+            if (c.client->attach_shared_memory(shmName) != 0) return EXIT_FAILURE;
+        } else if (c.client->connect_to_server() != 0 || c.client->send_hello() != 0) {
+            std::cerr << "could not open connection " << i << " to " << server_ip << ":" << SERVER_PORT << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+    size_t toSend = 0;
+    for (const Connection &c : conns) toSend += c.orders.size();
+
+    Results results;
+    results.warmup = warmup;
+    std::vector<pollfd> fds(connections);
+    for (size_t i = 0; i < connections; ++i) fds[i].fd = conns[i].client->fd();
+
+    std::mt19937_64 rng(spec.seed);
+    std::exponential_distribution<double> gap(rate > 0 ? rate : 1.0); //seconds between arrivals
+    double ticksPerSecond = 1e9 / clockNanosPerTick;
+    uint64_t start = clockNow();
+    double nextArrival = 0; //seconds after start
+    size_t sent = 0;
+    size_t turn = 0;
+    uint64_t lastAck = start;
+    bool ok = true;
+
+    while (ok) {
+        uint64_t now = clockNow();
+
+        //queue everything that is due, then send it
+        if (rate > 0) {
+            while (sent < toSend && start + static_cast<uint64_t>(nextArrival * ticksPerSecond) <= now) {
+                for (size_t k = 0; k < connections; ++k, turn = (turn + 1) % connections) {
+                    if (conns[turn].next < conns[turn].orders.size()) break; //skip connections that are done
+                }
+                queue(conns[turn], start + static_cast<uint64_t>(nextArrival * ticksPerSecond));
+                turn = (turn + 1) % connections;
+                sent++;
+                nextArrival += gap(rng);
+            }
+        } else {
+            for (Connection &c : conns) {
+                while (c.outstanding < inflight && c.next < c.orders.size()) {
+                    queue(c, now);
+                    sent++;
+                }
+            }
+        }
+        for (Connection &c : conns) ok = ok && flush(c, results);
+
+        size_t outstanding = 0;
+        for (const Connection &c : conns) outstanding += c.outstanding;
+        if (sent == toSend && outstanding == 0) break;
+        if (sent == toSend && ticksToNanos(now - lastAck) > DRAIN_SECONDS * 1e9) {
+            std::cerr << outstanding << " orders never got an ack\n";
+            break;
+        }
+
+        //wait for acks, but no longer than the next arrival
+        int timeout = 100;
+        if (rate > 0 && sent < toSend) {
+            double wait = nextArrival - ticksToNanos(clockNow() - start) / 1e9;
+            timeout = wait > 0.002 ? static_cast<int>(wait * 1000) - 1 : 0;
+        }
+        for (pollfd &p : fds) {
+            p.events = POLLIN;
+            p.revents = 0;
+        }
+        if (!shmName.empty()) {
+            //spin over the rings first, the way a co-located client would (unless the server needs
+            //this cpu), then sleep on the doorbells. every connection is read afterwards
+            uint64_t spinEnd = clockNow() + static_cast<uint64_t>(std::min(timeout, 1) * 1e6 / clockNanosPerTick);
+            bool any = false;
+            while (!any && spinningHelps() && clockNow() < spinEnd) {
+                for (Connection &c : conns) any = any || !c.reports.empty() || c.client->read_reports(c.reports) != 0;
+                cpuRelax();
+            }
+            bool armed = !any;
+            for (Connection &c : conns) armed = c.client->arm_doorbell() && armed;
+            if (armed && poll(fds.data(), fds.size(), timeout) < 0 && errno != EINTR) break;
+            for (Connection &c : conns) c.client->disarm_doorbell();
+            for (pollfd &p : fds) p.revents = POLLIN;
+        } else if (poll(fds.data(), fds.size(), timeout) < 0 && errno != EINTR) {
+            break;
+        }
+        for (size_t i = 0; i < connections; ++i) {
+            if (!(fds[i].revents & (POLLIN | POLLERR | POLLHUP))) continue;
+            if (conns[i].client->read_reports(conns[i].reports) < 0) {
+                ok = false;
+                break;
+            }
+            uint64_t before = results.acked;
+            matchReports(conns[i], results);
+            if (results.acked != before) lastAck = clockNow();
+        }
+    }
+    double seconds = ticksToNanos(clockNow() - start) / 1e9;
+
+    std::cout << connections << " connection(s), "
+              << (rate > 0 ? "open loop, poisson arrivals at " + std::to_string(static_cast<long long>(rate)) + " orders/s"
+                           : "closed loop, " + std::to_string(inflight) + " in flight per connection")
+              << ", " << (fileName.empty() ? "profile " + spec.profile : "file " + fileName) << "\n";
+    std::cout << "sent " << sent << " orders in " << seconds << " s (" << (seconds > 0 ? sent / seconds : 0) << " orders/s), "
+              << results.acked << " acked, " << results.fromDue.count() << " recorded\n";
+    std::cout << "reports: " << results.counts[EXEC_ACCEPTED] << " accepted, " << results.counts[EXEC_FILL] << " fills, "
+              << results.counts[EXEC_CANCELLED] << " cancelled, " << results.counts[EXEC_MODIFIED] << " modified, "
+              << results.counts[EXEC_REJECTED] << " rejected\n";
+    std::cout << "\nround trip from when the order was due (ns):\n";
+    results.fromDue.writeSummary(std::cout);
+    std::cout << "\nround trip from send() (ns):\n";
+    results.fromSend.writeSummary(std::cout);
+
+    for (Connection &c : conns) c.client->close_client();
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
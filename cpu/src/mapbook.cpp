@@ -0,0 +1,199 @@
+#include "mapbook.h"
+#include <algorithm>
+#include <limits>
+
+
+int MapOrderBook::initialize() {
+    bids.clear();
+    asks.clear();
+    index.clear();
+    eventBuffer.clear();
+    eventSeq = 0;
+    return 0;
+}
+
+
+
+static bool buyCrosses(int limit, int level) { return limit >= level; }
+static bool sellCrosses(int limit, int level) { return limit <= level; }
+
+
+
+template <typename Side>
+int64_t MapOrderBook::available(int limit, const Side &side, bool crosses(int, int)) {
+    int64_t total = 0;
+    for (auto it = side.begin(); it != side.end() && crosses(limit, it->first); ++it) {
+        for (const Order &o : it->second) total += o.quantity;
+    }
+    return total;
+}
+
+
+
+template <typename Side>
+void MapOrderBook::sweep(Order &order, int limit, Side &side, bool crosses(int, int)) {
+    while (order.quantity > 0 && !side.empty() && crosses(limit, side.begin()->first)) {
+        int price = side.begin()->first;
+        Level &level = side.begin()->second;
+        while (order.quantity > 0 && !level.empty()) {
+            Order &top = level.front();
+            int traded = std::min(order.quantity, top.quantity);
+            eventBuffer.push_back(BookEvent{++eventSeq, order.id, top.id, order.session, top.session,
+                                            price, traded, EXEC_FILL, order.buy});
+            order.quantity -= traded;
+            top.quantity -= traded;
+            if (top.quantity == 0) {
+                index.erase(key(top.id, top.session));
+                level.pop_front();
+            }
+        }
+        if (level.empty()) side.erase(side.begin());
+    }
+}
+
+
+
+bool MapOrderBook::rest(const Order &order) {
+    if (order.price < MIN_PRICE || order.price > MAX_PRICE) return false;
+    Location loc;
+    loc.price = order.price;
+    loc.buy = order.buy;
+    if (order.buy) {
+        Level &level = bids[order.price];
+        loc.it = level.insert(level.end(), order);
+    } else {
+        Level &level = asks[order.price];
+        loc.it = level.insert(level.end(), order);
+    }
+    index[key(order.id, order.session)] = loc;
+    return true;
+}
+
+
+
+void MapOrderBook::match(Order &order, uint8_t doneType) {
+    if (order.type >= ORDER_TYPE_COUNT || index.count(key(order.id, order.session))) { //id already resting for this session
+        emit(EXEC_REJECTED, order.id, order.session, order.buy, order.price, order.quantity);
+        return;
+    }
+    int limit = order.price;
+    if (order.type == ORDER_MARKET) limit = order.buy ? std::numeric_limits<int>::max() : std::numeric_limits<int>::min();
+
+    if (order.type == ORDER_POST_ONLY) {
+        bool crosses = order.buy ? (!asks.empty() && buyCrosses(limit, asks.begin()->first))
+                                 : (!bids.empty() && sellCrosses(limit, bids.begin()->first));
+        if (crosses) {
+            emit(EXEC_REJECTED, order.id, order.session, order.buy, order.price, order.quantity);
+            return;
+        }
+    }
+    if (order.type == ORDER_FOK) {
+        int64_t there = order.buy ? available(limit, asks, buyCrosses) : available(limit, bids, sellCrosses);
+        if (there < order.quantity) {
+            emit(EXEC_CANCELLED, order.id, order.session, order.buy, order.price, order.quantity);
+            return;
+        }
+    }
+
+    if (order.buy) sweep(order, limit, asks, buyCrosses);
+    else sweep(order, limit, bids, sellCrosses);
+
+    if (order.quantity > 0 && order.type != ORDER_LIMIT && order.type != ORDER_POST_ONLY) { //ioc, fok, market
+        emit(EXEC_CANCELLED, order.id, order.session, order.buy, order.price, order.quantity);
+        return;
+    }
+    if (order.quantity > 0 && !rest(order)) {
+        emit(EXEC_REJECTED, order.id, order.session, order.buy, order.price, order.quantity);
+        return;
+    }
+    emit(doneType, order.id, order.session, order.buy, order.price, order.quantity);
+}
+
+
+
+void MapOrderBook::remove(Index::iterator it) {
+    Location loc = it->second;
+    index.erase(it);
+    if (loc.buy) {
+        auto level = bids.find(loc.price);
+        level->second.erase(loc.it);
+        if (level->second.empty()) bids.erase(level);
+    } else {
+        auto level = asks.find(loc.price);
+        level->second.erase(loc.it);
+        if (level->second.empty()) asks.erase(level);
+    }
+}
+
+
+
+bool MapOrderBook::cancel(uint64_t id, uint32_t session) {
+    auto it = index.find(key(id, session));
+    if (it == index.end()) {
+        emit(EXEC_REJECTED, id, session, false, 0, 0);
+        return false;
+    }
+    Order cancelled = *it->second.it;
+    remove(it);
+    emit(EXEC_CANCELLED, cancelled.id, cancelled.session, cancelled.buy, cancelled.price, cancelled.quantity);
+    return true;
+}
+
+
+
+void MapOrderBook::modify(uint64_t id, int quantity, int price, uint32_t session) {
+    auto it = index.find(key(id, session));
+    if (it == index.end()) {
+        emit(EXEC_REJECTED, id, session, false, 0, 0);
+        return;
+    }
+    Order &resting = *it->second.it;
+    if (price == 0) price = resting.price;
+    if (quantity <= 0) {
+        cancel(id, session);
+        return;
+    }
+    if (price == resting.price && quantity <= resting.quantity) { //shrinking keeps priority
+        resting.quantity = quantity;
+        emit(EXEC_MODIFIED, resting.id, resting.session, resting.buy, resting.price, resting.quantity);
+        return;
+    }
+    Order replacement = resting;
+    replacement.action = ORDER_NEW;
+    replacement.price = price;
+    replacement.quantity = quantity;
+    remove(it);
+    match(replacement, EXEC_MODIFIED);
+}
+
+
+
+void MapOrderBook::process(Order &order) {
+    switch (order.action) {
+        case ORDER_CANCEL: cancel(order.id, order.session); break;
+        case ORDER_MODIFY: modify(order.id, order.quantity, order.price, order.session); break;
+        default: match(order, EXEC_ACCEPTED); break;
+    }
+}
+
+
+
+template <typename Side>
+static size_t sideDepth(const Side &side, size_t n, std::vector<DepthLevel> &out) {
+    for (auto it = side.begin(); it != side.end() && out.size() < n; ++it) {
+        DepthLevel level{it->first, 0, 0};
+        for (const Order &o : it->second) {
+            level.orders++;
+            level.quantity += o.quantity;
+        }
+        out.push_back(level);
+    }
+    return out.size();
+}
+
+
+
+size_t MapOrderBook::depth(bool bid_side, size_t n, std::vector<DepthLevel> &out) const {
+    out.clear();
+    return bid_side ? sideDepth(bids, n, out) : sideDepth(asks, n, out);
+}
@@ -0,0 +1,349 @@
+#include "marketdata.h"
+#include "clock.h"
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+bool parseEndpoint(const std::string &spec, sockaddr_in &out) {
+    size_t colon = spec.rfind(':');
+    if (colon == std::string::npos) return false;
+    std::memset(&out, 0, sizeof(out));
+    out.sin_family = AF_INET;
+    if (inet_pton(AF_INET, spec.substr(0, colon).c_str(), &out.sin_addr) != 1) return false;
+    try {
+        int port = std::stoi(spec.substr(colon + 1));
+        if (port <= 0 || port > 65535) return false;
+        out.sin_port = htons(static_cast<uint16_t>(port));
+    } catch (const std::exception &e) {
+        return false;
+    }
+    return true;
+}
+
+
+
+MarketDataPublisher::~MarketDataPublisher() {
+    stop();
+    if (sock >= 0) close(sock);
+}
+
+
+
+int MarketDataPublisher::initialize(const SymbolTable &symbol_table, size_t producer_count, size_t ring_capacity,
+                                    const sockaddr_in &destination_addr, const std::string &interface_ip,
+                                    int snapshot_ms, size_t snapshot_depth) {
+    books.clear();
+    books.resize(symbol_table.size());
+    rings.clear();
+    overflows.clear();
+    for (size_t i = 0; i < producer_count; ++i) {
+        std::unique_ptr<SPSCQueue<QueuedDelta>> ring(new SPSCQueue<QueuedDelta>());
+        ring->initialize(ring_capacity);
+        rings.push_back(std::move(ring));
+        overflows.emplace_back(new Overflow());
+    }
+    dirty.clear();
+    dirty.reserve(1 << 16);
+    packet.clear();
+    packet.reserve(MD_MAX_PACKET);
+    snapshotDepth = std::min(snapshot_depth, MD_MAX_SNAPSHOT_DEPTH);
+    snapshotTicks = (snapshot_ms > 0) ? static_cast<uint64_t>(snapshot_ms * 1e6 / clockNanosPerTick) : 0;
+
+    if (sock >= 0) close(sock);
+    //non-blocking: a full socket buffer means hold the packet and let the levels conflate, never wait
+    sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (sock < 0) {
+        std::cerr << "could not create market data socket: " << strerror(errno) << "\n";
+        return 1;
+    }
+    destination = destination_addr;
+
+    if (IN_MULTICAST(ntohl(destination.sin_addr.s_addr))) {
+        in_addr iface;
+        iface.s_addr = htonl(INADDR_ANY);
+        if (!interface_ip.empty() && inet_pton(AF_INET, interface_ip.c_str(), &iface) != 1) {
+            std::cerr << "invalid market data interface address: " << interface_ip << "\n";
+            return 1;
+        }
+        unsigned char loop = 1, ttl = 1;
+        if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof(iface)) < 0 ||
+            setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0 ||
+            setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0) {
+            std::cerr << "could not set up multicast on " << interface_ip << ": " << strerror(errno) << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+
+void MarketDataPublisher::start() {
+    if (running) return;
+    stopRequested.store(false);
+    running = true;
+    thread = std::thread(&MarketDataPublisher::run, this);
+}
+
+
+
+void MarketDataPublisher::stop() {
+    if (!running) return;
+    stopRequested.store(true);
+    if (thread.joinable()) thread.join();
+    running = false;
+}
+
+
+
+void MarketDataPublisher::post_levels(size_t producer, uint32_t symbol, const std::vector<LevelDelta> &deltas) {
+    //the shadow books are only right if they see every delta, but matching never waits for the publisher:
+    //what doesn't fit in the ring is merged into the overflow, and so is everything after it until the
+    //publisher has taken it
+    SPSCQueue<QueuedDelta> &ring = *rings[producer];
+    Overflow &overflow = *overflows[producer];
+    size_t i = 0;
+    if (!overflow.active.load(std::memory_order_acquire)) {
+        for (; i < deltas.size(); ++i) {
+            if (!ring.tryPush(QueuedDelta{symbol, i + 1 == deltas.size(), deltas[i]})) break;
+        }
+        if (i == deltas.size()) return;
+    }
+
+    std::lock_guard<std::mutex> lock(overflow.mutex); //only the publisher swapping the map out holds it
+    for (; i < deltas.size(); ++i) {
+        const LevelDelta &d = deltas[i];
+        uint64_t key = (static_cast<uint64_t>(symbol) << 33) | (static_cast<uint64_t>(d.buy ? 1 : 0) << 32) |
+                       static_cast<uint32_t>(d.price);
+        auto slot = overflow.levels.try_emplace(key, QueuedDelta{symbol, true, LevelDelta{d.price, 0, 0, d.buy}});
+        slot.first->second.delta.quantity += d.quantity;
+        slot.first->second.delta.orders += d.orders;
+        overflow.deltas++;
+    }
+    overflow.active.store(true, std::memory_order_release);
+}
+
+
+
+void MarketDataPublisher::apply(const QueuedDelta &q) {
+    ShadowBook &book = books[q.symbol];
+    Level &level = q.delta.buy ? book.bids[q.delta.price] : book.asks[q.delta.price];
+    level.quantity += q.delta.quantity;
+    level.orders += q.delta.orders;
+    deltasApplied++;
+    if (level.dirty) {
+        updatesConflated++;
+        return;
+    }
+    level.dirty = true;
+    dirty.push_back(DirtyLevel{q.symbol, q.delta.price, q.delta.buy});
+}
+
+
+
+size_t MarketDataPublisher::takeOverflow(size_t producer) {
+    Overflow &overflow = *overflows[producer];
+    if (!overflow.active.load(std::memory_order_acquire)) return 0;
+    {
+        std::lock_guard<std::mutex> lock(overflow.mutex);
+        overflowTaken.swap(overflow.levels);
+        overflow.active.store(false, std::memory_order_release);
+    }
+    for (const auto &entry : overflowTaken) apply(entry.second);
+    size_t applied = overflowTaken.size();
+    overflowTaken.clear();
+    overflowsTaken++;
+    return applied;
+}
+
+
+
+size_t MarketDataPublisher::drain() {
+    size_t applied = 0;
+    for (size_t producer = 0; producer < rings.size(); ++producer) {
+        SPSCQueue<QueuedDelta>* ring = rings[producer].get();
+        //a worker pushes the deltas of one process() call back to back, so when the ring runs dry in the
+        //middle of one the rest is a few spins away. waiting for it means every state we publish is one
+        //the book was actually in. the budget keeps one busy worker from starving the others
+        size_t budget = ring->capacity();
+        bool midCall = false;
+        QueuedDelta q;
+        while (midCall || budget > 0) {
+            if (ring->tryPop(q)) {
+                apply(q);
+                applied++;
+                if (budget > 0) budget--;
+                midCall = !q.last;
+            } else if (size_t taken = takeOverflow(producer)) {
+                //only once the ring is empty, the overflow comes after it. it ends with a whole call
+                applied += taken;
+                break;
+            } else if (midCall) {
+                cpuRelax();
+            } else {
+                break;
+            }
+        }
+    }
+    return applied;
+}
+
+
+
+bool MarketDataPublisher::sendPacket() {
+    if (packetMessages == 0) return true;
+    MdPacketHeader header;
+    header.magic = MD_MAGIC;
+    header.messages = packetMessages;
+    header.bytes = static_cast<uint16_t>(packet.size());
+    header.packetSeq = packetSeq + 1;
+    std::memcpy(packet.data(), &header, sizeof(header));
+
+    ssize_t sent = sendto(sock, packet.data(), packet.size(), MSG_DONTWAIT,
+                          reinterpret_cast<const sockaddr*>(&destination), sizeof(destination));
+    if (sent < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+            sendBlocked++;
+            packetPending = true;
+            return false;
+        }
+        sendErrors++; //dropped, consumers see the gap and resync from the next snapshot
+    } else {
+        packetsSent++;
+    }
+    packetSeq++;
+    packet.clear();
+    packetMessages = 0;
+    packetPending = false;
+    return true;
+}
+
+
+
+bool MarketDataPublisher::reserve(size_t bytes) {
+    if (packetPending) return false;
+    if (packet.size() + bytes > MD_MAX_PACKET && !sendPacket()) return false;
+    if (packet.empty()) packet.resize(sizeof(MdPacketHeader)); //filled in when it is sent
+    return true;
+}
+
+
+
+bool MarketDataPublisher::publish() {
+    if (packetPending && !sendPacket()) return false;
+
+    size_t sent = 0;
+    for (; sent < dirty.size(); ++sent) {
+        if (!reserve(sizeof(MdLevelUpdate))) break;
+        const DirtyLevel &d = dirty[sent];
+        ShadowBook &book = books[d.symbol];
+
+        MdLevelUpdate update = {};
+        update.type = MD_LEVEL_UPDATE;
+        update.buy = d.buy ? 1 : 0;
+        update.symbol = d.symbol;
+        update.seq = ++book.seq;
+        update.price = d.price;
+        if (d.buy) {
+            auto it = book.bids.find(d.price);
+            update.orders = static_cast<uint32_t>(it->second.orders);
+            update.quantity = it->second.quantity;
+            if (it->second.quantity == 0) book.bids.erase(it);
+            else it->second.dirty = false;
+        } else {
+            auto it = book.asks.find(d.price);
+            update.orders = static_cast<uint32_t>(it->second.orders);
+            update.quantity = it->second.quantity;
+            if (it->second.quantity == 0) book.asks.erase(it);
+            else it->second.dirty = false;
+        }
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&update);
+        packet.insert(packet.end(), bytes, bytes + sizeof(update));
+        packetMessages++;
+        updatesSent++;
+    }
+    dirty.erase(dirty.begin(), dirty.begin() + sent);
+    if (!dirty.empty()) return false;
+    return sendPacket(); //whatever is left in the last packet goes out now, nothing waits for a full one
+}
+
+
+
+void MarketDataPublisher::snapshot() {
+    for (uint32_t symbol = 0; symbol < books.size(); ++symbol) {
+        ShadowBook &book = books[symbol];
+        if (book.seq == 0) continue; //never traded, nothing to resync
+        size_t bidLevels = std::min(snapshotDepth, book.bids.size());
+        size_t askLevels = std::min(snapshotDepth, book.asks.size());
+        if (!reserve(sizeof(MdSnapshot) + (bidLevels + askLevels) * sizeof(MdSnapshotLevel))) return;
+
+        MdSnapshot header = {};
+        header.type = MD_SNAPSHOT;
+        header.bidLevels = static_cast<uint16_t>(bidLevels);
+        header.askLevels = static_cast<uint16_t>(askLevels);
+        header.symbol = symbol;
+        header.seq = book.seq;
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&header);
+        packet.insert(packet.end(), bytes, bytes + sizeof(header));
+
+        auto append = [&](int price, const Level &level) {
+            MdSnapshotLevel l = {price, static_cast<uint32_t>(level.orders), level.quantity};
+            const uint8_t* p = reinterpret_cast<const uint8_t*>(&l);
+            packet.insert(packet.end(), p, p + sizeof(l));
+        };
+        size_t n = 0;
+        for (auto it = book.bids.begin(); n < bidLevels; ++it, ++n) append(it->first, it->second);
+        n = 0;
+        for (auto it = book.asks.begin(); n < askLevels; ++it, ++n) append(it->first, it->second);
+        packetMessages++;
+        snapshotsSent++;
+    }
+}
+
+
+
+void MarketDataPublisher::run() {
+    if (!threadName.empty()) placeCurrentThread(threadName, placement, runtimeStatus);
+    lastSnapshot = clockNow();
+    while (!stopRequested.load(std::memory_order_acquire)) {
+        size_t applied = drain();
+        bool caughtUp = publish();
+
+        //snapshots only go out when every change is on the wire, so their seq matches what they show
+        if (caughtUp && snapshotTicks > 0 && clockNow() - lastSnapshot >= snapshotTicks) {
+            snapshot();
+            sendPacket();
+            lastSnapshot = clockNow();
+        }
+        if (applied == 0) std::this_thread::sleep_for(std::chrono::microseconds(IDLE_SLEEP_US));
+    }
+
+    //the workers are joined before stop(), take what they left. a socket that stays full loses the tail
+    drain();
+    for (int tries = 0; tries < 1000 && !publish(); ++tries) {
+        std::this_thread::sleep_for(std::chrono::microseconds(IDLE_SLEEP_US));
+    }
+    if (snapshotTicks > 0 && dirty.empty() && !packetPending) {
+        snapshot();
+        sendPacket();
+    }
+}
+
+
+
+void MarketDataPublisher::writeReport(std::ostream &out) const {
+    uint64_t overflowDeltas = 0;
+    for (const auto &overflow : overflows) overflowDeltas += overflow->deltas;
+    char address[INET_ADDRSTRLEN] = {0};
+    inet_ntop(AF_INET, &destination.sin_addr, address, sizeof(address));
+    out << "Market Data: " << address << ":" << ntohs(destination.sin_port) << ", " << deltasApplied << " level deltas, "
+        << updatesSent << " level updates sent (" << updatesConflated << " conflated), " << overflowsTaken
+        << " times a worker's ring was full (" << overflowDeltas << " deltas merged there), " << snapshotsSent << " snapshots, "
+        << packetsSent << " packets, " << sendBlocked << " sends found the socket full, " << sendErrors << " send errors\n";
+}
@@ -0,0 +1,279 @@
+// mdlisten.cpp
+// joins server_main's market data feed, rebuilds every book's levels from snapshots and level updates
+// and checks the sequence numbers. prints the top of every book it has when it exits.
+// a symbol whose first update has seq 1 is followed from the start, any other symbol waits for its
+// first snapshot, and a gap drops the symbol until the next one
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <cstdlib>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "marketdata.h"
+#include "symboltable.h"
+
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void handleSignal(int) {
+    stopRequested = 1;
+}
+
+
+struct Level {
+    int64_t quantity;
+    uint32_t orders;
+};
+
+struct LocalBook {
+    std::map<int, Level, std::greater<int>> bids;
+    std::map<int, Level> asks;
+    uint64_t seq = 0;
+    bool synced = false;
+    bool seen = false;
+};
+
+struct Stats {
+    uint64_t packets = 0;
+    uint64_t packetGaps = 0;
+    uint64_t updates = 0;
+    uint64_t snapshots = 0;
+    uint64_t seqGaps = 0;           // updates that skipped a seq, the symbol waits for a snapshot
+    uint64_t resyncs = 0;           // snapshots that (re)started a symbol
+    uint64_t snapshotChecks = 0;    // snapshots compared against a book we kept up ourselves
+    uint64_t snapshotMismatches = 0;
+    uint64_t malformed = 0;
+};
+
+
+template <typename Side>
+static void setLevel(Side &side, int price, int64_t quantity, uint32_t orders) {
+    if (quantity == 0) side.erase(price);
+    else side[price] = Level{quantity, orders};
+}
+
+
+//does the top of `side` match the snapshot's levels
+template <typename Side>
+static bool sameTop(const Side &side, const MdSnapshotLevel* levels, size_t count) {
+    auto it = side.begin();
+    for (size_t i = 0; i < count; ++i, ++it) {
+        if (it == side.end() || it->first != levels[i].price || it->second.quantity != levels[i].quantity ||
+            it->second.orders != levels[i].orders) return false;
+    }
+    return true;
+}
+
+
+static void applyUpdate(const MdLevelUpdate &u, std::vector<LocalBook> &books, Stats &stats) {
+    if (u.symbol >= books.size()) books.resize(u.symbol + 1);
+    LocalBook &book = books[u.symbol];
+    stats.updates++;
+    book.seen = true;
+    if (!book.synced) {
+        if (u.seq != 1) return; //joined late, wait for a snapshot
+        book.synced = true;
+    } else if (u.seq != book.seq + 1) {
+        stats.seqGaps++;
+        book.synced = false;
+        book.bids.clear();
+        book.asks.clear();
+        return;
+    }
+    book.seq = u.seq;
+    if (u.buy) setLevel(book.bids, u.price, u.quantity, u.orders);
+    else setLevel(book.asks, u.price, u.quantity, u.orders);
+}
+
+
+static void applySnapshot(const MdSnapshot &s, const MdSnapshotLevel* levels, std::vector<LocalBook> &books, Stats &stats) {
+    if (s.symbol >= books.size()) books.resize(s.symbol + 1);
+    LocalBook &book = books[s.symbol];
+    stats.snapshots++;
+    book.seen = true;
+    if (book.synced && s.seq == book.seq) {
+        stats.snapshotChecks++;
+        if (!sameTop(book.bids, levels, s.bidLevels) || !sameTop(book.asks, levels + s.bidLevels, s.askLevels)) {
+            stats.snapshotMismatches++;
+        }
+        return;
+    }
+    if (book.synced && s.seq < book.seq) return; //older than what we have
+
+    //only the top levels are in a snapshot, deeper ones show up as they change
+    book.bids.clear();
+    book.asks.clear();
+    for (size_t i = 0; i < s.bidLevels; ++i) setLevel(book.bids, levels[i].price, levels[i].quantity, levels[i].orders);
+    for (size_t i = 0; i < s.askLevels; ++i) {
+        const MdSnapshotLevel &l = levels[s.bidLevels + i];
+        setLevel(book.asks, l.price, l.quantity, l.orders);
+    }
+    book.seq = s.seq;
+    book.synced = true;
+    stats.resyncs++;
+}
+
+
+static void handlePacket(const uint8_t* data, size_t size, uint64_t &lastPacket, std::vector<LocalBook> &books, Stats &stats) {
+    MdPacketHeader header;
+    if (size < sizeof(header)) {
+        stats.malformed++;
+        return;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (header.magic != MD_MAGIC || header.bytes != size) {
+        stats.malformed++;
+        return;
+    }
+    stats.packets++;
+    if (lastPacket != 0 && header.packetSeq != lastPacket + 1) stats.packetGaps++;
+    lastPacket = header.packetSeq;
+
+    size_t off = sizeof(header);
+    for (uint16_t m = 0; m < header.messages; ++m) {
+        if (off >= size) {
+            stats.malformed++;
+            return;
+        }
+        if (data[off] == MD_LEVEL_UPDATE && off + sizeof(MdLevelUpdate) <= size) {
+            MdLevelUpdate u;
+            std::memcpy(&u, data + off, sizeof(u));
+            applyUpdate(u, books, stats);
+            off += sizeof(u);
+        } else if (data[off] == MD_SNAPSHOT && off + sizeof(MdSnapshot) <= size) {
+            MdSnapshot s;
+            std::memcpy(&s, data + off, sizeof(s));
+            size_t levelBytes = (size_t(s.bidLevels) + s.askLevels) * sizeof(MdSnapshotLevel);
+            if (off + sizeof(s) + levelBytes > size) {
+                stats.malformed++;
+                return;
+            }
+            std::vector<MdSnapshotLevel> levels(s.bidLevels + s.askLevels);
+            if (!levels.empty()) std::memcpy(levels.data(), data + off + sizeof(s), levelBytes);
+            applySnapshot(s, levels.data(), books, stats);
+            off += sizeof(s) + levelBytes;
+        } else {
+            stats.malformed++;
+            return;
+        }
+    }
+}
+
+
+static void usage(const char* prog) {
+    std::cerr << "usage: " << prog << " <group:port> [--interface ip] [--symbols list|file] [--seconds n]\n"
+              << "listens until ctrl+c (or for --seconds), then prints feed statistics and the top of every book.\n"
+              << "--interface is where the group is joined (default 127.0.0.1), --symbols the same list server_main\n"
+              << "got so books are shown by name.\n";
+}
+
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || argv[1][0] == '-') {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    sockaddr_in group;
+    if (!parseEndpoint(argv[1], group)) {
+        std::cerr << "invalid address: " << argv[1] << "\n";
+        return EXIT_FAILURE;
+    }
+    std::string interfaceIp = "127.0.0.1";
+    std::string symbolSpec;
+    double seconds = 0;
+    try {
+        for (int i = 2; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--interface" && i + 1 < argc) interfaceIp = argv[++i];
+            else if (arg == "--symbols" && i + 1 < argc) symbolSpec = argv[++i];
+            else if (arg == "--seconds" && i + 1 < argc) seconds = std::stod(argv[++i]);
+            else {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+    } catch (const std::exception &e) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    SymbolTable symbols;
+    if (!symbolSpec.empty() && !symbols.load(symbolSpec)) {
+        std::cerr << "no usable symbols in " << symbolSpec << "\n";
+        return EXIT_FAILURE;
+    }
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        std::cerr << "could not create socket: " << strerror(errno) << "\n";
+        return EXIT_FAILURE;
+    }
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)); //several listeners on one host
+    int rcvbuf = 8 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    sockaddr_in local = group;
+    if (IN_MULTICAST(ntohl(group.sin_addr.s_addr))) local.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) < 0) {
+        std::cerr << "could not bind to port " << ntohs(group.sin_port) << ": " << strerror(errno) << "\n";
+        return EXIT_FAILURE;
+    }
+    if (IN_MULTICAST(ntohl(group.sin_addr.s_addr))) {
+        ip_mreq join;
+        join.imr_multiaddr = group.sin_addr;
+        if (inet_pton(AF_INET, interfaceIp.c_str(), &join.imr_interface) != 1 ||
+            setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &join, sizeof(join)) < 0) {
+            std::cerr << "could not join " << argv[1] << " on " << interfaceIp << ": " << strerror(errno) << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    signal(SIGINT, handleSignal);
+    signal(SIGTERM, handleSignal);
+    std::cout << "listening on " << argv[1] << "\n";
+
+    std::vector<LocalBook> books(symbols.size());
+    Stats stats;
+    uint64_t lastPacket = 0;
+    std::vector<uint8_t> buffer(65536);
+    auto start = std::chrono::steady_clock::now();
+    while (!stopRequested) {
+        if (seconds > 0 && std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() >= seconds) break;
+        pollfd p = {fd, POLLIN, 0};
+        if (poll(&p, 1, 100) <= 0) continue;
+        ssize_t n;
+        while ((n = recv(fd, buffer.data(), buffer.size(), MSG_DONTWAIT)) > 0) {
+            handlePacket(buffer.data(), static_cast<size_t>(n), lastPacket, books, stats);
+        }
+    }
+    close(fd);
+
+    std::cout << stats.packets << " packets (" << stats.packetGaps << " gaps, " << stats.malformed << " malformed), "
+              << stats.updates << " level updates (" << stats.seqGaps << " sequence gaps), " << stats.snapshots << " snapshots ("
+              << stats.resyncs << " resyncs, " << stats.snapshotMismatches << " of " << stats.snapshotChecks
+              << " checks disagreed with the book)\n";
+    for (uint32_t symbol = 0; symbol < books.size(); ++symbol) {
+        const LocalBook &book = books[symbol];
+        if (!book.seen) continue;
+        std::cout << (symbol < symbols.size() ? symbols.name(symbol) : "symbol " + std::to_string(symbol)) << ": ";
+        if (!book.synced) {
+            std::cout << "waiting for a snapshot\n";
+            continue;
+        }
+        if (book.bids.empty()) std::cout << "no bids";
+        else std::cout << book.bids.begin()->second.quantity << " @ " << book.bids.begin()->first;
+        std::cout << " / ";
+        if (book.asks.empty()) std::cout << "no asks";
+        else std::cout << book.asks.begin()->second.quantity << " @ " << book.asks.begin()->first;
+        std::cout << " (" << book.bids.size() << " bid, " << book.asks.size() << " ask levels, seq " << book.seq << ")\n";
+    }
+    return stats.snapshotMismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,118 @@
+#include "memoryconfig.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sys/mman.h>
+
+
+int lockAllMemory() {
+    return mlockall(MCL_CURRENT | MCL_FUTURE) == 0 ? 0 : errno;
+}
+
+
+
+size_t prefaultMemory(void* p, size_t bytes) {
+    static const size_t PAGE = 4096;
+    volatile char* base = static_cast<volatile char*>(p);
+    for (size_t off = 0; off < bytes; off += PAGE) base[off] = base[off];
+    if (bytes > 0) base[bytes - 1] = base[bytes - 1];
+    return bytes;
+}
+
+
+
+//"[never]" in the sysfs setting means madvise(MADV_HUGEPAGE) is accepted but does nothing
+static bool transparentHugePagesUsable() {
+    static const bool usable = [] {
+        std::ifstream setting("/sys/kernel/mm/transparent_hugepage/enabled");
+        std::string line;
+        return std::getline(setting, line) && line.find("[never]") == std::string::npos;
+    }();
+    return usable;
+}
+
+
+
+static inline size_t roundUp(size_t bytes, size_t page) {
+    return (bytes + page - 1) / page * page;
+}
+
+
+
+int PageBuffer::allocate(size_t bytes, HugePagePolicy policy) {
+    release();
+    if (bytes == 0) bytes = 1;
+
+    if (policy == HUGE_PAGES_EXPLICIT) {
+        size_t len = roundUp(bytes, HUGE_PAGE_SIZE);
+        void* p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            base = p;
+            length = len;
+            backing = PAGES_EXPLICIT_HUGE;
+            return 0;
+        }
+        //no reserved pages left (or none configured), transparent ones are the next best thing
+        policy = HUGE_PAGES_TRANSPARENT;
+    }
+
+    if (policy == HUGE_PAGES_TRANSPARENT && transparentHugePagesUsable()) {
+        //khugepaged and the fault path only use huge pages for 2MB aligned ranges, so map one page
+        //extra and trim the ends until the start is aligned
+        size_t len = roundUp(bytes, HUGE_PAGE_SIZE);
+        void* p = mmap(nullptr, len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p != MAP_FAILED) {
+            uintptr_t start = reinterpret_cast<uintptr_t>(p);
+            uintptr_t aligned = roundUp(start, HUGE_PAGE_SIZE);
+            if (aligned > start) munmap(p, aligned - start);
+            munmap(reinterpret_cast<void*>(aligned + len), start + HUGE_PAGE_SIZE - aligned);
+            base = reinterpret_cast<void*>(aligned);
+            length = len;
+            backing = madvise(base, length, MADV_HUGEPAGE) == 0 ? PAGES_TRANSPARENT_HUGE : PAGES_SMALL;
+            return 0;
+        }
+    }
+
+    size_t len = roundUp(bytes, 4096);
+    void* p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        std::cerr << "could not map " << bytes << " bytes: " << strerror(errno) << "\n";
+        return 1;
+    }
+    base = p;
+    length = len;
+    backing = PAGES_SMALL;
+    return 0;
+}
+
+
+
+void PageBuffer::release() {
+    if (base != nullptr) munmap(base, length);
+    base = nullptr;
+    length = 0;
+    backing = PAGES_NONE;
+}
+
+
+
+bool parseHugePagePolicy(const std::string &name, HugePagePolicy &out) {
+    if (name == "off") out = HUGE_PAGES_OFF;
+    else if (name == "thp") out = HUGE_PAGES_TRANSPARENT;
+    else if (name == "explicit") out = HUGE_PAGES_EXPLICIT;
+    else return false;
+    return true;
+}
+
+
+
+const char* pageBackingName(PageBacking backing) {
+    switch (backing) {
+        case PAGES_SMALL: return "4KB pages";
+        case PAGES_TRANSPARENT_HUGE: return "transparent huge pages";
+        case PAGES_EXPLICIT_HUGE: return "explicit huge pages";
+        default: return "none";
+    }
+}
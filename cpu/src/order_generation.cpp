@@ -5,33 +5,66 @@
 #include <iostream> 
 #include "orderbook.h"
 #include "utilities.h"
+#include "workload.h"
 
 
 
 int main(int argc, char** argv) {
 
-    // usage: ./order_generator [num_orders] [file_name]
+    // usage: ./order_generator [num_orders] [file_name] [--compress] [--profile name] [--seed n] [--symbols n]
     // example: ./order_generator 5000000 orders.bin
+    // --profile writes one of the seeded benchmark workloads (with cancels and modifies) instead of
+    // unseeded uniform new orders
 
     if (argc < 3) {
-        std::cerr << "usage: " << argv[0] << " [num_orders] [file_name]\n";
+        std::cerr << "usage: " << argv[0] << " [num_orders] [file_name] [--compress] [--profile name] [--seed n] [--symbols n]\n"
+                  << "--compress writes delta/varint encoded blocks instead of fixed-size records.\n"
+                  << "profiles:\n";
+        for (const WorkloadProfile &p : workloadProfiles()) std::cerr << "  " << p.name << ": " << p.description << "\n";
         return 1;
     }
 
     size_t num_orders;
+    WorkloadSpec spec;
+    spec.profile.clear();
+    bool compress = false;
     try {
         num_orders = static_cast<size_t>(std::stoull(argv[1]));
+        for (int i = 3; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--compress") compress = true;
+            else if (arg == "--profile" && i + 1 < argc) spec.profile = argv[++i];
+            else if (arg == "--seed" && i + 1 < argc) spec.seed = std::stoull(argv[++i]);
+            else if (arg == "--symbols" && i + 1 < argc) spec.symbols = static_cast<uint32_t>(std::stoul(argv[++i]));
+            else {
+                std::cerr << "unknown option: " << arg << "\n";
+                return 1;
+            }
+        }
     } catch (const std::exception &e) {
-        std::cerr << "invalid number of orders: " << argv[1] << "\n";
+        std::cerr << "invalid number: " << e.what() << "\n";
         return 1;
     }
 
     std::string file_name = argv[2];
 
 
-    auto orders = generateRandomOrders(num_orders);
+    std::vector<Order> orders;
+    std::vector<std::string> symbols;
+    if (spec.profile.empty()) {
+        orders = generateRandomOrders(num_orders);
+    } else {
+        spec.count = num_orders;
+        if (!generateWorkload(spec, orders)) {
+            std::cerr << "unknown profile: " << spec.profile << "\n";
+            return 1;
+        }
+        uint32_t used = 0;
+        for (const Order &o : orders) used = std::max(used, o.symbol + 1);
+        for (uint32_t s = 0; used > 1 && s < used; ++s) symbols.push_back("SYM" + std::to_string(s)); //server_main --symbols SYM0,SYM1,..
+    }
 
-    bool success = saveOrdersToFile(file_name, orders);
+    bool success = saveOrdersToFile(file_name, orders, compress, symbols);
     if (!success) {
         std::cerr << "could not save orders to file: " << file_name << "\n";
         return 1;
@@ -2,180 +2,372 @@
 
 
 int OrderBook::initialize() { //gets everything ready
-    bids.clear();
-    bids.resize(PRICE_RANGE);
-    
-    asks.clear();
-    asks.resize(PRICE_RANGE);
-
-    bestBidIndex = -1, bestAskIndex = -1;
-
-    //open log file
-    logFile.open(log_file_name, std::ios::out | std::ios::binary);
-    if (!logFile) {
-        std::cerr << "could not open log file " << log_file_name << "\n";
+    if (bids.initialize(MIN_PRICE, MAX_PRICE, ladderWindow, true, hugePages) != 0 ||
+        asks.initialize(MIN_PRICE, MAX_PRICE, ladderWindow, false, hugePages) != 0) {
+        std::cerr << "could not initialize price ladders\n";
         return 1;
     }
-    latencyLog.clear();
-    latencyLog.reserve(BATCH_SIZE); 
+
+    bestBidPrice = -1, bestAskPrice = -1;
+
+    //every resting order comes out of this slab, so nothing is allocated while matching
+    if (pool.initialize(poolCapacity, hugePages) != 0) {
+        std::cerr << "could not initialize order pool\n";
+        return 1;
+    }
+    if (orderIndex.initialize(poolCapacity, hugePages) != 0) {
+        std::cerr << "could not initialize order index\n";
+        return 1;
+    }
+
+    //register the trace file, an empty name keeps latencies in the report only.
+    //a standalone book blocks rather than drops when its logger falls behind, so its trace is complete
+    logStream = -1;
+    if (!log_file_name.empty()) {
+        if (logger == nullptr || logger == ownLogger.get()) {
+            if (ownLogger) ownLogger->stop();
+            ownLogger.reset(new AsyncLogger());
+            ownLogger->initialize(1, TRACE_RING_CAPACITY, 1, LOG_BLOCK);
+            ownLogger->start();
+            logger = ownLogger.get();
+            logProducer = 0;
+        }
+        logStream = logger->openStream(log_file_name);
+        if (logStream < 0) {
+            std::cerr << "could not open log file " << log_file_name << "\n";
+            return 1;
+        }
+    }
+    traceCountdown = traceEvery;
 
     //get report stats ready
-    totalLatencySum = 0;
+    latencyHistogram.reset();
     totalOrdersProcessed = 0;
-    minLatency = std::numeric_limits<long long>::max();
-    maxLatency = std::numeric_limits<long long>::lowest();
-
+    rejectedOrders = 0;
+    cancelledOrders = 0;
+    modifiedOrders = 0;
+    unknownOrderIds = 0;
+    unfilledOrders = 0;
+    postOnlyRejects = 0;
 
     return 0;
 }
 
 
 
-void OrderBook::flushLatencyData() {
-    if (!logFile.is_open()) return;
-    logFile.write(reinterpret_cast<const char*>(latencyLog.data()), latencyLog.size() * sizeof(long long));
-    logFile.flush(); 
-    latencyLog.clear();
+size_t OrderBook::prefault() {
+    return pool.prefault() + orderIndex.prefault();
 }
 
 
 
+void OrderBook::enableEvents(bool enabled) {
+    eventsEnabled = enabled;
+    eventBuffer.clear();
+    if (enabled) eventBuffer.reserve(EVENT_BUFFER_RESERVE);
+}
+
+
+
+size_t OrderBook::depth(bool bid_side, size_t n, std::vector<DepthLevel> &out) const {
+    out.clear();
+    return bid_side ? bids.depth(n, out) : asks.depth(n, out);
+}
+
+
+
+void OrderBook::enableLevelDeltas(bool enabled) {
+    levelsEnabled = enabled;
+    levelBuffer.clear();
+    if (enabled) levelBuffer.reserve(EVENT_BUFFER_RESERVE);
+}
+
+
+
+
+
+bool OrderBook::insert(const Order& order) { //adds order to orderbook
+    int price = order.price;
+    if (price < MIN_PRICE || price > MAX_PRICE) { //price is off the ladder, nowhere to rest it
+        rejectedOrders++;
+        return false;
+    }
 
+    uint32_t node = pool.allocate(order);
+    if (node == OrderPool::NIL) { //pool exhausted, drop the remainder instead of allocating
+        rejectedOrders++;
+        return false;
+    }
+    if (!orderIndex.insert(order.id, order.session, node)) { //id is already resting for this session, or is 0
+        pool.release(node);
+        rejectedOrders++;
+        return false;
+    }
 
-void OrderBook::insert(const Order& order) { //adds order to orderbook
-    //int idx = priceToIndex(order.price);
-    int idx = order.price - MIN_PRICE;
-    if (order.buy) { //add order, update index
-        bids[idx].push_back(order);
-        if (bestBidIndex == -1 || idx > bestBidIndex) bestBidIndex = idx;
+    PriceLevel &level = order.buy ? bids.acquire(price) : asks.acquire(price);
+    pool.pushBack(level, node);
+    adjustLevel(level, order.buy, price, order.quantity, 1);
+    if (order.buy) { //update best price
+        if (bestBidPrice == -1 || price > bestBidPrice) bestBidPrice = price;
     }
     else {
-        asks[idx].push_back(order);
-        if (bestAskIndex == -1 || idx < bestAskIndex) bestAskIndex = idx;
+        if (bestAskPrice == -1 || price < bestAskPrice) bestAskPrice = price;
     }
+    return true;
 }
 
 
 
 
 void OrderBook::cleanup() { //cleans up levels
-    //decrement index until you find non empty bids index
-    while (bestBidIndex >= 0 && bids[bestBidIndex].empty()) bestBidIndex--;
-    //increment until we find non empty asks index
-    while (bestAskIndex >= 0 && bestAskIndex < PRICE_RANGE && asks[bestAskIndex].empty()) {
-        bestAskIndex++;
-        if (bestAskIndex >= PRICE_RANGE) {
-            bestAskIndex = -1; // no asks
-            break;
-        }
-    } 
+    //emptied levels have already been released from the ladders, so the best prices are a few word scans
+    //(or a map end) away no matter how far apart the remaining levels are
+    bestBidPrice = bids.best();
+    bestAskPrice = asks.best();
 }
 
 
 
 
 void OrderBook::finalize_log() { //flushes remaining log, called at the end of the program lifecycle
-    if (!latencyLog.empty()) flushLatencyData();
-    if (logFile.is_open()) logFile.close();
+    if (ownLogger) ownLogger->stop();
+}
+
+
+
+void OrderBook::removeResting(uint32_t node) {
+    const Order &resting = pool[node].order;
+    int price = resting.price;
+    orderIndex.erase(resting.id, resting.session);
+
+    if (resting.buy) {
+        PriceLevel &level = bids.at(price);
+        adjustLevel(level, true, price, -resting.quantity, -1);
+        pool.unlink(level, node);
+        if (level.empty()) {
+            bids.release(price);
+            if (price == bestBidPrice) cleanup();
+        }
+    } else {
+        PriceLevel &level = asks.at(price);
+        adjustLevel(level, false, price, -resting.quantity, -1);
+        pool.unlink(level, node);
+        if (level.empty()) {
+            asks.release(price);
+            if (price == bestAskPrice) cleanup();
+        }
+    }
+}
+
+
+
+
+bool OrderBook::cancel(uint64_t order_id, uint32_t session) {
+    uint32_t node = orderIndex.find(order_id, session);
+    if (node == OrderIndex::NOT_FOUND) {
+        unknownOrderIds++;
+        emit(EXEC_REJECTED, order_id, session, false, 0, 0);
+        return false;
+    }
+
+    Order cancelled = pool[node].order;
+    removeResting(node);
+    emit(EXEC_CANCELLED, cancelled.id, cancelled.session, cancelled.buy, cancelled.price, cancelled.quantity);
+
+    cancelledOrders++;
+    return true;
+}
+
+
+
+
+bool OrderBook::modify(uint64_t order_id, int new_quantity, int new_price, uint32_t session) {
+    uint32_t node = orderIndex.find(order_id, session);
+    if (node == OrderIndex::NOT_FOUND) {
+        unknownOrderIds++;
+        emit(EXEC_REJECTED, order_id, session, false, 0, 0);
+        return false;
+    }
+
+    Order &resting = pool[node].order;
+    if (new_price == 0) new_price = resting.price;
+
+    if (new_quantity <= 0) { //modifying down to nothing is a cancel
+        cancel(order_id, session);
+        return true;
+    }
+
+    modifiedOrders++;
+
+    //shrinking in place keeps time priority
+    if (new_price == resting.price && new_quantity <= resting.quantity) {
+        PriceLevel &level = resting.buy ? bids.at(resting.price) : asks.at(resting.price);
+        adjustLevel(level, resting.buy, resting.price, new_quantity - resting.quantity, 0);
+        resting.quantity = new_quantity;
+        emit(EXEC_MODIFIED, resting.id, resting.session, resting.buy, resting.price, resting.quantity);
+        return true;
+    }
+
+    //a new price or more size goes to the back of the queue, and may trade on the way in.
+    //it keeps its type, so a post-only order moved across the spread is rejected (and gone)
+    Order replacement = resting;
+    replacement.action = ORDER_NEW;
+    replacement.price = new_price;
+    replacement.quantity = new_quantity;
+    removeResting(node);
+    match(replacement, EXEC_MODIFIED);
+    return true;
 }
 
 
 
+
 void OrderBook::process(Order &order) {
 
-    auto start = std::chrono::steady_clock::now();
+    uint64_t start = clockNow();
+
+    switch (order.action) {
+        case ORDER_CANCEL: cancel(order.id, order.session); break;
+        case ORDER_MODIFY: modify(order.id, order.quantity, order.price, order.session); break;
+        default: match(order, EXEC_ACCEPTED); break;
+    }
+
+    uint64_t end = clockNowOrdered();
+    long long latency = ticksToNanos(end - start);
+    latencyHistogram.record(latency);
+    totalOrdersProcessed++;
+
+    //sampled raw trace, a copy into the logger's ring
+    if (logStream >= 0 && --traceCountdown == 0) {
+        traceCountdown = traceEvery;
+        logger->log(logProducer, static_cast<uint32_t>(logStream), &latency, sizeof(latency));
+    }
+
+}
+
+
+
+
+void OrderBook::match(Order &order, uint8_t doneType) {
+
+    if (order.type >= ORDER_TYPE_COUNT || order.id == 0 || //0 is reserved, the index could never find it again
+        orderIndex.find(order.id, order.session) != OrderIndex::NOT_FOUND) { //this session already has the id resting
+        rejectedOrders++;
+        emit(EXEC_REJECTED, order.id, order.session, order.buy, order.price, order.quantity);
+        return;
+    }
+
+    //the worst price the order may trade at. a market order takes whatever is there
+    int limit = order.price;
+    if (order.type == ORDER_MARKET) limit = order.buy ? std::numeric_limits<int>::max() : std::numeric_limits<int>::min();
+
+    if (order.type == ORDER_POST_ONLY) {
+        bool crosses = order.buy ? (bestAskPrice != -1 && limit >= bestAskPrice) : (bestBidPrice != -1 && limit <= bestBidPrice);
+        if (crosses) {
+            postOnlyRejects++;
+            emit(EXEC_REJECTED, order.id, order.session, order.buy, order.price, order.quantity);
+            return;
+        }
+    } else if (order.type == ORDER_FOK) {
+        //the level totals answer "is there enough" without touching a single resting order
+        const PriceLadder &other = order.buy ? asks : bids;
+        if (other.quantityThrough(limit, order.quantity) < order.quantity) {
+            unfilledOrders++;
+            emit(EXEC_CANCELLED, order.id, order.session, order.buy, order.price, order.quantity);
+            return;
+        }
+    }
 
     if (order.buy) { //buy order, try to match with sell orders 
-        while (order.quantity > 0 && bestAskIndex != -1) {
-            int askPrice = MIN_PRICE + bestAskIndex; 
+        while (order.quantity > 0 && bestAskPrice != -1) {
+            int askPrice = bestAskPrice; 
             
             // check if buy price >= ask price. if so, we can immediately match the order
-            if (order.price >= askPrice) {
-                auto &askQueue = asks[bestAskIndex]; //get corresponding index for best sell price
+            if (limit >= askPrice) {
+                PriceLevel &askQueue = asks.at(askPrice); //get the level for the best sell price
+                int levelTraded = 0, levelEmptied = 0;
                 
                 // match with orders at this price index until order is filled or no asks left at this price
                 while (order.quantity > 0 && !askQueue.empty()) {
-                    Order &topAsk = askQueue.front();
+                    Order &topAsk = pool[askQueue.head].order;
                     
                     int tradedQty = std::min(order.quantity, topAsk.quantity);
-                    //TODO: LOG HERE
+                    emitTrade(order, topAsk, askPrice, tradedQty);
                     order.quantity -= tradedQty;
                     topAsk.quantity -= tradedQty;
+                    levelTraded += tradedQty;
                     
                     //remove top ask if there are no more sellers at this price
                     if (topAsk.quantity == 0) {
-                        askQueue.pop_front();
+                        orderIndex.erase(topAsk.id, topAsk.session);
+                        pool.popFront(askQueue);
+                        levelEmptied++;
                     }
                 }
+                adjustLevel(askQueue, false, askPrice, -levelTraded, -levelEmptied);
+                if (askQueue.empty()) asks.release(askPrice);
 
-                //move bestBidIndex and bestAskIndex if needed
+                //move bestBidPrice and bestAskPrice if needed
                 cleanup();
                 
             } else break;
         }
 
-        // add to bids if there is still any of the order left
-        if (order.quantity > 0) insert(order);
-
-
     } else { //sell order, try to match with buy orders 
         
-        while (order.quantity > 0 && bestBidIndex != -1) {
-            int bidPrice = MIN_PRICE + bestBidIndex;
+        while (order.quantity > 0 && bestBidPrice != -1) {
+            int bidPrice = bestBidPrice;
 
             // check if sell price <= bid price. if so, we can immediately match the order
-            if (order.price <= bidPrice) {
-                auto &bidQueue = bids[bestBidIndex];
+            if (limit <= bidPrice) {
+                PriceLevel &bidQueue = bids.at(bidPrice);
+                int levelTraded = 0, levelEmptied = 0;
 
                 while (order.quantity > 0 && !bidQueue.empty()) {
-                    Order &topBid = bidQueue.front();
+                    Order &topBid = pool[bidQueue.head].order;
 
                     int tradedQty = std::min(order.quantity, topBid.quantity);
-
-                    //TODO: LOG HERE
+                    emitTrade(order, topBid, bidPrice, tradedQty);
                     order.quantity -= tradedQty;
                     topBid.quantity -= tradedQty;
+                    levelTraded += tradedQty;
 
-                    if (topBid.quantity == 0) bidQueue.pop_front();
+                    if (topBid.quantity == 0) {
+                        orderIndex.erase(topBid.id, topBid.session);
+                        pool.popFront(bidQueue);
+                        levelEmptied++;
+                    }
                 }
+                adjustLevel(bidQueue, true, bidPrice, -levelTraded, -levelEmptied);
+                if (bidQueue.empty()) bids.release(bidPrice);
 
-                //move bestBidIndex and bestAskIndex if needed
+                //move bestBidPrice and bestAskPrice if needed
                 cleanup(); 
 
             } else break;
         }
-
-        // add to asks if there is still any of the order left
-        if (order.quantity > 0) insert(order);
     }
 
-    auto end = std::chrono::steady_clock::now();
-    long long latency = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
-    latencyLog.push_back(latency);
-
-    //for average latency
-    totalLatencySum += latency;
-    totalOrdersProcessed++;
-    
-    //update min and max latencies
-    if (latency < minLatency) minLatency = latency;
-    if (latency > maxLatency) maxLatency = latency;
+    //ioc, fok and market orders never rest, what they couldn't trade is cancelled
+    bool rests = (order.type == ORDER_LIMIT || order.type == ORDER_POST_ONLY);
+    if (order.quantity > 0 && !rests) {
+        unfilledOrders++;
+        emit(EXEC_CANCELLED, order.id, order.session, order.buy, order.price, order.quantity);
+        return;
+    }
 
-    if (latencyLog.size() >= BATCH_SIZE) flushLatencyData(); //flush data if necessary
-    
+    // rest whatever is left, then tell the owner how the order ended up
+    if (order.quantity > 0 && !insert(order)) {
+        emit(EXEC_REJECTED, order.id, order.session, order.buy, order.price, order.quantity);
+        return;
+    }
+    emit(doneType, order.id, order.session, order.buy, order.price, order.quantity);
 }
 
 
 
 
 void OrderBook::writeReport(const std::string &report_filename) {
-
-    //avoid division by zero
-    double averageLatency = 0.0;
-    if (totalOrdersProcessed > 0) {
-        averageLatency = static_cast<double>(totalLatencySum) / static_cast<double>(totalOrdersProcessed);
-    }
-
     std::ofstream reportFile(report_filename, std::ios::out);
     if (!reportFile) {
         std::cerr << "could not open report file " << report_filename << "\n";
@@ -184,12 +376,36 @@ void OrderBook::writeReport(const std::string &report_filename) {
 
     reportFile << "OrderBook Processing Report\n";
     reportFile << "-----------------------\n";
+    writeReport(reportFile);
+    reportFile.close();
+}
+
+
+
+void OrderBook::writeReport(std::ostream &reportFile) {
     reportFile << "Total Orders Processed: " << totalOrdersProcessed << "\n";
-    reportFile << "Average Latency (ns): " << averageLatency << "\n";
-    if (totalOrdersProcessed > 0) {
-        reportFile << "Min Latency (ns): " << minLatency << "\n";
-        reportFile << "Max Latency (ns): " << maxLatency << "\n";
+    latencyHistogram.writeSummary(reportFile);
+    reportFile << "Resting Orders: " << pool.inUse() << " (pool capacity " << pool.capacity() << ")\n";
+    reportFile << "Rejected Orders: " << rejectedOrders << "\n";
+    reportFile << "Cancelled Orders: " << cancelledOrders << "\n";
+    reportFile << "Modified Orders: " << modifiedOrders << "\n";
+    reportFile << "Cancels/Modifies With Unknown Id: " << unknownOrderIds << "\n";
+    reportFile << "IOC/FOK/Market Orders Cancelled Unfilled: " << unfilledOrders << "\n";
+    reportFile << "Post-Only Orders Rejected: " << postOnlyRejects << "\n";
+    if (ownLogger) {
+        reportFile << "Latency Trace: " << ownLogger->written() << " samples written, "
+                   << ownLogger->dropped() << " dropped\n";
     }
-    reportFile.close();
+    if (bids.dense()) {
+        reportFile << "Price Ladder: dense\n";
+    } else {
+        reportFile << "Price Ladder: window of " << bids.windowWidth() << " prices, "
+                   << bids.overflowLevels() + asks.overflowLevels() << " levels outside it, "
+                   << bids.recenterCount() + asks.recenterCount() << " re-centers\n";
+    }
+    reportFile << "Memory Backing: pool " << pageBackingName(pool.backing()) << ", index " << pageBackingName(orderIndex.backing())
+               << ", ladders " << pageBackingName(bids.backing());
+    if (asks.backing() != bids.backing()) reportFile << " (asks " << pageBackingName(asks.backing()) << ")";
+    reportFile << "\n";
 }
 
@@ -11,28 +11,32 @@
 // Include the OrderBook class and utilities
 #include "orderbook.h"
 #include "utilities.h"
+#include "clock.h"
 
 
 
 
 int main(int argc, char *argv[]) {
     // Check for correct usage
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <orders_file>\n";
+    OrderFileMode read_mode = ORDER_FILE_MMAP;
+    if ((argc != 2 && argc != 4) || (argc == 4 && (std::string(argv[2]) != "--read" || !OrderFileReader::parseMode(argv[3], read_mode)))) {
+        std::cerr << "Usage: " << argv[0] << " <orders_file> [--read mmap|stream]\n";
         std::cerr << "Example: " << argv[0] << " orders.bin\n";
+        std::cerr << "mmap (the default) replays straight out of the mapped file, stream reads it in chunks.\n";
         return EXIT_FAILURE;
     }
 
     std::string orders_file = argv[1];
 
-    //load orders from binary file
-    std::vector<Order> orders;
-    if (!loadOrdersFromFile(orders_file, orders)) {
-        std::cerr << "Error: Failed to load orders from file: " << orders_file << "\n";
+    //orders are read as they are replayed, nothing is loaded up front
+    OrderFileReader orders;
+    if (orders.open(orders_file, read_mode) != 0) {
+        std::cerr << "Error: Failed to open orders file: " << orders_file << "\n";
         return EXIT_FAILURE;
     }
 
-    std::cout << "Loaded " << orders.size() << " orders from " << orders_file << "\n";
+    std::cout << "Replaying " << orders.size() << " orders from " << orders_file
+              << (orders.fileMode() == ORDER_FILE_MMAP ? " (mmap)" : " (stream)") << "\n";
 
 
     auto now = std::chrono::system_clock::now();
@@ -40,6 +44,7 @@ int main(int argc, char *argv[]) {
     auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(epoch).count();
 
     std::string session_id = std::to_string(millis);
+    calibrateClock(); //before the book takes timestamps
     std::string log_file = "latencies_" + session_id + ".bin";
 
     OrderBook ob(log_file);
@@ -55,7 +60,8 @@ int main(int argc, char *argv[]) {
     int orders_processed = 0;
 
 
-    for (auto &order : orders) {
+    Order order;
+    while (orders.next(order)) {
         ob.process(order);
         orders_processed++;
     }
@@ -67,7 +73,7 @@ int main(int argc, char *argv[]) {
     double total_seconds = duration.count();
     double average_latency = (orders_processed > 0) ? (total_seconds / orders_processed) : 0.0;
 
-    std::cout << "Processed " << orders_processed << " orders in " << total_seconds << " seconds.\n";
+    std::cout << "Processed " << orders_processed << " orders in " << total_seconds << " seconds (reading included).\n";
     std::cout << "Average latency per order: " << average_latency * 1e6 << " microseconds.\n";
 
     ob.finalize_log();
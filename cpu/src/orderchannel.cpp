@@ -0,0 +1,109 @@
+#include "orderchannel.h"
+
+
+int OrderChannel::initialize(ChannelMode channel_mode, size_t capacity) {
+    mode = channel_mode;
+    if (mode != CHANNEL_MUTEX) ring.initialize(capacity);
+    parked.store(false);
+    stopped.store(false);
+    return 0;
+}
+
+
+
+void OrderChannel::push(const Order& order) {
+    //ring full means the matching thread is behind, apply backpressure instead of dropping
+    while (!tryPush(order)) {
+        if (stopped.load(std::memory_order_relaxed)) return;
+        cpuRelax();
+    }
+}
+
+
+
+bool OrderChannel::tryPush(const Order& order) {
+    if (mode == CHANNEL_MUTEX) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push(order);
+        }
+        cv.notify_one();
+        return true;
+    }
+
+    if (!ring.tryPush(order)) return false;
+
+    if (mode == CHANNEL_HYBRID) {
+        //pairs with the fence in park(): either we see parked, or the consumer sees our order
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (parked.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(mutex);
+            cv.notify_one();
+        }
+    }
+    return true;
+}
+
+
+
+bool OrderChannel::park() {
+    std::unique_lock<std::mutex> lock(mutex);
+    parked.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    cv.wait(lock, [this] { return !ring.empty() || stopped.load(); });
+    parked.store(false, std::memory_order_relaxed);
+    return !ring.empty() || !stopped.load();
+}
+
+
+
+bool OrderChannel::pop(Order& order) {
+    if (mode == CHANNEL_MUTEX) {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this] { return !queue.empty() || stopped.load(); });
+        if (queue.empty()) return false; //stopped and drained
+        order = queue.front();
+        queue.pop();
+        return true;
+    }
+
+    int spins = 0;
+    while (!ring.tryPop(order)) {
+        if (stopped.load(std::memory_order_acquire)) return ring.tryPop(order); //one last look after stop
+        if (mode == CHANNEL_HYBRID && ++spins >= SPIN_LIMIT) {
+            if (!park()) return false;
+            spins = 0;
+        } else cpuRelax();
+    }
+    return true;
+}
+
+
+
+void OrderChannel::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopped.store(true);
+    }
+    cv.notify_all();
+}
+
+
+
+bool OrderChannel::parseMode(const std::string& name, ChannelMode& out) {
+    if (name == "mutex") out = CHANNEL_MUTEX;
+    else if (name == "spin") out = CHANNEL_SPIN;
+    else if (name == "hybrid") out = CHANNEL_HYBRID;
+    else return false;
+    return true;
+}
+
+
+
+const char* OrderChannel::modeName(ChannelMode m) {
+    switch (m) {
+        case CHANNEL_SPIN: return "spin";
+        case CHANNEL_HYBRID: return "hybrid";
+        default: return "mutex";
+    }
+}
@@ -0,0 +1,475 @@
+#include "orderfile.h"
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+namespace {
+
+    const uint64_t PAGE = 4096;
+    const uint32_t MAX_BLOCK_RECORDS = 1 << 20;
+
+    //compressed record tag byte: action and side, plus which fields are left out because they
+    //repeat (or continue) the previous record in the block
+    enum : uint8_t {
+        TAG_ACTION = 0x03,      // OrderAction, or TAG_TYPED_NEW
+        TAG_TYPED_NEW = 0x03,   // a new order that isn't a limit order, its type byte follows the tag
+        TAG_BUY = 0x04,
+        TAG_NEXT_ID = 0x08,     // id is the previous id + 1
+        TAG_SAME_SYMBOL = 0x10,
+        TAG_SAME_TIME = 0x20,
+        TAG_SAME_PRICE = 0x40,  // price is the last non-zero price
+        TAG_ZERO_PRICE = 0x80   // cancels, and modifies that keep the price
+    };
+
+    inline uint64_t zigzag(int64_t v) { return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63); }
+
+    inline int64_t unzigzag(uint64_t v) { return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1); }
+
+    inline void putVarint(std::vector<uint8_t> &out, uint64_t v) {
+        while (v >= 0x80) {
+            out.push_back(static_cast<uint8_t>(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(v));
+    }
+
+    inline bool getVarint(const uint8_t* &p, const uint8_t* end, uint64_t &v) {
+        v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (p == end) return false;
+            uint8_t b = *p++;
+            v |= static_cast<uint64_t>(b & 0x7F) << shift;
+            if (b < 0x80) return true;
+        }
+        return false;
+    }
+
+    //what the next record is predicted to look like, reset at every block so blocks decode on their own
+    struct Predictor {
+        uint64_t timestamp = 0;
+        uint64_t id = 0;
+        uint32_t symbol = 0;
+        int32_t price = 0;
+    };
+}
+
+
+
+// ---------------------------------------------------------------- reader
+
+OrderFileReader::~OrderFileReader() {
+    close();
+}
+
+
+
+void OrderFileReader::close() {
+    if (mapped) munmap(const_cast<uint8_t*>(mapped), mappedSize);
+    mapped = nullptr;
+    mappedSize = 0;
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    format = LEGACY;
+    header = OrderFileHeader{};
+    symbolNames.clear();
+    recordCount = consumed = 0;
+    lastTimestamp = 0;
+    fileSize = readOffset = batchOffset = releasedBytes = 0;
+    legacyBatch = nullptr;
+    batch = nullptr;
+    batchSize = batchPos = 0;
+    std::vector<uint64_t>().swap(readBuffer);
+    std::vector<OrderRecord>().swap(decoded);
+}
+
+
+
+int OrderFileReader::fail(const std::string &message) {
+    std::cerr << message << "\n";
+    close();
+    return 1;
+}
+
+
+
+int OrderFileReader::open(const std::string &filename, OrderFileMode file_mode, size_t chunk_records) {
+    close();
+    mode = file_mode;
+    chunkRecords = chunk_records == 0 ? DEFAULT_CHUNK_RECORDS : chunk_records;
+
+    fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return fail("could not open file to read: " + filename + ": " + strerror(errno));
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) return fail("could not stat " + filename);
+    fileSize = static_cast<uint64_t>(st.st_size);
+
+    char first[8];
+    if (pread(fd, first, sizeof(first), 0) != static_cast<ssize_t>(sizeof(first))) return fail("could not read count from file");
+
+    uint64_t dataOffset;
+    if (memcmp(first, ORDER_FILE_MAGIC, sizeof(first)) != 0) {
+        //legacy: the first word is the record count
+        format = LEGACY;
+        size_t count;
+        memcpy(&count, first, sizeof(count));
+        uint64_t available = (fileSize - sizeof(count)) / sizeof(StoredOrder);
+        if (count > available) {
+            return fail("could not read orders from file: header says " + std::to_string(count) +
+                        " orders, file holds " + std::to_string(available));
+        }
+        recordCount = count;
+        dataOffset = sizeof(count);
+    } else {
+        if (pread(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))) return fail("truncated order file header");
+        if (header.version == 0 || header.version > ORDER_FILE_VERSION) {
+            return fail("order file version " + std::to_string(header.version) + " is not supported (newest known is " +
+                        std::to_string(ORDER_FILE_VERSION) + ")");
+        }
+        if (header.recordSize < sizeof(OrderRecord)) return fail("order file records are too small: " + std::to_string(header.recordSize));
+        if (header.symbolBytes > fileSize - sizeof(header)) return fail("truncated order file symbol table");
+
+        std::string names(header.symbolBytes, '\0');
+        if (header.symbolBytes > 0 &&
+            pread(fd, &names[0], names.size(), sizeof(header)) != static_cast<ssize_t>(names.size())) {
+            return fail("could not read order file symbol table");
+        }
+        for (size_t begin = 0; begin < names.size();) {
+            size_t end = names.find('\n', begin);
+            if (end == std::string::npos) end = names.size();
+            symbolNames.push_back(names.substr(begin, end - begin));
+            begin = end + 1;
+        }
+
+        dataOffset = (sizeof(header) + header.symbolBytes + 7) & ~uint64_t(7);
+        recordCount = header.recordCount;
+        if (header.flags & ORDER_FILE_COMPRESSED) {
+            format = BLOCKED;
+            if (header.blockRecords == 0 || header.blockRecords > MAX_BLOCK_RECORDS) {
+                return fail("bad order file block size: " + std::to_string(header.blockRecords));
+            }
+        } else {
+            format = RAW;
+            uint64_t available = (fileSize - std::min(fileSize, dataOffset)) / header.recordSize;
+            if (recordCount > available) {
+                return fail("could not read orders from file: header says " + std::to_string(recordCount) +
+                            " orders, file holds " + std::to_string(available));
+            }
+        }
+    }
+    readOffset = dataOffset;
+
+    if (mode == ORDER_FILE_MMAP && fileSize > 0) {
+        mappedSize = fileSize;
+        void* p = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            std::cerr << "could not map " << filename << " (" << strerror(errno) << "), falling back to streaming\n";
+            mappedSize = 0;
+            mode = ORDER_FILE_STREAM;
+        } else {
+            mapped = static_cast<const uint8_t*>(p);
+            madvise(p, mappedSize, MADV_SEQUENTIAL); //aggressive readahead, pages behind us go first
+        }
+    } else {
+        mode = ORDER_FILE_STREAM;
+    }
+    if (mode == ORDER_FILE_STREAM) posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return 0;
+}
+
+
+
+//the next `bytes` bytes of the file: in place in mmap mode, otherwise read into the one buffer
+//(so the previous fetch's bytes are gone). nullptr if the file ends first
+const uint8_t* OrderFileReader::fetch(size_t bytes) {
+    if (readOffset + bytes > fileSize) {
+        std::cerr << "could not read orders from file: unexpected end of file\n";
+        return nullptr;
+    }
+    const uint8_t* p;
+    if (mapped) {
+        p = mapped + readOffset;
+    } else {
+        if (readBuffer.size() * sizeof(uint64_t) < bytes) readBuffer.resize((bytes + 7) / 8);
+        char* dst = reinterpret_cast<char*>(readBuffer.data());
+        size_t got = 0;
+        while (got < bytes) {
+            ssize_t r = pread(fd, dst + got, bytes - got, readOffset + got);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) {
+                std::cerr << "could not read orders from file: " << (r < 0 ? strerror(errno) : "unexpected end of file") << "\n";
+                return nullptr;
+            }
+            got += static_cast<size_t>(r);
+        }
+        p = reinterpret_cast<const uint8_t*>(dst);
+    }
+    readOffset += bytes;
+    return p;
+}
+
+
+
+bool OrderFileReader::decodeBlock(const uint8_t* p, const uint8_t* end, size_t records) {
+    decoded.resize(records);
+    Predictor last;
+    uint64_t v;
+    for (size_t i = 0; i < records; ++i) {
+        if (p == end) return false;
+        uint8_t tag = *p++;
+        OrderRecord &r = decoded[i];
+        r.action = tag & TAG_ACTION;
+        r.buy = (tag & TAG_BUY) ? 1 : 0;
+        r.type = ORDER_LIMIT;
+        r.reserved = 0;
+        if (r.action == TAG_TYPED_NEW) {
+            if (p == end) return false;
+            r.action = ORDER_NEW;
+            r.type = *p++;
+        }
+
+        if (!(tag & TAG_SAME_TIME)) {
+            if (!getVarint(p, end, v)) return false;
+            last.timestamp += static_cast<uint64_t>(unzigzag(v));
+        }
+        r.timestamp = last.timestamp;
+
+        if (tag & TAG_NEXT_ID) last.id += 1;
+        else {
+            if (!getVarint(p, end, v)) return false;
+            last.id += static_cast<uint64_t>(unzigzag(v));
+        }
+        r.id = last.id;
+
+        if (!(tag & TAG_SAME_SYMBOL)) {
+            if (!getVarint(p, end, v)) return false;
+            last.symbol = static_cast<uint32_t>(v);
+        }
+        r.symbol = last.symbol;
+
+        if (tag & TAG_ZERO_PRICE) r.price = 0;
+        else {
+            if (!(tag & TAG_SAME_PRICE)) {
+                if (!getVarint(p, end, v)) return false;
+                last.price = static_cast<int32_t>(last.price + unzigzag(v));
+            }
+            r.price = last.price;
+        }
+
+        if (!getVarint(p, end, v)) return false;
+        r.quantity = static_cast<int32_t>(unzigzag(v));
+    }
+    return p == end;
+}
+
+
+
+size_t OrderFileReader::nextBatch() {
+    legacyBatch = nullptr;
+    batch = nullptr;
+    if (fd < 0 || consumed >= recordCount) return 0;
+
+    size_t remaining = recordCount - consumed;
+    size_t n = remaining < chunkRecords ? remaining : chunkRecords;
+    batchOffset = readOffset;
+    const uint8_t* p = nullptr;
+
+    switch (format) {
+        case LEGACY:
+            p = fetch(n * sizeof(StoredOrder));
+            legacyBatch = reinterpret_cast<const StoredOrder*>(p);
+            break;
+
+        case RAW:
+            p = fetch(n * header.recordSize);
+            if (p && header.recordSize == sizeof(OrderRecord)) {
+                batch = reinterpret_cast<const OrderRecord*>(p);
+            } else if (p) { //written by a newer version with more fields, keep the ones we know
+                decoded.resize(n);
+                for (size_t i = 0; i < n; ++i) memcpy(&decoded[i], p + i * header.recordSize, sizeof(OrderRecord));
+                batch = decoded.data();
+            }
+            break;
+
+        case BLOCKED: {
+            const uint8_t* h = fetch(sizeof(OrderBlockHeader));
+            if (!h) break;
+            OrderBlockHeader block;
+            memcpy(&block, h, sizeof(block));
+            if (block.records == 0 || block.records > header.blockRecords || block.records > remaining) {
+                std::cerr << "could not read orders from file: bad block of " << block.records << " records\n";
+                break;
+            }
+            p = fetch(block.bytes);
+            if (!p) break;
+            if (!decodeBlock(p, p + block.bytes, block.records)) {
+                std::cerr << "could not read orders from file: corrupt block at record " << consumed << "\n";
+                p = nullptr;
+                break;
+            }
+            n = block.records;
+            batch = decoded.data();
+            break;
+        }
+    }
+
+    if (!p) {
+        recordCount = consumed; //stop here
+        legacyBatch = nullptr;
+        batch = nullptr;
+        return 0;
+    }
+    consumed += n;
+    releaseConsumed();
+    return n;
+}
+
+
+
+//drops everything before the current batch (which must stay valid), so a long replay keeps a
+//constant footprint instead of filling memory with pages it won't touch again
+void OrderFileReader::releaseConsumed() {
+    uint64_t done = batchOffset & ~(PAGE - 1);
+    if (done <= releasedBytes + 64 * PAGE) return; //not worth a syscall yet
+
+    if (mapped) madvise(const_cast<uint8_t*>(mapped) + releasedBytes, done - releasedBytes, MADV_DONTNEED);
+    else posix_fadvise(fd, releasedBytes, done - releasedBytes, POSIX_FADV_DONTNEED);
+    releasedBytes = done;
+}
+
+
+
+bool OrderFileReader::parseMode(const std::string &name, OrderFileMode &out) {
+    if (name == "mmap") out = ORDER_FILE_MMAP;
+    else if (name == "stream") out = ORDER_FILE_STREAM;
+    else return false;
+    return true;
+}
+
+
+
+// ---------------------------------------------------------------- writer
+
+OrderFileWriter::~OrderFileWriter() {
+    if (out.is_open()) close();
+}
+
+
+
+int OrderFileWriter::open(const std::string &filename, bool compress, const std::vector<std::string> &symbols,
+                          uint64_t time_base, uint32_t block_records) {
+    if (out.is_open()) close();
+    fileName = filename;
+    pending.clear();
+
+    std::string names;
+    for (size_t i = 0; i < symbols.size(); ++i) {
+        if (i) names += '\n';
+        names += symbols[i];
+    }
+
+    header = OrderFileHeader{};
+    memcpy(header.magic, ORDER_FILE_MAGIC, sizeof(header.magic));
+    header.version = ORDER_FILE_VERSION;
+    header.recordSize = sizeof(OrderRecord);
+    header.flags = compress ? ORDER_FILE_COMPRESSED : 0;
+    header.timeBase = time_base;
+    header.blockRecords = block_records == 0 ? DEFAULT_BLOCK_RECORDS : std::min(block_records, MAX_BLOCK_RECORDS);
+    header.symbolBytes = static_cast<uint32_t>(names.size());
+
+    out.open(filename, std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!out) {
+        std::cerr << "could not open file to write: " << filename << "\n";
+        return 1;
+    }
+    //the count is filled in by close()
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(names.data(), names.size());
+    static const char zeros[8] = {0};
+    size_t padding = ((sizeof(header) + names.size() + 7) & ~size_t(7)) - (sizeof(header) + names.size());
+    out.write(zeros, padding);
+    return out ? 0 : 1;
+}
+
+
+
+void OrderFileWriter::write(const Order &o, uint64_t timestamp) {
+    OrderRecord r;
+    r.timestamp = timestamp;
+    r.id = o.id;
+    r.symbol = o.symbol;
+    r.price = o.price;
+    r.quantity = o.quantity;
+    r.action = o.action;
+    r.buy = o.buy ? 1 : 0;
+    r.type = (o.action == ORDER_NEW) ? o.type : static_cast<uint8_t>(ORDER_LIMIT);
+    r.reserved = 0;
+    header.recordCount++;
+
+    if (header.flags & ORDER_FILE_COMPRESSED) {
+        pending.push_back(r);
+        if (pending.size() == header.blockRecords) flushBlock();
+    } else {
+        out.write(reinterpret_cast<const char*>(&r), sizeof(r));
+    }
+}
+
+
+
+void OrderFileWriter::flushBlock() {
+    if (pending.empty()) return;
+    encoded.clear();
+    Predictor last;
+    for (const OrderRecord &r : pending) {
+        bool typed = (r.action == ORDER_NEW && r.type != ORDER_LIMIT);
+        uint8_t tag = static_cast<uint8_t>((typed ? TAG_TYPED_NEW : (r.action & TAG_ACTION)) | (r.buy ? TAG_BUY : 0));
+        if (r.timestamp == last.timestamp) tag |= TAG_SAME_TIME;
+        if (r.id == last.id + 1) tag |= TAG_NEXT_ID;
+        if (r.symbol == last.symbol) tag |= TAG_SAME_SYMBOL;
+        if (r.price == 0) tag |= TAG_ZERO_PRICE;
+        else if (r.price == last.price) tag |= TAG_SAME_PRICE;
+        encoded.push_back(tag);
+        if (typed) encoded.push_back(r.type);
+
+        if (!(tag & TAG_SAME_TIME)) putVarint(encoded, zigzag(static_cast<int64_t>(r.timestamp - last.timestamp)));
+        if (!(tag & TAG_NEXT_ID)) putVarint(encoded, zigzag(static_cast<int64_t>(r.id - last.id)));
+        if (!(tag & TAG_SAME_SYMBOL)) putVarint(encoded, r.symbol);
+        if (!(tag & (TAG_ZERO_PRICE | TAG_SAME_PRICE))) {
+            putVarint(encoded, zigzag(static_cast<int64_t>(r.price) - last.price));
+        }
+        putVarint(encoded, zigzag(r.quantity));
+
+        last.timestamp = r.timestamp;
+        last.id = r.id;
+        last.symbol = r.symbol;
+        if (r.price != 0) last.price = r.price;
+    }
+
+    OrderBlockHeader block;
+    block.records = static_cast<uint32_t>(pending.size());
+    block.bytes = static_cast<uint32_t>(encoded.size());
+    out.write(reinterpret_cast<const char*>(&block), sizeof(block));
+    out.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+    pending.clear();
+}
+
+
+
+int OrderFileWriter::close() {
+    if (!out.is_open()) return 1;
+    flushBlock();
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.close();
+    if (!out) {
+        std::cerr << "could not write " << fileName << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,28 @@
+#include "orderindex.h"
+#include "memoryconfig.h"
+#include <iostream>
+
+
+int OrderIndex::initialize(size_t maxEntries, HugePagePolicy huge_pages) {
+    size_t tableSize = 16;
+    while (tableSize < maxEntries * 2) tableSize <<= 1;
+
+    //fresh anonymous pages read as zero, so the table starts empty without touching every page up front
+    if (memory.allocate(tableSize * sizeof(Slot), huge_pages) != 0) {
+        std::cerr << "could not allocate order index of " << tableSize << " slots\n";
+        slots = nullptr;
+        mask = 0;
+        return 1;
+    }
+    slots = static_cast<Slot*>(memory.data());
+
+    mask = tableSize - 1;
+    count = 0;
+    return 0;
+}
+
+
+
+size_t OrderIndex::prefault() {
+    return slots ? prefaultMemory(slots, (mask + 1) * sizeof(Slot)) : 0;
+}
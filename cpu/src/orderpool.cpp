@@ -0,0 +1,33 @@
+#include "orderpool.h"
+#include "memoryconfig.h"
+#include <iostream>
+
+
+int OrderPool::initialize(size_t capacity, HugePagePolicy huge_pages) {
+    if (capacity == 0 || capacity >= NIL) {
+        std::cerr << "invalid order pool capacity " << capacity << "\n";
+        return 1;
+    }
+
+    //nodes are plain data and never read before allocate() writes them, so the mapping is used as is
+    //and the kernel only commits pages as nodes get used
+    if (memory.allocate(capacity * sizeof(OrderNode), huge_pages) != 0) {
+        std::cerr << "could not allocate order pool of " << capacity << " orders\n";
+        nodes = nullptr;
+        poolCapacity = 0;
+        return 1;
+    }
+    nodes = static_cast<OrderNode*>(memory.data());
+
+    poolCapacity = capacity;
+    freeHead = NIL;
+    nextUnused = 0;
+    used = 0;
+    return 0;
+}
+
+
+
+size_t OrderPool::prefault() {
+    return prefaultMemory(nodes, poolCapacity * sizeof(OrderNode));
+}
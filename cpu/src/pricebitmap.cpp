@@ -0,0 +1,15 @@
+#include "pricebitmap.h"
+
+
+void PriceBitmap::initialize(size_t size) {
+    levels.clear();
+
+    //keep adding summary levels until one word covers everything
+    size_t words = (size + 63) / 64;
+    if (words == 0) words = 1;
+    while (true) {
+        levels.emplace_back(words, 0);
+        if (words == 1) break;
+        words = (words + 63) / 64;
+    }
+}
@@ -0,0 +1,87 @@
+#include "priceladder.h"
+#include <new>
+
+
+int PriceLadder::initialize(int min_price, int max_price, int window_size, bool bid_side, HugePagePolicy huge_pages) {
+    int range = max_price - min_price + 1;
+    minPrice = min_price;
+    maxPrice = max_price;
+    windowSize = (window_size <= 0 || window_size > range) ? range : window_size;
+    base = min_price;
+    bidSide = bid_side;
+
+    //an empty level is all ones, so unlike the pool and index the window is written up front
+    if (windowMemory.allocate(static_cast<size_t>(windowSize) * sizeof(PriceLevel), huge_pages) != 0) {
+        window = nullptr;
+        windowSize = 0;
+        return 1;
+    }
+    window = static_cast<PriceLevel*>(windowMemory.data());
+    for (int i = 0; i < windowSize; ++i) new (&window[i]) PriceLevel();
+    occupied.initialize(static_cast<size_t>(windowSize));
+    windowLevels = 0;
+    overflow.clear();
+    recenters = 0;
+    return 0;
+}
+
+
+
+size_t PriceLadder::depth(size_t n, std::vector<DepthLevel> &out) const {
+    size_t count = 0;
+    if (n == 0) return 0;
+    forEachBest([&](int price, const PriceLevel &level) {
+        out.push_back(DepthLevel{price, level.orders, level.quantity});
+        return ++count < n;
+    });
+    return count;
+}
+
+
+
+int64_t PriceLadder::quantityThrough(int limit, int64_t enough) const {
+    int64_t total = 0;
+    forEachBest([&](int price, const PriceLevel &level) {
+        if (bidSide ? price < limit : price > limit) return false;
+        total += level.quantity;
+        return total < enough;
+    });
+    return total;
+}
+
+
+
+int PriceLadder::windowBest() const {
+    int slot = bidSide ? occupied.highest() : occupied.lowest();
+    return (slot == -1) ? -1 : base + slot;
+}
+
+
+
+void PriceLadder::recenter(int price) {
+    int newBase = price - windowSize / 2;
+    if (newBase > maxPrice - windowSize + 1) newBase = maxPrice - windowSize + 1;
+    if (newBase < minPrice) newBase = minPrice;
+    if (newBase == base) return;
+
+    //everything in the window goes to the map, then whatever the new window covers comes back.
+    //levels are just head/tail indices into the pool, so moving them leaves the fifos intact
+    int slot;
+    while ((slot = occupied.lowest()) != -1) {
+        overflow[base + slot] = window[static_cast<size_t>(slot)];
+        window[static_cast<size_t>(slot)] = PriceLevel();
+        occupied.clear(slot);
+    }
+    windowLevels = 0;
+    base = newBase;
+
+    auto it = overflow.lower_bound(base);
+    while (it != overflow.end() && it->first - base < windowSize) {
+        slot = it->first - base;
+        window[static_cast<size_t>(slot)] = it->second;
+        occupied.set(slot);
+        windowLevels++;
+        it = overflow.erase(it);
+    }
+    recenters++;
+}
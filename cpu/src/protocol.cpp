@@ -0,0 +1,336 @@
+#include "protocol.h"
+#include <climits>
+
+
+//small cursor helpers for parseTextOrder, none of them allocate
+namespace {
+
+    inline void skipSpace(const char*& p, const char* end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+    }
+
+    inline bool tokenEnds(const char* p, const char* end) {
+        return p == end || *p == ' ' || *p == '\t' || *p == '\r';
+    }
+
+    //next whitespace separated token, false if the line is used up
+    inline bool readWord(const char*& p, const char* end, const char*& word, size_t& len) {
+        skipSpace(p, end);
+        word = p;
+        while (p < end && !tokenEnds(p, end)) ++p;
+        len = static_cast<size_t>(p - word);
+        return len > 0;
+    }
+
+    inline bool wordIs(const char* word, size_t len, const char* literal) {
+        size_t n = std::strlen(literal);
+        return len == n && std::memcmp(word, literal, n) == 0;
+    }
+
+    inline bool readUnsigned(const char*& p, const char* end, unsigned long long& out, int maxDigits) {
+        skipSpace(p, end);
+        const char* first = p;
+        unsigned long long v = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            unsigned long long digit = static_cast<unsigned long long>(*p - '0');
+            if (p - first >= maxDigits || v > (ULLONG_MAX - digit) / 10) return false; // too long, or past 64 bits
+            v = v * 10 + digit;
+            ++p;
+        }
+        if (p == first || !tokenEnds(p, end)) return false;
+        out = v;
+        return true;
+    }
+
+    inline bool readQuantity(const char*& p, const char* end, int& out) {
+        unsigned long long v;
+        if (!readUnsigned(p, end, v, 9)) return false;
+        out = static_cast<int>(v);
+        return true;
+    }
+
+    //"4.56" -> 456 exactly, a third decimal rounds half up like the old double conversion did.
+    //a price past what an int holds in cents fails instead of wrapping to some small one
+    inline bool readPriceCents(const char*& p, const char* end, int& out) {
+        skipSpace(p, end);
+        const char* first = p;
+        long long whole = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (p - first >= 8) return false;
+            whole = whole * 10 + (*p - '0');
+            ++p;
+        }
+        bool hasWhole = (p != first);
+
+        long long frac = 0;
+        int fracDigits = 0;
+        bool roundUp = false;
+        if (p < end && *p == '.') {
+            ++p;
+            while (p < end && *p >= '0' && *p <= '9') {
+                if (fracDigits < 2) frac = frac * 10 + (*p - '0');
+                else if (fracDigits == 2) roundUp = (*p >= '5');
+                fracDigits++;
+                ++p;
+            }
+        }
+        if ((!hasWhole && fracDigits == 0) || !tokenEnds(p, end)) return false;
+
+        if (fracDigits == 1) frac *= 10;
+        long long cents = whole * 100 + frac + (roundUp ? 1 : 0);
+        if (cents > INT_MAX) return false;
+        out = static_cast<int>(cents);
+        return true;
+    }
+
+    //symbols start with a letter, which is how they are told apart from a trailing id or price
+    inline bool atSymbol(const char*& p, const char* end) {
+        skipSpace(p, end);
+        return p < end && ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z'));
+    }
+
+    //optional trailing id: absent is fine (0), present but malformed is not
+    inline bool readOptionalId(const char*& p, const char* end, unsigned long long& id) {
+        id = 0;
+        if (p == end || atSymbol(p, end)) return true;
+        return readUnsigned(p, end, id, 20);
+    }
+
+    //optional symbol, then the end of the line
+    inline bool readOptionalSymbol(const char*& p, const char* end, const SymbolTable* symbols, uint32_t& symbol) {
+        const char* word;
+        size_t len;
+        symbol = 0;
+        if (readWord(p, end, word, len)) {
+            if (symbols == nullptr) return false;
+            symbol = symbols->find(std::string_view(word, len));
+            if (symbol == SymbolTable::NOT_FOUND) return false; // unknown instrument
+        }
+        skipSpace(p, end);
+        return p == end;
+    }
+
+    inline char* writeUnsigned(char* out, unsigned long long v) {
+        char digits[20];
+        int n = 0;
+        do {
+            digits[n++] = static_cast<char>('0' + v % 10);
+            v /= 10;
+        } while (v != 0);
+        while (n > 0) *out++ = digits[--n];
+        return out;
+    }
+
+    //456 -> "4.56"
+    inline char* writePriceCents(char* out, int cents) {
+        if (cents < 0) {
+            *out++ = '-';
+            cents = -cents;
+        }
+        out = writeUnsigned(out, static_cast<unsigned long long>(cents / 100));
+        *out++ = '.';
+        *out++ = static_cast<char>('0' + (cents / 10) % 10);
+        *out++ = static_cast<char>('0' + cents % 10);
+        return out;
+    }
+
+    inline char* writeWord(char* out, const char* word) {
+        while (*word) *out++ = *word++;
+        return out;
+    }
+
+    const char* execTypeName(uint8_t type) {
+        switch (type) {
+            case EXEC_ACCEPTED: return "accepted";
+            case EXEC_FILL: return "fill";
+            case EXEC_CANCELLED: return "cancelled";
+            case EXEC_MODIFIED: return "modified";
+            default: return "rejected";
+        }
+    }
+
+    const char* orderTypeName(uint8_t type) {
+        switch (type) {
+            case ORDER_IOC: return "ioc";
+            case ORDER_FOK: return "fok";
+            case ORDER_MARKET: return "market";
+            case ORDER_POST_ONLY: return "post";
+            default: return "limit";
+        }
+    }
+
+    //optional order type right after the side. quantities start with a digit, so a word is a type
+    inline bool readOptionalType(const char*& p, const char* end, uint8_t& type) {
+        type = ORDER_LIMIT;
+        skipSpace(p, end);
+        if (p == end || (*p >= '0' && *p <= '9')) return true;
+        const char* word;
+        size_t len;
+        if (!readWord(p, end, word, len)) return false;
+        for (uint8_t t = 0; t < ORDER_TYPE_COUNT; ++t) {
+            if (wordIs(word, len, orderTypeName(t))) {
+                type = t;
+                return true;
+            }
+        }
+        return false; // unknown type
+    }
+
+    //optional trailing price: absent means 0 ("keep the current price")
+    inline bool readOptionalPrice(const char*& p, const char* end, int& cents) {
+        cents = 0;
+        if (p == end || atSymbol(p, end)) return true;
+        return readPriceCents(p, end, cents);
+    }
+}
+
+
+
+bool parseTextOrder(const char* begin, const char* end, Order &o, const SymbolTable* symbols) {
+    const char* p = begin;
+    const char* side;
+    size_t sideLen;
+    int quantity;
+    int price;
+    unsigned long long id = 0;
+    uint32_t symbol;
+
+    if (!readWord(p, end, side, sideLen)) return false; // parsing failed
+
+    if (wordIs(side, sideLen, "cancel")) { // cancel <id> [symbol]
+        if (!readUnsigned(p, end, id, 20) || id == 0) return false;
+        if (!readOptionalSymbol(p, end, symbols, symbol)) return false;
+        o.id = id;
+        o.symbol = symbol;
+        o.action = ORDER_CANCEL;
+        o.type = ORDER_LIMIT;
+        o.buy = false;
+        o.price = 0;
+        o.quantity = 0;
+        return true;
+    }
+
+    if (wordIs(side, sideLen, "modify")) { // modify <id> <quantity> [price] [symbol]
+        if (!readUnsigned(p, end, id, 20) || id == 0) return false;
+        if (!readQuantity(p, end, quantity)) return false;
+        if (!readOptionalPrice(p, end, price)) return false; // no price keeps the current one
+        if (!readOptionalSymbol(p, end, symbols, symbol)) return false;
+        o.id = id;
+        o.symbol = symbol;
+        o.action = ORDER_MODIFY;
+        o.type = ORDER_LIMIT;
+        o.buy = false;
+        o.price = price;
+        o.quantity = quantity;
+        return orderValuesValid(o);
+    }
+
+    bool buy = wordIs(side, sideLen, "buy");
+    if (!buy && !wordIs(side, sideLen, "sell")) return false; // invalid side
+    uint8_t type;
+    if (!readOptionalType(p, end, type)) return false;
+    if (!readQuantity(p, end, quantity) || !readPriceCents(p, end, price)) return false; // parsing failed
+    if (!readOptionalId(p, end, id)) return false; // id is optional
+    if (!readOptionalSymbol(p, end, symbols, symbol)) return false; // so is the symbol
+
+    // Create order
+    o.id = id;
+    o.symbol = symbol;
+    o.action = ORDER_NEW;
+    o.type = type;
+    o.buy = buy;
+    o.price = price;
+    o.quantity = quantity;
+    return orderValuesValid(o);
+}
+
+
+size_t formatTextReport(char* buf, const ExecReport& report) {
+    char* out = buf;
+    out = writeWord(out, execTypeName(report.type));
+    *out++ = ' ';
+    out = writeWord(out, report.buy ? "buy" : "sell");
+    *out++ = ' ';
+    out = writeUnsigned(out, report.orderId);
+    *out++ = ' ';
+    out = writeUnsigned(out, static_cast<unsigned long long>(report.quantity < 0 ? 0 : report.quantity));
+    *out++ = ' ';
+    out = writePriceCents(out, report.price);
+    *out++ = ' ';
+    out = writeUnsigned(out, report.counterId);
+    *out++ = ' ';
+    out = writeUnsigned(out, report.seq);
+    *out++ = '\n';
+    return static_cast<size_t>(out - buf);
+}
+
+
+size_t formatTextOrder(char* buf, const Order &o, const SymbolTable* symbols) {
+    char* out = buf;
+    if (o.action == ORDER_CANCEL) { // cancel <id>
+        out = writeWord(out, "cancel ");
+        out = writeUnsigned(out, o.id);
+    } else if (o.action == ORDER_MODIFY) { // modify <id> <qty> [price]
+        out = writeWord(out, "modify ");
+        out = writeUnsigned(out, o.id);
+        *out++ = ' ';
+        out = writeUnsigned(out, static_cast<unsigned long long>(o.quantity < 0 ? 0 : o.quantity));
+        if (o.price != 0) {
+            *out++ = ' ';
+            out = writePriceCents(out, o.price);
+        }
+    } else { // buy|sell [type] <qty> <price> <id>
+        out = writeWord(out, o.buy ? "buy " : "sell ");
+        if (o.type != ORDER_LIMIT) {
+            out = writeWord(out, orderTypeName(o.type));
+            *out++ = ' ';
+        }
+        out = writeUnsigned(out, static_cast<unsigned long long>(o.quantity < 0 ? 0 : o.quantity));
+        *out++ = ' ';
+        out = writePriceCents(out, o.price);
+        *out++ = ' ';
+        out = writeUnsigned(out, o.id);
+    }
+    if (symbols && o.symbol < symbols->size()) {
+        const std::string &name = symbols->name(o.symbol);
+        *out++ = ' ';
+        memcpy(out, name.data(), name.size());
+        out += name.size();
+    }
+    *out++ = '\n';
+    return static_cast<size_t>(out - buf);
+}
+
+
+bool parseTextReport(const char* begin, const char* end, ExecReport& report) {
+    const char* p = begin;
+    const char* word;
+    size_t len;
+    unsigned long long id, counter, seq;
+    int quantity, price;
+
+    if (!readWord(p, end, word, len)) return false;
+    if (wordIs(word, len, "accepted")) report.type = EXEC_ACCEPTED;
+    else if (wordIs(word, len, "fill")) report.type = EXEC_FILL;
+    else if (wordIs(word, len, "cancelled")) report.type = EXEC_CANCELLED;
+    else if (wordIs(word, len, "modified")) report.type = EXEC_MODIFIED;
+    else if (wordIs(word, len, "rejected")) report.type = EXEC_REJECTED;
+    else return false;
+
+    if (!readWord(p, end, word, len)) return false;
+    report.buy = wordIs(word, len, "buy");
+    if (!readUnsigned(p, end, id, 20) || !readQuantity(p, end, quantity) || !readPriceCents(p, end, price) ||
+        !readUnsigned(p, end, counter, 20) || !readUnsigned(p, end, seq, 20)) return false;
+
+    report.orderId = id;
+    report.quantity = quantity;
+    report.price = price;
+    report.counterId = counter;
+    report.seq = seq;
+    return true;
+}
+
+
+bool parseTextOrder(const std::string &line, Order &o, const SymbolTable* symbols) {
+    return parseTextOrder(line.data(), line.data() + line.size(), o, symbols);
+}
@@ -0,0 +1,144 @@
+// protocol_test.cpp
+// checks the text and binary order parsers on inputs that must be refused: numbers that don't fit,
+// prices and quantities that would reach the book as something else than what was sent, and
+// non-positive ones that would trade or rest as if they meant something.
+// prints every case that went wrong and exits non-zero if there was one
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include "protocol.h"
+
+
+static int failures = 0;
+
+static void expectText(const std::string &line, bool accepted) {
+    Order o;
+    if (parseTextOrder(line, o) != accepted) {
+        failures++;
+        std::cout << "FAIL: \"" << line << "\" should be " << (accepted ? "accepted" : "refused") << "\n";
+    }
+}
+
+static void expectTextPrice(const std::string &line, int cents) {
+    Order o;
+    if (!parseTextOrder(line, o) || o.price != cents) {
+        failures++;
+        std::cout << "FAIL: \"" << line << "\" should have price " << cents << "\n";
+    }
+}
+
+//a binary message built with encodeOrder, then its price and quantity fields overwritten with raw u32s
+static void expectBinary(const char* what, uint8_t action, uint8_t type, uint32_t price, uint32_t quantity, DecodeStatus expected) {
+    Order o;
+    o.id = 7;
+    o.symbol = 0;
+    o.action = action;
+    o.type = type;
+    o.buy = false;
+    o.price = 0;
+    o.quantity = 0;
+    char buf[MAX_MESSAGE_SIZE];
+    size_t len = encodeOrder(buf, o);
+    putU32(buf + 12, price);
+    putU32(buf + 16, quantity);
+    Order decoded;
+    size_t consumed = 0;
+    DecodeStatus status = decodeMessage(buf, len, decoded, consumed);
+    if (status != expected || consumed != len) {
+        failures++;
+        std::cout << "FAIL: binary " << what << " decoded as " << status << ", expected " << expected << "\n";
+    }
+}
+
+//a binary message with good values, only its id overwritten
+static void expectBinaryId(const char* what, uint8_t action, uint64_t id, DecodeStatus expected) {
+    Order o;
+    o.id = 7;
+    o.symbol = 0;
+    o.action = action;
+    o.type = ORDER_LIMIT;
+    o.buy = true;
+    o.price = 456;
+    o.quantity = 100;
+    char buf[MAX_MESSAGE_SIZE];
+    size_t len = encodeOrder(buf, o);
+    putU64(buf + 4, id);
+    Order decoded;
+    size_t consumed = 0;
+    DecodeStatus status = decodeMessage(buf, len, decoded, consumed);
+    if (status != expected || consumed != len || decoded.id != id) {
+        failures++;
+        std::cout << "FAIL: binary " << what << " decoded as " << status << ", expected " << expected << "\n";
+    }
+}
+
+static void expectReport(const std::string &line, bool accepted) {
+    ExecReport report;
+    if (parseTextReport(line.data(), line.data() + line.size(), report) != accepted) {
+        failures++;
+        std::cout << "FAIL: report \"" << line << "\" should be " << (accepted ? "accepted" : "refused") << "\n";
+    }
+}
+
+
+int main() {
+    //prices: in cents, and nothing that wraps around an int
+    expectTextPrice("buy 100 4.56", 456);
+    expectTextPrice("sell 100 21474836.47", 2147483647);
+    expectText("sell 100 21474836.48", false);
+    expectText("sell 100 42949673.00", false);
+    expectText("sell 100 99999999.99", false);
+    expectText("modify 5 100 42949673.00", false);
+
+    //ids: up to 20 digits, but only what fits in 64 bits
+    expectText("buy 100 4.56 18446744073709551615", true);
+    expectText("buy 100 4.56 18446744073709551616", false);
+    expectText("buy 100 4.56 99999999999999999999", false);
+    expectText("cancel 18446744073709551616", false);
+    expectReport("fill buy 42 100 4.56 17 9001", true);
+    expectReport("fill buy 42 100 4.56 17 18446744073709551616", false);
+
+    //text orders: nothing at or below zero reaches a book
+    expectText("sell 100 0", false);
+    expectText("sell 100 0.00", false);
+    expectText("sell 100 0.001", false);
+    expectText("sell 100 -1.00", false);
+    expectText("buy 0 4.56", false);
+    expectText("buy -5 4.56", false);
+    expectText("buy ioc 0 4.56", false);
+    expectText("buy post 100 0", false);
+    expectText("buy market 100 0", true);
+    expectText("buy market 0 0", false);
+    expectText("modify 5 0", true);             //down to nothing is a cancel
+    expectText("modify 5 100 0.00", true);      //0 keeps the price
+    expectText("modify 5 -1 4.56", false);
+
+    //binary orders: u32 prices and quantities past 2^31 would turn negative
+    expectBinary("limit", ORDER_NEW, ORDER_LIMIT, 456, 100, DECODE_OK);
+    expectBinary("limit at 0", ORDER_NEW, ORDER_LIMIT, 0, 100, DECODE_INVALID);
+    expectBinary("limit at 2^31", ORDER_NEW, ORDER_LIMIT, 0x80000000u, 100, DECODE_INVALID);
+    expectBinary("limit at 2^32-1", ORDER_NEW, ORDER_LIMIT, 0xFFFFFFFFu, 100, DECODE_INVALID);
+    expectBinary("zero quantity", ORDER_NEW, ORDER_LIMIT, 456, 0, DECODE_INVALID);
+    expectBinary("quantity 2^31", ORDER_NEW, ORDER_LIMIT, 456, 0x80000000u, DECODE_INVALID);
+    expectBinary("ioc at 0", ORDER_NEW, ORDER_IOC, 0, 100, DECODE_INVALID);
+    expectBinary("market at 0", ORDER_NEW, ORDER_MARKET, 0, 100, DECODE_OK);
+    expectBinary("market, zero quantity", ORDER_NEW, ORDER_MARKET, 0, 0, DECODE_INVALID);
+    expectBinary("modify to 0", ORDER_MODIFY, ORDER_LIMIT, 0, 0, DECODE_OK);
+    expectBinary("modify, quantity 2^31", ORDER_MODIFY, ORDER_LIMIT, 0, 0x80000000u, DECODE_INVALID);
+    expectBinary("modify, price 2^31", ORDER_MODIFY, ORDER_LIMIT, 0x80000000u, 100, DECODE_INVALID);
+
+    //binary ids: 0 is reserved, the server doesn't assign one like it does for text orders
+    expectBinaryId("new order, id 1", ORDER_NEW, 1, DECODE_OK);
+    expectBinaryId("new order, id 0", ORDER_NEW, 0, DECODE_INVALID);
+    expectBinaryId("cancel, id 1", ORDER_CANCEL, 1, DECODE_OK);
+    expectBinaryId("cancel, id 0", ORDER_CANCEL, 0, DECODE_INVALID);
+    expectBinaryId("modify, id 1", ORDER_MODIFY, 1, DECODE_OK);
+    expectBinaryId("modify, id 0", ORDER_MODIFY, 0, DECODE_INVALID);
+    expectBinaryId("new order, id 2^64-1", ORDER_NEW, 0xFFFFFFFFFFFFFFFFULL, DECODE_OK);
+    expectText("cancel 0", false);
+    expectText("modify 0 100", false);
+
+    if (failures == 0) std::cout << "all protocol checks passed\n";
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1,30 +1,109 @@
-
 #include "server.h"
 #include "orderbook.h"
+#include "threadconfig.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <algorithm>
+#include <thread>
+
+
+Server::Server() : server_fd(-1), epoll_fd(-1), wake_fd(-1), stopRequested(false), engine(nullptr), symbols(nullptr), nextOrderId(SERVER_ID_BASE) {}
 
 
-Server::Server() : server_fd(-1), client_fd(-1), orderQueue(nullptr), orderMutex(nullptr), orderCV(nullptr) {}
+Server::~Server() {
+    close_all();
+    if (wake_fd >= 0) { //kept until here since the matching thread may still look at it after the loop exits
+        close(wake_fd);
+        wake_fd = -1;
+    }
+}
+
+
+void Server::setSharedResources(MatchingEngine* matching_engine, const SymbolTable* symbol_table) {
+    engine = matching_engine;
+    symbols = symbol_table;
+    reportQueues.clear();
+    for (size_t i = 0; i < engine->workerCount(); ++i) {
+        reportQueues.emplace_back(new SPSCQueue<BookEvent>());
+        reportQueues.back()->initialize(REPORT_QUEUE_SIZE);
+    }
+}
+
+void Server::resume(uint64_t last_seq, uint64_t highest_order_id, uint32_t last_session) {
+    nextSeq = std::max(nextSeq, last_seq + 1);
+    if (highest_order_id >= SERVER_ID_BASE) nextOrderId = std::max(nextOrderId, highest_order_id + 1);
+    nextSessionId = std::max(nextSessionId, last_session + 1);
+}
 
 
-void Server::setSharedResources(std::queue<Order>* q, std::mutex* m, std::condition_variable* cv) {
-    orderQueue = q;
-    orderMutex = m;
-    orderCV = cv;
+bool Server::parseOrderLine(const char* begin, const char* end, Order &o) {
+    if (!parseTextOrder(begin, end, o, symbols)) return false;
+    if (o.action == ORDER_NEW && o.id == 0) o.id = nextOrderId++; // id is optional
+    return true;
 }
 
+
 bool Server::parseOrderLine(const std::string &line, Order &o) {
-    std::istringstream iss(line);
-    std::string side;
-    int quantity;
-    double price;
-
-    if (!(iss >> side >> quantity >> price)) return false; // parsing failed
-    if (side != "buy" && side != "sell") return false; // invalid side
-
-    // Create order
-    o.buy = (side == "buy");
-    o.price = static_cast<int>(price * 100 + 0.5);
-    o.quantity = quantity;
+    return parseOrderLine(line.data(), line.data() + line.size(), o);
+}
+
+
+void Server::submit(Session &session, Order &o) {
+    o.recvTime = session.recvTime;
+    o.parsedAt = tickOffset(session.recvTime, clockNow());
+    o.session = session.id;
+    if (o.symbol >= engine->symbolCount()) { //binary clients can send any id
+        reject(session, o);
+        return;
+    }
+    o.seq = nextSeq++; //only what is journaled and matched gets one, so the journal's seqs have no holes
+    //a full inbound ring means the worker is behind, and it may itself be waiting for this loop to make
+    //room in its report queue. keep taking reports while waiting so the two never wait on each other
+    for (int spins = 0; !engine->trySubmit(o); ++spins) {
+        if (stopRequested.load(std::memory_order_relaxed)) { //never matched, so never journaled either
+            nextSeq--;
+            return;
+        }
+        drain_reports();
+        if (spins < SUBMIT_SPINS_BEFORE_YIELD) cpuRelax();
+        else std::this_thread::yield(); //the worker may need this cpu to make room
+    }
+    //only once the worker has it, so recovery never replays an order that wasn't matched. seqs are handed
+    //out and journaled on this thread alone, so the journal still has them in the order the engine got them
+    if (journal != nullptr) journal->append(o); //a copy into the journal's ring, the writer thread does the i/o
+}
+
+
+
+void Server::reject(Session &session, const Order &o) {
+    ExecReport report;
+    report.seq = 0; //not a book event
+    report.orderId = o.id;
+    report.counterId = 0;
+    report.price = o.price;
+    report.quantity = o.quantity;
+    report.type = EXEC_REJECTED;
+    report.buy = o.buy;
+    deliver(session.id, report);
+}
+
+
+bool Server::handleBinaryMessage(Session &session, const char* data, size_t len, size_t &consumed) {
+    Order o;
+    DecodeStatus status = decodeMessage(data, len, o, consumed);
+    if (status == DECODE_INCOMPLETE) return false;
+    if (status == DECODE_ERROR) {
+        std::cerr << "invalid binary message from session " << session.id << ", dropping connection\n";
+        session.binaryError = true;
+        return false;
+    }
+    if (status == DECODE_OK) {
+        submit(session, o);
+    } else if (status == DECODE_INVALID) {
+        reject(session, o); //never sequenced, the book doesn't see it
+    }
     return true;
 }
 
@@ -32,12 +111,15 @@ bool Server::parseOrderLine(const std::string &line, Order &o) {
 int Server::initialize() {
 
     //create socket
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    server_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
     if (server_fd < 0) {
         std::cerr << "could not create socket\n";
         return 1;
     }
 
+    int reuse = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
     //bind
     memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
@@ -48,94 +130,551 @@ int Server::initialize() {
     if (bind(server_fd, (struct sockaddr*) &server_addr, sizeof(server_addr)) < 0) {
         std::cerr << "could not bind\n";
         close(server_fd);
+        server_fd = -1;
         return 1;
     }
 
-    //listen for connection
-    if (listen(server_fd, 1) < 0) {
+    //listen for connections
+    if (listen(server_fd, SOMAXCONN) < 0) {
         std::cerr << "could not listen\n";
         close(server_fd);
+        server_fd = -1;
+        return 1;
+    }
+
+    epoll_fd = epoll_create1(0);
+    if (epoll_fd < 0) {
+        std::cerr << "could not create epoll instance\n";
+        close(server_fd);
+        server_fd = -1;
+        return 1;
+    }
+
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = LISTEN_KEY;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_fd, &ev) < 0) {
+        std::cerr << "could not watch listening socket\n";
+        close_all();
         return 1;
     }
 
+    //the matching thread rings this when it has reports and the loop is asleep
+    wake_fd = eventfd(0, EFD_NONBLOCK);
+    ev.events = EPOLLIN;
+    ev.data.u64 = WAKE_KEY;
+    if (wake_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev) < 0) {
+        std::cerr << "could not set up report wakeups\n";
+        close_all();
+        return 1;
+    }
     std::cout << "listening on port " << PORT << "...\n";
 
     return 0;
 }
 
-int Server::wait_for_client_connection() {
-    //accept client connection
-    socklen_t client_len = sizeof(client_addr);
-    client_fd = accept(server_fd, (struct sockaddr*)&client_addr, &client_len);
-    if (client_fd < 0) {
-        std::cerr << "could not accept\n";
-        close(server_fd);
+
+
+int Server::enableSharedMemory(const std::string &name, size_t client_slots, size_t ring_slots, bool busy_poll) {
+    if (shm.create(name, client_slots, ring_slots) != 0) return 1;
+    shm_doorbell_fd = openDoorbell(name, -1);
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = SHM_KEY;
+    if (shm_doorbell_fd < 0 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, shm_doorbell_fd, &ev) < 0) {
+        std::cerr << "could not set up the shared memory doorbell\n";
+        shm.close();
         return 1;
     }
-
-    std::cout << "client connected...\n";
+    shmBusyPoll = busy_poll;
+    shmSessions.assign(shm.header()->clientSlots, 0);
+    std::cout << "shared memory gateway " << name << ": " << shm.header()->clientSlots << " client slots, "
+              << shm.header()->ringSlots << " messages each way" << (busy_poll ? ", busy polling" : "") << "\n";
     return 0;
 }
 
 
 
+void Server::accept_clients() {
+    while (true) {
+        sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+        int fd = accept4(server_fd, (struct sockaddr*)&client_addr, &client_len, SOCK_NONBLOCK);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) std::cerr << "could not accept\n";
+            return;
+        }
 
+        std::unique_ptr<Session> session(new Session());
+        session->fd = fd;
+        session->id = nextSessionId++;
+        session->recvBuffer.initialize(SESSION_BUFFER_SIZE);
+        session->outBuffer.reserve(OUT_RESERVE);
+
+        epoll_event ev;
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.u64 = session->id;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            std::cerr << "could not watch client socket\n";
+            close(fd);
+            continue;
+        }
 
-void Server::listen_to_client() {
-    std::string leftover; // for incomplete orders
-    char buffer[BUFF_SIZE];
+        std::cout << "client connected, session " << session->id << "\n";
+        sessions[session->id] = std::move(session);
+    }
+}
 
 
-    while (true) {
-        memset(buffer, 0, BUFF_SIZE); //clear buffer
-        ssize_t bytes_read = recv(client_fd, buffer, BUFF_SIZE, 0); //get client input
 
+bool Server::parseReceived(Session &session) {
+    RecvBuffer &buffer = session.recvBuffer;
 
-        if (bytes_read < 0) {
-            std::cerr << "error: recv() failed\n";
-            break;
-        } else if (bytes_read == 0) {
-            std::cout << "client disconnected\n";
+    //first bytes of the connection decide the protocol
+    if (!session.protocolChosen) {
+        const char* data = buffer.readPtr();
+        size_t len = buffer.readable();
+        if (len < HELLO_SIZE && data[0] == static_cast<char>(HELLO_SIZE)) return true; //hello not complete yet
+        session.binaryMode = isHello(data, len);
+        if (session.binaryMode) buffer.consume(HELLO_SIZE);
+        session.protocolChosen = true;
+        std::cout << "session " << session.id << " protocol: " << (session.binaryMode ? "binary" : "text") << "\n";
+    }
+
+    if (session.binaryMode) {
+        //decode every complete message where it sits in the buffer
+        size_t consumed = 0;
+        while (handleBinaryMessage(session, buffer.readPtr(), buffer.readable(), consumed)) buffer.consume(consumed);
+        return !session.binaryError;
+    }
+
+    while (buffer.readable() > 0) {
+        const char* line = buffer.readPtr();
+        const char* newline = static_cast<const char*>(memchr(line, '\n', buffer.readable()));
+        if (newline == nullptr) break; //incomplete order, wait for the rest
+
+        //std::cout << "received order: " << std::string(line, newline) << "\n";
+
+        Order o{}; //a line that doesn't parse is rejected with whatever was read of it, id 0 if nothing
+        if (parseOrderLine(line, newline, o)) {
+            submit(session, o);
+        } else {
+            if (session.invalidLines++ == 0) { //once per session, a bad client can't flood the log
+                std::cerr << "invalid order format from session " << session.id << " (later ones are only rejected): "
+                          << std::string(line, newline) << "\n";
+            }
+            reject(session, o);
+        }
+        buffer.consume(static_cast<size_t>(newline - line) + 1);
+    }
+    return true;
+}
+
+
+
+void Server::read_session(Session &session) {
+    RecvBuffer &buffer = session.recvBuffer;
+    buffer.compact(); //only moves the partial tail when little room is left
+    if (buffer.full()) {
+        std::cerr << "error: message from session " << session.id << " does not fit in the receive buffer\n";
+        close_session(session.id);
+        return;
+    }
+
+    //one recv per wakeup keeps a busy client from starving the others
+    ssize_t bytes_read = recv(session.fd, buffer.writePtr(), buffer.writable(), 0); //get client input
+
+    if (bytes_read < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return;
+        std::cerr << "error: recv() failed on session " << session.id << "\n";
+        close_session(session.id);
+        return;
+    } else if (bytes_read == 0) {
+        std::cout << "client disconnected, session " << session.id << "\n";
+        close_session(session.id);
+        return;
+    }
+
+    session.recvTime = clockNow();
+    buffer.commit(static_cast<size_t>(bytes_read));
+    if (!parseReceived(session)) close_session(session.id);
+}
+
+
+
+void Server::run_event_loop(const ThreadPlacement &placement, RuntimeStatus* status) {
+    placeCurrentThread("event-loop", placement, status);
+
+    epoll_event events[MAX_EVENTS];
+    bool shmSleeps = shm.mapped() && !shmBusyPoll;
+
+    while (!stopRequested.load(std::memory_order_relaxed)) {
+        //pairs with the fence in post_events(): either the matching thread sees us sleeping and
+        //rings wake_fd, or we see its reports here and don't sleep. shm clients do the same with
+        //serverSleeping and the doorbell
+        loopSleeping.store(true, std::memory_order_relaxed);
+        if (shmSleeps) shm.header()->serverSleeping.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int timeout = (reports_pending() || shm_work_pending()) ? 0 : EPOLL_TIMEOUT_MS;
+        if (shm.mapped() && shmBusyPoll) timeout = 0;
+        else if (timeout > SHM_RETRY_MS && shm_backlog()) timeout = SHM_RETRY_MS;
+
+        int n = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout);
+        loopSleeping.store(false, std::memory_order_relaxed);
+        if (shmSleeps) shm.header()->serverSleeping.store(0, std::memory_order_relaxed);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "error: epoll_wait() failed\n";
             break;
         }
 
-        std::string data(buffer, bytes_read);
-        leftover += data;
+        //events are handled in the order the kernel reported them, and every message a session
+        //parses is sequenced right away, so the book sees one well defined interleaving
+        for (int i = 0; i < n; ++i) {
+            uint64_t key = events[i].data.u64;
+            if (key == LISTEN_KEY) {
+                accept_clients();
+                continue;
+            }
+            if (key == WAKE_KEY) {
+                uint64_t rings;
+                if (read(wake_fd, &rings, sizeof(rings)) < 0) {} //just reset it, the reports are in the queue
+                continue;
+            }
+            if (key == SHM_KEY) {
+                drainDoorbell(shm_doorbell_fd); //the orders are in the rings, read below
+                continue;
+            }
 
-        size_t pos;
-        while ((pos = leftover.find('\n')) != std::string::npos) {
-            std::string order_str = leftover.substr(0, pos);
-            leftover.erase(0, pos + 1);
+            auto it = sessions.find(static_cast<uint32_t>(key));
+            if (it == sessions.end()) continue; //closed earlier in this batch
+            if (events[i].events & EPOLLOUT) {
+                flush_session(*it->second);
+                it = sessions.find(static_cast<uint32_t>(key));
+                if (it == sessions.end()) continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) read_session(*it->second);
+        }
+        if (shm.mapped()) poll_shared_memory();
+
+        //reports go out once per wakeup, so a burst of fills to one session becomes one send()
+        drain_reports();
+        for (uint32_t id : flushList) {
+            auto it = sessions.find(id);
+            if (it == sessions.end()) continue;
+            it->second->queuedForFlush = false;
+            flush_session(*it->second);
+        }
+        flushList.clear();
+    }
 
-            //std::cout << "received order: " << order_str << "\n";
+    close_all();
+    std::cout << "exiting event loop.\n";
+}
 
-            Order o;
-            if (parseOrderLine(order_str, o)) {
-                {
-                    std::lock_guard<std::mutex> lock(*orderMutex);
-                    orderQueue->push(o);
-                }
-                orderCV->notify_one();
-            } else {
-                std::cerr << "invalid order format: " << order_str << "\n";
+
+
+void Server::post_events(size_t producer, const std::vector<BookEvent> &events) {
+    if (events.empty() || stopRequested.load(std::memory_order_relaxed)) return;
+
+    SPSCQueue<BookEvent> &reportQueue = *reportQueues[producer];
+    for (const BookEvent &event : events) {
+        while (!reportQueue.tryPush(event)) {
+            if (stopRequested.load(std::memory_order_relaxed)) return; //nobody left to deliver to
+            if (loopSleeping.load(std::memory_order_relaxed)) {
+                uint64_t one = 1;
+                if (write(wake_fd, &one, sizeof(one)) < 0) {}
             }
+            std::this_thread::yield();
         }
+    }
 
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (loopSleeping.load(std::memory_order_relaxed)) {
+        uint64_t one = 1;
+        if (write(wake_fd, &one, sizeof(one)) < 0) {}
     }
-    std::cout << "exiting listen_to_client.\n";
 }
 
-void Server::stop_server() {
-    if (client_fd >= 0) {
-        shutdown(client_fd, SHUT_RDWR);
-        close(client_fd);
-        std::cout << "client socket closed\n";
-        client_fd = -1;
+
+
+bool Server::reports_pending() const {
+    for (const auto &queue : reportQueues) {
+        if (!queue->empty()) return true;
+    }
+    return false;
+}
+
+
+
+void Server::drain_reports() {
+    BookEvent event;
+    for (auto &queue : reportQueues) {
+        while (queue->tryPop(event)) {
+            ExecReport report;
+            report.seq = event.seq;
+            report.orderId = event.orderId;
+            report.counterId = event.passiveId;
+            report.price = event.price;
+            report.quantity = event.quantity;
+            report.type = event.type;
+            report.buy = event.buy;
+            deliver(event.session, report);
+
+            //the resting side of a trade gets its own report
+            if (event.type == EXEC_FILL) {
+                report.orderId = event.passiveId;
+                report.counterId = event.orderId;
+                report.buy = !event.buy;
+                deliver(event.passiveSession, report);
+            }
+        }
+    }
+}
+
+
+
+void Server::deliver(uint32_t session_id, const ExecReport &report) {
+    if (session_id == 0) return; //order didn't come from a client
+    auto it = sessions.find(session_id);
+    if (it == sessions.end()) return; //client already left
+    Session &session = *it->second;
+
+    size_t used = session.outBuffer.size();
+    session.outBuffer.resize(used + MAX_TEXT_REPORT_SIZE);
+    size_t len = session.binaryMode ? encodeExecReport(session.outBuffer.data() + used, report)
+                                    : formatTextReport(session.outBuffer.data() + used, report);
+    session.outBuffer.resize(used + len);
+
+    if (!session.queuedForFlush) {
+        session.queuedForFlush = true;
+        flushList.push_back(session_id);
+    }
+}
+
+
+
+void Server::flush_session(Session &session) {
+    size_t pending = session.outBuffer.size() - session.outOffset;
+    if (pending > 0 && session.shmSlot >= 0) {
+        session.outOffset += push_shm_reports(session);
+    } else if (pending > 0) {
+        ssize_t sent = send(session.fd, session.outBuffer.data() + session.outOffset, pending, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                std::cerr << "error: send() failed on session " << session.id << "\n";
+                close_session(session.id);
+                return;
+            }
+        } else {
+            session.outOffset += static_cast<size_t>(sent);
+        }
+    }
+
+    pending = session.outBuffer.size() - session.outOffset;
+    if (pending == 0) { //all out, reuse the buffer from the start
+        session.outBuffer.clear();
+        session.outOffset = 0;
+    } else if (session.outOffset > session.outBuffer.size() / 2) { //drop the sent prefix now and then
+        session.outBuffer.erase(session.outBuffer.begin(), session.outBuffer.begin() + session.outOffset);
+        session.outOffset = 0;
+    }
+    update_interest(session);
+}
+
+
+
+void Server::update_interest(Session &session) {
+    size_t pending = session.outBuffer.size() - session.outOffset;
+    bool wantWrite = pending > 0;
+    bool pauseRead = pending > OUT_HIGH_WATER; //client isn't keeping up with its reports, stop taking orders from it
+    if (session.shmSlot >= 0) { //no epoll for rings, the loop looks at these flags itself
+        session.writeWatched = wantWrite;
+        session.readPaused = pauseRead;
+        return;
     }
+    if (wantWrite == session.writeWatched && pauseRead == session.readPaused) return;
+
+    session.writeWatched = wantWrite;
+    session.readPaused = pauseRead;
+    epoll_event ev;
+    ev.events = EPOLLRDHUP;
+    if (!pauseRead) ev.events |= EPOLLIN;
+    if (wantWrite) ev.events |= EPOLLOUT;
+    ev.data.u64 = session.id;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, session.fd, &ev);
+}
+
+
+
+void Server::close_session(uint32_t session_id) {
+    auto it = sessions.find(session_id);
+    if (it == sessions.end()) return;
+    if (it->second->shmSlot >= 0) {
+        size_t slot = static_cast<size_t>(it->second->shmSlot);
+        //a client that is still attached is told it was dropped, its slot is freed once it lets go.
+        //one that closed (or died) can't touch the rings any more, so the slot is free right away
+        uint32_t expected = SHM_CLIENT_ACTIVE;
+        if (!shm.client(slot)->state.compare_exchange_strong(expected, SHM_CLIENT_DROPPED)) shm.resetClient(slot);
+        else ringDoorbell(shm_doorbell_fd, shm.name(), static_cast<int>(slot)); //in case it sleeps on its reports
+        shmSessions[slot] = 0;
+        sessions.erase(it);
+        return;
+    }
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, it->second->fd, nullptr);
+    shutdown(it->second->fd, SHUT_RDWR);
+    close(it->second->fd);
+    sessions.erase(it);
+}
+
+
+
+void Server::close_all() {
+    if (!sessions.empty()) {
+        while (!sessions.empty()) close_session(sessions.begin()->first);
+        std::cout << "client sockets closed\n";
+    }
+
     if (server_fd >= 0) {
         shutdown(server_fd, SHUT_RDWR);
         close(server_fd);
         std::cout << "server socket closed\n";
         server_fd = -1;
     }
+    if (shm.mapped()) {
+        shm.close(); //clients still attached see the server stop running
+        std::cout << "shared memory gateway closed\n";
+    }
+    if (shm_doorbell_fd >= 0) {
+        close(shm_doorbell_fd);
+        shm_doorbell_fd = -1;
+    }
+    if (epoll_fd >= 0) {
+        close(epoll_fd);
+        epoll_fd = -1;
+    }
+}
+
+
+
+void Server::poll_shared_memory() {
+    uint64_t now = clockNow();
+    bool checkPids = ticksToNanos(now - lastPidCheck) >= SHM_PID_CHECK_MS * 1000000LL;
+    if (checkPids) lastPidCheck = now;
+
+    uint32_t ringSlots = shm.header()->ringSlots;
+    for (size_t slot = 0; slot < shmSessions.size(); ++slot) {
+        ShmClientControl* client = shm.client(slot);
+        uint32_t state = client->state.load(std::memory_order_acquire);
+        uint32_t id = shmSessions[slot];
+
+        if (checkPids && state != SHM_CLIENT_FREE && client->pid != 0 && !processAlive(client->pid)) {
+            std::cout << "shared memory client in slot " << slot << " exited without closing\n";
+            client->state.store(SHM_CLIENT_CLOSING, std::memory_order_release);
+            state = SHM_CLIENT_CLOSING;
+        }
+        if (state == SHM_CLIENT_CLOSING) {
+            if (id != 0) {
+                std::cout << "client detached, session " << id << "\n";
+                close_session(id);
+            } else {
+                shm.resetClient(slot);
+            }
+            continue;
+        }
+        if (state == SHM_CLIENT_ACTIVE && id == 0) {
+            std::unique_ptr<Session> session(new Session());
+            session->id = nextSessionId++;
+            session->shmSlot = static_cast<int>(slot);
+            session->protocolChosen = true; //rings only carry the binary protocol, no hello
+            session->binaryMode = true;
+            session->outBuffer.reserve(OUT_RESERVE);
+            session->shmIn.bind(&client->toServer, shm.ringSlots(slot, true), ringSlots, false);
+            session->shmOut.bind(&client->toClient, shm.ringSlots(slot, false), ringSlots, true);
+            id = session->id;
+            shmSessions[slot] = id;
+            std::cout << "client attached over shared memory, session " << id << " (slot " << slot << ")\n";
+            sessions[id] = std::move(session);
+        }
+        if (id == 0) continue;
+
+        Session &session = *sessions[id];
+        if (session.writeWatched) flush_session(session); //room may have opened up in its report ring
+        if (!session.readPaused) read_shm_session(session);
+    }
+}
+
+
+
+void Server::read_shm_session(Session &session) {
+    const char* message = session.shmIn.front();
+    if (message == nullptr) return;
+    session.recvTime = clockNow();
+
+    //one message per slot, decoded where it sits like the tcp receive buffer
+    for (size_t taken = 0; taken < SHM_READ_BUDGET && message != nullptr; ++taken) {
+        size_t consumed = 0;
+        bool ok = handleBinaryMessage(session, message, SHM_SLOT_SIZE, consumed);
+        session.shmIn.pop();
+        if (!ok) {
+            if (!session.binaryError) std::cerr << "invalid binary message from session " << session.id << ", dropping connection\n";
+            close_session(session.id);
+            return;
+        }
+        message = session.shmIn.front();
+    }
+}
+
+
+
+size_t Server::push_shm_reports(Session &session) {
+    size_t offset = session.outOffset;
+    size_t end = session.outBuffer.size();
+    size_t moved = 0;
+    char* slot;
+    //the out buffer holds whole binary reports back to back, each goes to its own ring slot
+    while (offset < end && (slot = session.shmOut.reserve()) != nullptr) {
+        size_t len = getU16(session.outBuffer.data() + offset);
+        std::memcpy(slot, session.outBuffer.data() + offset, len);
+        session.shmOut.commit();
+        offset += len;
+        moved += len;
+    }
+    if (moved == 0) return 0;
+
+    session.shmOut.publish();
+    ShmClientControl* client = shm.client(static_cast<size_t>(session.shmSlot));
+    std::atomic_thread_fence(std::memory_order_seq_cst); //pairs with the client's fence before it sleeps
+    if (client->sleeping.load(std::memory_order_relaxed)) ringDoorbell(shm_doorbell_fd, shm.name(), session.shmSlot);
+    return moved;
+}
+
+
+
+bool Server::shm_work_pending() const {
+    if (!shm.mapped()) return false;
+    for (size_t slot = 0; slot < shmSessions.size(); ++slot) {
+        uint32_t state = shm.client(slot)->state.load(std::memory_order_acquire);
+        uint32_t id = shmSessions[slot];
+        if (state == SHM_CLIENT_CLOSING || (state == SHM_CLIENT_ACTIVE && id == 0)) return true;
+        if (id == 0) continue;
+        const Session &session = *sessions.at(id);
+        if (!session.readPaused && !session.shmIn.empty()) return true;
+    }
+    return false;
+}
+
+
+
+bool Server::shm_backlog() const {
+    for (uint32_t id : shmSessions) {
+        if (id != 0 && sessions.at(id)->writeWatched) return true;
+    }
+    return false;
+}
+
+
+
+void Server::stop_server() {
+    stopRequested.store(true); //the event loop notices within EPOLL_TIMEOUT_MS and closes everything
 }
@@ -5,50 +5,22 @@
 #include <functional>
 #include <random>
 #include <chrono>
-#include <queue>
-#include <mutex>
-#include <condition_variable>
 #include <atomic>
+#include <memory>
+#include <thread>
+#include <algorithm>
 #include <csignal>
+#include <cstring>
+#include <pthread.h>
 #include "server.h" 
-#include "orderbook.h"
-
-static std::queue<Order> orderQueue; //order buffer between the producer (server) and consumer (orderbook)
-static std::mutex orderQueueMutex; //mutex for variable above
-static std::condition_variable orderAvailableCV; //condition variable signaling if an order is in the queue
-static std::atomic<bool> stopRequested(false); //for wrapping things up
-
-
-//handle Ctrl+C gracefully
-void signalHandler(int signum) {
-    if (signum == SIGINT) {
-        stopRequested.store(true);
-        orderAvailableCV.notify_all();
-    }
-}
-
-
-void orderBookConsumer(OrderBook &ob) {
-    while (true) {
-        Order o;
-        {
-            std::unique_lock<std::mutex> lock(orderQueueMutex);
-            orderAvailableCV.wait(lock, []{ return !orderQueue.empty() || stopRequested.load(); });
-
-            if (stopRequested.load() && orderQueue.empty()) { //doesn't stop processing orders until orderQueue is empty
-                break; // no more orders and stop requested
-            }
-
-            if (!orderQueue.empty()) {
-                o = orderQueue.front();
-                orderQueue.pop();
-            } else continue;
-        }
-        ob.process(o);
-    }
-    std::cout << "order feed thread exited\n";
-}
-
+#include "engine.h"
+#include "symboltable.h"
+#include "clock.h"
+#include "threadconfig.h"
+#include "memoryconfig.h"
+#include "marketdata.h"
+#include "journal.h"
+#include <fstream>
 
 
 inline std::string generateRandomSessionId() {
@@ -64,69 +36,313 @@ inline std::string generateRandomSessionId() {
     
 }
 
-int main() {
+int main(int argc, char *argv[]) {
+
+    // usage: ./server_main [--symbols list|file] [--workers n] [--worker-cpus a,b,..] [--pool-capacity n]
+    //                      [--ladder-window n] [--latency-trace n] [--trace-full drop|block] [--queue mutex|spin|hybrid] [--queue-capacity n] [--net-cpu n]
+    //                      [--log-cpu n] [--fifo priority] [--mlock] [--prefault] [--huge-pages off|thp|explicit]
+    //                      [--md group:port] [--md-interface ip] [--md-snapshot-ms n] [--md-depth n] [--md-cpu n]
+    //                      [--shm name] [--shm-clients n] [--shm-ring n] [--shm-busy-poll]
+    //                      [--journal dir] [--journal-sync none|batch|ms] [--snapshot-ms n] [--journal-cpu n]
+    ChannelMode channelMode = CHANNEL_HYBRID; //every worker gets its own lock-free ring
+    size_t channelCapacity = 1 << 16;
+    int netCpu = -1;
+    int logCpu = -1;
+    int fifoPriority = 0; //SCHED_FIFO for the event loop and the workers, 0 keeps the default scheduler
+    bool lockMemory = false;
+    bool prefault = false;
+    HugePagePolicy hugePages = HUGE_PAGES_OFF;
+    std::string mdEndpoint; //market data off unless given
+    std::string mdInterface = "127.0.0.1";
+    int mdSnapshotMs = 1000;
+    size_t mdDepth = 10;
+    int mdCpu = -1;
+    std::string shmName; //shared memory gateway off unless given
+    size_t shmClients = 16;
+    size_t shmRing = 1 << 14;
+    bool shmBusyPoll = false;
+    std::string journalDir; //no journal and no recovery unless given
+    JournalSync journalSync = JOURNAL_SYNC_BATCH;
+    int journalSyncMs = 0;
+    int snapshotMs = 60000;
+    int journalCpu = -1;
+    const size_t JOURNAL_RING = 1 << 20; //messages in flight between the event loop and the journal writer
+    std::string symbolSpec;
+    size_t workerCount = 1;
+    std::vector<int> workerCpus;
+    size_t poolCapacity = 0; //0: split the default capacity over the symbols
+    int ladderWindow = -1; //-1: dense for a single symbol, DEFAULT_LADDER_WINDOW when there are several
+    uint32_t traceEvery = 0; //raw latency trace off, the report has the histogram
+    LogFullPolicy tracePolicy = LOG_DROP; //a slow disk never holds up matching
+    const int DEFAULT_LADDER_WINDOW = 4096;       //prices around the touch each book keeps dense
+    const size_t DEFAULT_POOL_CAPACITY = 1 << 22; //resting orders across all books
+    const size_t MIN_POOL_CAPACITY = 1 << 16;     //per book, when the default gets split
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--queue" && i + 1 < argc) {
+            if (!OrderChannel::parseMode(argv[++i], channelMode)) {
+                std::cerr << "unknown queue mode: " << argv[i] << " (expected mutex, spin or hybrid)\n";
+                return 1;
+            }
+        } else if (arg == "--queue-capacity" && i + 1 < argc) {
+            channelCapacity = static_cast<size_t>(std::stoull(argv[++i]));
+        } else if (arg == "--net-cpu" && i + 1 < argc) {
+            netCpu = std::stoi(argv[++i]);
+        } else if (arg == "--log-cpu" && i + 1 < argc) {
+            logCpu = std::stoi(argv[++i]);
+        } else if (arg == "--fifo" && i + 1 < argc) {
+            fifoPriority = std::stoi(argv[++i]);
+        } else if (arg == "--mlock") {
+            lockMemory = true;
+        } else if (arg == "--prefault") {
+            prefault = true;
+        } else if (arg == "--huge-pages" && i + 1 < argc) {
+            if (!parseHugePagePolicy(argv[++i], hugePages)) {
+                std::cerr << "unknown huge page policy: " << argv[i] << " (expected off, thp or explicit)\n";
+                return 1;
+            }
+        } else if (arg == "--md" && i + 1 < argc) {
+            mdEndpoint = argv[++i];
+        } else if (arg == "--md-interface" && i + 1 < argc) {
+            mdInterface = argv[++i];
+        } else if (arg == "--md-snapshot-ms" && i + 1 < argc) {
+            mdSnapshotMs = std::stoi(argv[++i]);
+        } else if (arg == "--md-depth" && i + 1 < argc) {
+            mdDepth = static_cast<size_t>(std::stoul(argv[++i]));
+        } else if (arg == "--md-cpu" && i + 1 < argc) {
+            mdCpu = std::stoi(argv[++i]);
+        } else if (arg == "--shm" && i + 1 < argc) {
+            shmName = argv[++i];
+        } else if (arg == "--shm-clients" && i + 1 < argc) {
+            shmClients = static_cast<size_t>(std::stoul(argv[++i]));
+        } else if (arg == "--shm-ring" && i + 1 < argc) {
+            shmRing = static_cast<size_t>(std::stoul(argv[++i]));
+        } else if (arg == "--shm-busy-poll") {
+            shmBusyPoll = true;
+        } else if (arg == "--journal" && i + 1 < argc) {
+            journalDir = argv[++i];
+        } else if (arg == "--journal-sync" && i + 1 < argc) {
+            if (!parseJournalSync(argv[++i], journalSync, journalSyncMs)) {
+                std::cerr << "unknown journal sync policy: " << argv[i] << " (expected none, batch or a number of ms)\n";
+                return 1;
+            }
+        } else if (arg == "--snapshot-ms" && i + 1 < argc) {
+            snapshotMs = std::stoi(argv[++i]);
+        } else if (arg == "--journal-cpu" && i + 1 < argc) {
+            journalCpu = std::stoi(argv[++i]);
+        } else if (arg == "--symbols" && i + 1 < argc) {
+            symbolSpec = argv[++i];
+        } else if (arg == "--workers" && i + 1 < argc) {
+            workerCount = static_cast<size_t>(std::stoul(argv[++i]));
+        } else if (arg == "--worker-cpus" && i + 1 < argc) {
+            std::istringstream list(argv[++i]);
+            std::string cpu;
+            while (std::getline(list, cpu, ',')) workerCpus.push_back(std::stoi(cpu));
+        } else if (arg == "--pool-capacity" && i + 1 < argc) {
+            poolCapacity = static_cast<size_t>(std::stoull(argv[++i]));
+        } else if (arg == "--ladder-window" && i + 1 < argc) {
+            ladderWindow = std::stoi(argv[++i]);
+        } else if (arg == "--latency-trace" && i + 1 < argc) {
+            traceEvery = static_cast<uint32_t>(std::stoul(argv[++i]));
+        } else if (arg == "--trace-full" && i + 1 < argc) {
+            if (!AsyncLogger::parsePolicy(argv[++i], tracePolicy)) {
+                std::cerr << "unknown trace policy: " << argv[i] << " (expected drop or block)\n";
+                return 1;
+            }
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--symbols list|file] [--workers n] [--worker-cpus a,b,..] [--pool-capacity n]\n"
+                      << "       [--ladder-window n] [--latency-trace n] [--trace-full drop|block] [--queue mutex|spin|hybrid] [--queue-capacity n] [--net-cpu n]\n"
+                      << "       [--log-cpu n] [--fifo priority] [--mlock] [--prefault] [--huge-pages off|thp|explicit]\n"
+                      << "       [--md group:port] [--md-interface ip] [--md-snapshot-ms n] [--md-depth n] [--md-cpu n]\n"
+                      << "       [--shm name] [--shm-clients n] [--shm-ring n] [--shm-busy-poll]\n"
+                      << "       [--journal dir] [--journal-sync none|batch|ms] [--snapshot-ms n] [--journal-cpu n]\n"
+                      << "--symbols takes a comma separated list or a file with one name per line. without it there is\n"
+                      << "one instrument and orders need no symbol. symbol names have to start with a letter.\n"
+                      << "--pool-capacity is per book (default: " << DEFAULT_POOL_CAPACITY << " split over the symbols).\n"
+                      << "--ladder-window is how many prices around the touch each book keeps in a dense array,\n"
+                      << "0 keeps the whole range (default: whole range for one symbol, " << DEFAULT_LADDER_WINDOW << " otherwise).\n"
+                      << "--latency-trace n writes every nth latency to latencies_<session>_<symbol>.bin (default: off).\n"
+                      << "--trace-full picks what matching does when the trace writer falls behind (default: drop).\n"
+                      << "--net-cpu, --worker-cpus and --log-cpu pin the event loop, the matching workers and the trace logger.\n"
+                      << "--fifo runs the event loop and the workers under SCHED_FIFO at that priority (1-99, needs privileges).\n"
+                      << "--mlock locks all memory, current and future. --prefault builds every book and faults its\n"
+                      << "memory in before the first order. the report lists which of these took effect.\n"
+                      << "--huge-pages backs each book's order pool, index and ladders with 2MB pages: thp asks for transparent\n"
+                      << "ones, explicit takes them from vm.nr_hugepages and falls back to thp, then 4KB pages. every book's\n"
+                      << "section of the report says what it got.\n"
+                      << "--md publishes L2 level updates over udp to a multicast group (or any address), through\n"
+                      << "--md-interface (default 127.0.0.1). every --md-snapshot-ms (default 1000, 0: never) the top\n"
+                      << "--md-depth levels (default 10) of every book go out as a snapshot. --md-cpu pins the publisher.\n"
+                      << "--shm also takes binary clients on this host through POSIX shared memory (e.g. /orderbook):\n"
+                      << "--shm-clients slots (default 16) with --shm-ring messages each way (default 16384).\n"
+                      << "--shm-busy-poll keeps the event loop spinning so shm clients never wait for a wakeup.\n"
+                      << "--journal appends every accepted message to a journal in dir and snapshots the books every\n"
+                      << "--snapshot-ms (default 60000, 0: only at shutdown). on start the newest snapshot is loaded and\n"
+                      << "the journal after it replayed. --journal-sync is when the journal reaches the disk: none\n"
+                      << "(write only, survives the process but not the machine), batch (fdatasync every group commit,\n"
+                      << "the default) or every n ms. snapshots come from a copy of the books the journal keeps on its\n"
+                      << "own threads (--journal-cpu pins them), so they cost a second set of books but no matching time.\n";
+            return 1;
+        }
+    }
+
+    SymbolTable symbols;
+    if (symbolSpec.empty()) {
+        symbols.add("DEFAULT"); //orders without a symbol are symbol 0
+    } else if (!symbols.load(symbolSpec)) {
+        std::cerr << "no usable symbols in " << symbolSpec << "\n";
+        return 1;
+    }
+    if (poolCapacity == 0) poolCapacity = std::max(DEFAULT_POOL_CAPACITY / symbols.size(), MIN_POOL_CAPACITY);
+    if (ladderWindow < 0) ladderWindow = (symbols.size() == 1) ? OrderBook::DENSE_LADDER : DEFAULT_LADDER_WINDOW;
+
+    //ctrl+c and kill are taken synchronously by the main thread in sigwait() below. blocked before any
+    //thread starts, so every thread inherits the mask and none of them is ever interrupted
+    sigset_t stopSignals;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, nullptr);
 
-    //handle signal
-    std::signal(SIGINT, signalHandler);
+    calibrateClock(); //before anything takes a timestamp
+    std::cout << "latency clock: " << clockSourceName() << " (" << clockNanosPerTick << " ns/tick)\n";
 
     std::string session_id = generateRandomSessionId();
-    std::string log_file = "latencies_" + session_id + ".bin";
-    OrderBook ob(log_file);
-    if (ob.initialize() != 0) {
-        std::cerr << "failed to initialize orderbook\n";
+    MatchingEngine engine;
+    if (engine.initialize(symbols, workerCount, channelMode, channelCapacity, poolCapacity, ladderWindow,
+                          traceEvery > 0 ? "latencies_" + session_id : std::string()) != 0) {
+        std::cerr << "failed to initialize matching engine\n";
         return 1;
     }
+    engine.setLatencyTrace(traceEvery, tracePolicy);
+
+    RuntimeStatus runtimeStatus;
+    engine.setRuntimeOptions(fifoPriority, logCpu, prefault, &runtimeStatus);
+    engine.setHugePages(hugePages);
+    if (lockMemory) { //before the threads start, so their stacks and every book built later are locked too
+        int error = lockAllMemory();
+        runtimeStatus.record("mlockall current and future memory", error);
+        if (error == 0) std::cout << "all memory locked\n";
+        else std::cerr << "could not lock memory (mlockall): " << strerror(error) << "\n";
+    }
+
+    MarketDataPublisher marketData;
+    if (!mdEndpoint.empty()) {
+        sockaddr_in destination;
+        if (!parseEndpoint(mdEndpoint, destination)) {
+            std::cerr << "invalid market data address: " << mdEndpoint << " (expected ip:port)\n";
+            return 1;
+        }
+        if (marketData.initialize(symbols, engine.workerCount(), channelCapacity, destination, mdInterface,
+                                  mdSnapshotMs, mdDepth) != 0) {
+            std::cerr << "failed to initialize market data publisher\n";
+            return 1;
+        }
+        ThreadPlacement mdPlacement;
+        mdPlacement.cpu = mdCpu;
+        marketData.setPlacement("md-publisher", mdPlacement, &runtimeStatus);
+        marketData.start();
+        engine.setMarketDataSink(&marketData);
+        std::cout << "publishing market data to " << mdEndpoint << "\n";
+    }
 
+    Journal journal;
     Server s;
     if (s.initialize() != 0) {
         std::cerr << "failed to initialize server\n";
         return 1;
     }
-
-    std::cout << "waiting for client connection...\n";
-    if (s.wait_for_client_connection() != 0) {
-        std::cerr << "failed to accept client connection\n";
-        s.stop_server();
+    if (!shmName.empty() && s.enableSharedMemory(shmName, shmClients, shmRing, shmBusyPoll) != 0) {
+        std::cerr << "failed to set up the shared memory gateway\n";
         return 1;
     }
 
+    s.setSharedResources(&engine, &symbols); //set the bridge between server & books
+    engine.setEventSink(&s); //fills and acks go back to the sessions that own the orders
 
-    s.setSharedResources(&orderQueue, &orderQueueMutex, &orderAvailableCV); //set the bridge between server & orderbook
+    if (!journalDir.empty()) {
+        if (journal.initialize(journalDir, symbols, poolCapacity, ladderWindow, journalSync, journalSyncMs, snapshotMs,
+                               JOURNAL_RING) != 0) {
+            std::cerr << "failed to set up the journal\n";
+            return 1;
+        }
+        auto began = std::chrono::steady_clock::now();
+        std::shared_ptr<Recovery> recovered(new Recovery());
+        if (recovered->load(journalDir, symbols) != 0) {
+            std::cerr << "could not recover from " << journalDir << "\n";
+            return 1;
+        }
+        double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - began).count();
+        size_t resting = engine.recover(*recovered);
+        double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - began).count();
+        s.resume(recovered->lastSeq, recovered->highestOrderId, recovered->lastSession);
+        s.setJournal(&journal);
+        //the journal rebuilds its copy of the books on its own thread once the engine's are done, so it
+        //doesn't hold up the first order. what arrives in the meantime waits in its ring
+        ThreadPlacement journalPlacement;
+        journalPlacement.cpu = journalCpu;
+        journal.setPlacement(journalPlacement, &runtimeStatus);
+        journal.start(recovered);
+        if (recovered->empty()) {
+            std::cout << "journaling to " << journalDir << ", nothing to recover\n";
+        } else {
+            std::cout << "recovered " << resting << " resting orders in " << totalMs << " ms: "
+                      << (recovered->snapshotFile.empty() ? std::string("no snapshot") :
+                          "snapshot at seq " + std::to_string(recovered->snapshotSeq) + " (" +
+                          std::to_string(recovered->restingOrders) + " orders)")
+                      << " and " << recovered->tail.size() << " journaled messages from " << recovered->segments
+                      << " segment(s), files read in " << loadMs << " ms. next seq " << recovered->lastSeq + 1 << "\n";
+        }
+    }
+
+    std::cout << "order queue mode: " << OrderChannel::modeName(channelMode) << "\n";
+    std::cout << symbols.size() << " symbol(s) on " << engine.workerCount() << " matching worker(s), "
+              << poolCapacity << " resting orders per book\n";
 
-    std::thread consumerThread(orderBookConsumer, std::ref(ob));
-    std::cout << "order feed thread started\n";
+    engine.start(workerCpus);
+    std::cout << "matching workers started\n";
 
-    std::thread serverThread([&s]() {
-        std::cout << "server now listening to client...\n";
-        s.listen_to_client();
-        std::cout << "server stopped listening to client\n";
+    ThreadPlacement netPlacement;
+    netPlacement.cpu = netCpu;
+    netPlacement.fifoPriority = fifoPriority;
+    std::thread serverThread([&s, netPlacement, &runtimeStatus]() {
+        std::cout << "server now accepting clients...\n";
+        s.run_event_loop(netPlacement, &runtimeStatus);
+        std::cout << "server stopped listening to clients\n";
     });
 
 
-    while (!stopRequested.load()) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    }
-    std::cout << "\nreceived shutdown signal (Ctrl+C)\n";
+    //sleeps until ctrl+c or kill, no periodic wakeups to disturb the other threads
+    int signum = 0;
+    sigwait(&stopSignals, &signum);
+    std::cout << "\nreceived shutdown signal (" << (signum == SIGINT ? "Ctrl+C" : "SIGTERM") << ")\n";
 
     s.stop_server();
     std::cout << "\nserver stopped\n";
-    {
-        std::lock_guard<std::mutex> lock(orderQueueMutex);
-    }
-
-    orderAvailableCV.notify_all(); //wake up order feed thread
 
     if (serverThread.joinable()) {
         serverThread.join();
         std::cout << "\nserver thread joined\n";
     }
-    if (consumerThread.joinable()) {
-        consumerThread.join();
-        std::cout << "\norder feed thread joined\n";
-    }
-    if (ob.getTotalOrdersProcessed() > 0) {
-        ob.finalize_log();
-        ob.writeReport("report_"+session_id+".rpt");
+
+    engine.stop(); //producer is gone, workers drain their queues and exit
+    std::cout << "\nmatching workers joined\n";
+    marketData.stop(); //after the workers, so the last deltas still go out
+    journal.stop(); //the event loop is gone, so this is every message. ends with a snapshot for a quick restart
+
+    if (engine.totalOrdersProcessed() > 0) {
+        engine.writeReport("report_"+session_id+".rpt");
+        if (!mdEndpoint.empty() || !journalDir.empty()) {
+            std::ofstream report("report_" + session_id + ".rpt", std::ios::app);
+            if (!mdEndpoint.empty()) {
+                report << "\n";
+                marketData.writeReport(report);
+            }
+            if (!journalDir.empty()) {
+                report << "\n";
+                journal.writeReport(report);
+            }
+        }
         std::cout << "report generated: report_" + session_id + ".rpt\n";
     }
     return 0;
@@ -0,0 +1,247 @@
+#include "shmtransport.h"
+#include <iostream>
+#include <algorithm>
+#include <new>
+#include <thread>
+#include <cstddef>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+void ShmRing::bind(ShmRingControl* ring_control, ShmSlot* ring_slots, uint64_t slot_count, bool producer) {
+    control = ring_control;
+    slots = ring_slots;
+    mask = slot_count - 1;
+    uint64_t head = control->head.load(std::memory_order_acquire);
+    uint64_t tail = control->tail.load(std::memory_order_acquire);
+    next = producer ? tail : head;
+    cachedOther = producer ? head : tail;
+}
+
+
+
+//segment layout: header, the client controls, then every client's two rings (to server first)
+static inline size_t controlsOffset() {
+    return (sizeof(ShmSegmentHeader) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+}
+
+static inline size_t slotsOffset(size_t client_slots) {
+    return controlsOffset() + client_slots * sizeof(ShmClientControl);
+}
+
+static inline size_t segmentBytes(size_t client_slots, size_t ring_slots) {
+    return slotsOffset(client_slots) + client_slots * 2 * ring_slots * sizeof(ShmSlot);
+}
+
+
+
+int ShmSegment::create(const std::string &name, size_t client_slots, size_t ring_slots) {
+    close();
+    if (name.size() < 2 || name[0] != '/' || name.find('/', 1) != std::string::npos) {
+        std::cerr << "invalid shared memory name " << name << " (expected /name)\n";
+        return 1;
+    }
+    size_t slots = 2;
+    while (slots < ring_slots) slots <<= 1;
+    if (client_slots == 0) client_slots = 1;
+
+    //a segment with the name already there is either a running server's or one left behind by a crash
+    ShmSegment previous;
+    if (previous.attach(name) == 0) {
+        int32_t pid = previous.header()->serverPid;
+        bool live = previous.header()->running.load() && processAlive(pid);
+        previous.close();
+        if (live) {
+            std::cerr << "shared memory " << name << " is in use by server process " << pid << "\n";
+            return 1;
+        }
+    }
+    shm_unlink(name.c_str());
+
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        std::cerr << "could not create shared memory " << name << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    size_t bytes = segmentBytes(client_slots, slots);
+    if (ftruncate(fd, static_cast<off_t>(bytes)) < 0) {
+        std::cerr << "could not size shared memory " << name << ": " << strerror(errno) << "\n";
+        ::close(fd);
+        shm_unlink(name.c_str());
+        return 1;
+    }
+    void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        std::cerr << "could not map shared memory " << name << ": " << strerror(errno) << "\n";
+        shm_unlink(name.c_str());
+        return 1;
+    }
+    base = p;
+    length = bytes;
+    owner = true;
+    segmentName = name;
+
+    //the file starts zeroed, which is what every atomic and index starts at. the placement news just
+    //make the objects official
+    ShmSegmentHeader* h = new (base) ShmSegmentHeader();
+    h->version = SHM_VERSION;
+    h->clientSlots = static_cast<uint32_t>(client_slots);
+    h->ringSlots = static_cast<uint32_t>(slots);
+    h->serverPid = static_cast<int32_t>(getpid());
+    h->segmentBytes = bytes;
+    h->running.store(1);
+    h->serverSleeping.store(0);
+    for (size_t i = 0; i < client_slots; ++i) {
+        new (client(i)) ShmClientControl();
+        resetClient(i);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    h->magic = SHM_MAGIC;
+    return 0;
+}
+
+
+
+int ShmSegment::attach(const std::string &name) {
+    close();
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        if (errno != ENOENT) std::cerr << "could not open shared memory " << name << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(ShmSegmentHeader)) {
+        ::close(fd);
+        return 1;
+    }
+    size_t bytes = static_cast<size_t>(st.st_size);
+    void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        std::cerr << "could not map shared memory " << name << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    base = p;
+    length = bytes;
+    owner = false;
+    segmentName = name;
+
+    const ShmSegmentHeader* h = header();
+    if (h->magic != SHM_MAGIC || h->version != SHM_VERSION || h->segmentBytes != bytes ||
+        segmentBytes(h->clientSlots, h->ringSlots) != bytes) {
+        std::cerr << "shared memory " << name << " is not an order gateway (or a different version of one)\n";
+        close();
+        return 1;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return 0;
+}
+
+
+
+void ShmSegment::close() {
+    if (base == nullptr) return;
+    if (owner) {
+        header()->running.store(0);
+        shm_unlink(segmentName.c_str()); //clients still attached keep their mapping
+    }
+    munmap(base, length);
+    base = nullptr;
+    length = 0;
+    owner = false;
+}
+
+
+
+ShmClientControl* ShmSegment::client(size_t slot) const {
+    return reinterpret_cast<ShmClientControl*>(static_cast<char*>(base) + controlsOffset()) + slot;
+}
+
+
+
+ShmSlot* ShmSegment::ringSlots(size_t slot, bool to_server) const {
+    size_t ring = slot * 2 + (to_server ? 0 : 1);
+    return reinterpret_cast<ShmSlot*>(static_cast<char*>(base) + slotsOffset(header()->clientSlots)) + ring * header()->ringSlots;
+}
+
+
+
+void ShmSegment::resetClient(size_t slot) {
+    ShmClientControl* c = client(slot);
+    c->toServer.head.store(0, std::memory_order_relaxed);
+    c->toServer.tail.store(0, std::memory_order_relaxed);
+    c->toClient.head.store(0, std::memory_order_relaxed);
+    c->toClient.tail.store(0, std::memory_order_relaxed);
+    c->sleeping.store(0, std::memory_order_relaxed);
+    c->pid = 0;
+    c->generation++;
+    c->state.store(SHM_CLIENT_FREE, std::memory_order_release);
+}
+
+
+
+static socklen_t doorbellAddress(const std::string &segment_name, int slot, sockaddr_un &addr) {
+    std::string path = "orderbook-shm" + segment_name;
+    if (slot >= 0) path += "." + std::to_string(slot);
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    size_t len = std::min(path.size(), sizeof(addr.sun_path) - 1);
+    std::memcpy(addr.sun_path + 1, path.data(), len); //leading 0: abstract, nothing on the filesystem
+    return static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + len);
+}
+
+
+
+int openDoorbell(const std::string &segment_name, int slot) {
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        std::cerr << "could not create doorbell socket: " << strerror(errno) << "\n";
+        return -1;
+    }
+    sockaddr_un addr;
+    socklen_t len = doorbellAddress(segment_name, slot, addr);
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), len) < 0) {
+        std::cerr << "could not bind doorbell for " << segment_name << ": " << strerror(errno) << "\n";
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+
+void ringDoorbell(int doorbell_fd, const std::string &segment_name, int slot) {
+    sockaddr_un addr;
+    socklen_t len = doorbellAddress(segment_name, slot, addr);
+    char ring = 0;
+    //a full doorbell already has a wakeup waiting, and a missing one means the other side is gone
+    if (sendto(doorbell_fd, &ring, 1, MSG_DONTWAIT | MSG_NOSIGNAL, reinterpret_cast<sockaddr*>(&addr), len) < 0) {}
+}
+
+
+
+void drainDoorbell(int doorbell_fd) {
+    char rings[64];
+    while (recv(doorbell_fd, rings, sizeof(rings), MSG_DONTWAIT) > 0) {}
+}
+
+
+
+bool spinningHelps() {
+    static const bool helps = std::thread::hardware_concurrency() > 1;
+    return helps;
+}
+
+
+
+bool processAlive(pid_t pid) {
+    return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
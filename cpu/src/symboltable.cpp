@@ -0,0 +1,31 @@
+#include "symboltable.h"
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cctype>
+
+
+//text orders tell a trailing id from a trailing symbol by its first character
+static bool validName(const std::string &name) {
+    return !name.empty() && std::isalpha(static_cast<unsigned char>(name[0]));
+}
+
+
+bool SymbolTable::load(const std::string &spec) {
+    std::ifstream file(spec);
+    std::string name;
+    std::istringstream list(spec);
+    bool fromFile = static_cast<bool>(file);
+
+    //one symbol per line, or a comma separated list
+    while (fromFile ? static_cast<bool>(std::getline(file, name)) : static_cast<bool>(std::getline(list, name, ','))) {
+        if (!name.empty() && name.back() == '\r') name.pop_back();
+        if (name.empty()) continue;
+        if (!validName(name)) {
+            std::cerr << "ignoring symbol " << name << ", names have to start with a letter\n";
+            continue;
+        }
+        add(name);
+    }
+    return size() > 0;
+}
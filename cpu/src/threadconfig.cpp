@@ -0,0 +1,65 @@
+#include "threadconfig.h"
+#include <iostream>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+
+
+void RuntimeStatus::record(const std::string &what, int error) {
+    std::lock_guard<std::mutex> guard(lock);
+    lines.push_back(what + (error == 0 ? ": ok" : std::string(": failed (") + strerror(error) + ")"));
+    if (error != 0) failed++;
+}
+
+
+
+size_t RuntimeStatus::failures() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return failed;
+}
+
+
+
+void RuntimeStatus::write(std::ostream &out) const {
+    std::lock_guard<std::mutex> guard(lock);
+    for (const std::string &line : lines) out << line << "\n";
+}
+
+
+
+int pinCurrentThread(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+
+
+int setCurrentThreadFifo(int priority) {
+    sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+    return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+}
+
+
+
+int placeCurrentThread(const std::string &name, const ThreadPlacement &placement, RuntimeStatus* status) {
+    pthread_setname_np(pthread_self(), name.substr(0, 15).c_str()); //the kernel keeps 15 characters
+
+    int failures = 0;
+    auto step = [&](const std::string &what, int error) {
+        std::string line = name + " " + what;
+        if (error == 0) std::cout << line << "\n";
+        else std::cerr << "could not " << line << ": " << strerror(error) << "\n";
+        if (status) status->record(line, error);
+        if (error != 0) failures++;
+    };
+
+    if (placement.cpu >= 0) step("pinned to cpu " + std::to_string(placement.cpu), pinCurrentThread(placement.cpu));
+    if (placement.fifoPriority > 0) {
+        step("SCHED_FIFO priority " + std::to_string(placement.fifoPriority), setCurrentThreadFifo(placement.fifoPriority));
+    }
+    return failures;
+}
@@ -0,0 +1,250 @@
+#include "workload.h"
+#include <cmath>
+#include <random>
+
+
+namespace {
+
+    //uniforms and normals straight from the engine's raw output, so a seed gives the same orders with any
+    //standard library (the <random> distributions are allowed to differ between implementations)
+    class Rng {
+        std::mt19937_64 engine;
+    public:
+        explicit Rng(uint64_t seed) : engine(seed) {}
+
+        inline uint64_t next() { return engine(); }
+
+        inline double unit() { return static_cast<double>(next() >> 11) * (1.0 / 9007199254740992.0); } // [0, 1)
+
+        inline int range(int lo, int hi) { // [lo, hi]
+            return lo + static_cast<int>(next() % static_cast<uint64_t>(hi - lo + 1));
+        }
+
+        inline bool chance(double p) { return unit() < p; }
+
+        inline double normal(double mean, double sd) { // box-muller
+            double u1 = unit();
+            double u2 = unit();
+            if (u1 < 1e-300) u1 = 1e-300;
+            return mean + sd * std::sqrt(-2.0 * std::log(u1)) * std::cos(6.283185307179586 * u2);
+        }
+    };
+
+
+    //per symbol state: where the market is and which ids were recently left on the book
+    struct SymbolFlow {
+        int mid = 50000;
+        std::vector<uint64_t> recent; // ring of recently submitted ids, for cancels and modifies
+        size_t recentNext = 0;
+    };
+
+
+    class Generator {
+    public:
+        static const int MIN_MID = 1000;
+        static const int MAX_MID = 900000;
+        static const size_t RECENT_IDS = 4096;
+
+        Rng rng;
+        std::vector<SymbolFlow> flows;
+        std::vector<Order> &out;
+        uint64_t nextId = 1;
+
+        Generator(uint64_t seed, uint32_t symbols, std::vector<Order> &orders) : rng(seed), flows(symbols), out(orders) {
+            for (uint32_t s = 0; s < symbols; ++s) flows[s].mid = 50000 + static_cast<int>((s * 3000ULL) % 800000);
+        }
+
+        inline Order base(uint32_t symbol) {
+            Order o;
+            o.seq = out.size() + 1;
+            o.session = 1;
+            o.symbol = symbol;
+            return o;
+        }
+
+        void remember(uint32_t symbol, uint64_t id) {
+            SymbolFlow &f = flows[symbol];
+            if (f.recent.size() < RECENT_IDS) f.recent.push_back(id);
+            else f.recent[f.recentNext] = id;
+            f.recentNext = (f.recentNext + 1) % RECENT_IDS; //equals size() until the ring is full
+        }
+
+        //one of the `window` most recently remembered ids, 0 if there are none
+        uint64_t recentId(uint32_t symbol, size_t window) {
+            SymbolFlow &f = flows[symbol];
+            if (f.recent.empty()) return 0;
+            size_t n = f.recent.size();
+            size_t back = static_cast<size_t>(rng.next() % (window < n ? window : n));
+            return f.recent[(f.recentNext + n - 1 - back) % n]; //newest sits just before recentNext
+        }
+
+        void newOrder(uint32_t symbol, bool buy, int price, int quantity, uint8_t type = ORDER_LIMIT) {
+            Order o = base(symbol);
+            o.id = nextId++;
+            o.action = ORDER_NEW;
+            o.type = type;
+            o.buy = buy;
+            o.price = price < 1 ? 1 : price;
+            o.quantity = quantity;
+            out.push_back(o);
+            remember(symbol, o.id);
+        }
+
+        //passive order `ticks` away from the mid on its own side
+        void passive(uint32_t symbol, bool buy, int ticks, int quantity, uint8_t type = ORDER_LIMIT) {
+            int mid = flows[symbol].mid;
+            newOrder(symbol, buy, buy ? mid - ticks : mid + ticks, quantity, type);
+        }
+
+        void cancel(uint32_t symbol, size_t window) {
+            uint64_t id = recentId(symbol, window);
+            if (id == 0) return;
+            Order o = base(symbol);
+            o.id = id;
+            o.action = ORDER_CANCEL;
+            o.buy = false;
+            o.price = 0;
+            o.quantity = 0;
+            out.push_back(o);
+        }
+
+        void modify(uint32_t symbol, size_t window, int quantity, int price) {
+            uint64_t id = recentId(symbol, window);
+            if (id == 0) return;
+            Order o = base(symbol);
+            o.id = id;
+            o.action = ORDER_MODIFY;
+            o.buy = false;
+            o.price = price;
+            o.quantity = quantity;
+            out.push_back(o);
+        }
+
+        void drift(uint32_t symbol, double sd) {
+            int &mid = flows[symbol].mid;
+            mid += static_cast<int>(std::lround(rng.normal(0.0, sd)));
+            if (mid < MIN_MID) mid = MIN_MID;
+            if (mid > MAX_MID) mid = MAX_MID;
+        }
+
+        //gaussian flow on one symbol: prices scattered around the mid, a bit more passive than aggressive
+        void gaussianStep(uint32_t symbol) {
+            if (out.size() % 100 == 0) drift(symbol, 20.0);
+            double r = rng.unit();
+            if (r < 0.80) {
+                bool buy = rng.chance(0.5);
+                int offset = static_cast<int>(std::lround(rng.normal(5.0, 25.0))); // > 0 is passive
+                passive(symbol, buy, offset, rng.range(1, 500));
+            } else if (r < 0.92) {
+                cancel(symbol, 1024);
+            } else {
+                int mid = flows[symbol].mid;
+                modify(symbol, 1024, rng.range(0, 500), rng.chance(0.5) ? 0 : rng.range(mid - 50, mid + 50));
+            }
+        }
+    };
+
+
+    void uniform(Generator &g, size_t count) { //what generateRandomOrders draws, but seeded
+        while (g.out.size() < count) g.newOrder(0, g.rng.chance(0.5), g.rng.range(100, 100000), g.rng.range(1, 1000));
+    }
+
+    void gaussian(Generator &g, size_t count) {
+        while (g.out.size() < count) g.gaussianStep(0);
+    }
+
+    void sweeps(Generator &g, size_t count) {
+        while (g.out.size() < count) {
+            if (g.rng.chance(0.002)) { //a burst of large orders that walk the other side
+                bool buy = g.rng.chance(0.5);
+                int burst = g.rng.range(5, 20);
+                for (int i = 0; i < burst && g.out.size() < count; ++i) {
+                    int mid = g.flows[0].mid;
+                    g.newOrder(0, buy, buy ? mid + 200 : mid - 200, g.rng.range(500, 5000));
+                }
+                int shift = g.rng.range(10, 60);
+                g.flows[0].mid += buy ? shift : -shift;
+                if (g.flows[0].mid < Generator::MIN_MID) g.flows[0].mid = Generator::MIN_MID;
+                continue;
+            }
+            if (g.rng.chance(0.05)) g.cancel(0, 2048);
+            else g.passive(0, g.rng.chance(0.5), g.rng.range(1, 50), g.rng.range(1, 200));
+        }
+    }
+
+    void cancelHeavy(Generator &g, size_t count) { //quoting: post near the touch, pull most of it again
+        while (g.out.size() < count) {
+            if (g.out.size() % 200 == 0) g.drift(0, 3.0);
+            double r = g.rng.unit();
+            if (r < 0.35) g.passive(0, g.rng.chance(0.5), g.rng.range(1, 10), g.rng.range(1, 100));
+            else if (r < 0.90) g.cancel(0, 64);
+            else if (r < 0.98) g.modify(0, 64, g.rng.range(1, 100), 0);
+            else g.passive(0, g.rng.chance(0.5), -g.rng.range(1, 5), g.rng.range(1, 50)); //small aggressor
+        }
+    }
+
+    void deepBook(Generator &g, size_t count) { //mostly resting orders spread over thousands of levels
+        while (g.out.size() < count) {
+            double r = g.rng.unit();
+            if (r < 0.95) g.passive(0, g.rng.chance(0.5), g.rng.range(1, 20000), g.rng.range(1, 1000));
+            else if (r < 0.98) g.passive(0, g.rng.chance(0.5), -g.rng.range(1, 20), g.rng.range(100, 2000));
+            else g.cancel(0, Generator::RECENT_IDS);
+        }
+    }
+
+    void orderTypes(Generator &g, size_t count) { //post-only makers, takers that never rest
+        while (g.out.size() < count) {
+            if (g.out.size() % 200 == 0) g.drift(0, 5.0);
+            bool buy = g.rng.chance(0.5);
+            double r = g.rng.unit();
+            if (r < 0.45) g.passive(0, buy, g.rng.range(-2, 30), g.rng.range(1, 300), ORDER_POST_ONLY); //some would cross
+            else if (r < 0.55) g.passive(0, buy, g.rng.range(1, 30), g.rng.range(1, 300));
+            else if (r < 0.70) g.passive(0, buy, -g.rng.range(0, 10), g.rng.range(1, 500), ORDER_IOC);
+            else if (r < 0.77) g.passive(0, buy, -g.rng.range(0, 10), g.rng.range(100, 2000), ORDER_FOK);
+            else if (r < 0.80) g.newOrder(0, buy, g.flows[0].mid, g.rng.range(1, 300), ORDER_MARKET);
+            else g.cancel(0, 256);
+        }
+    }
+
+    void multiSymbol(Generator &g, size_t count) { //gaussian flow, a few hot symbols get most of it
+        uint32_t symbols = static_cast<uint32_t>(g.flows.size());
+        while (g.out.size() < count) {
+            double u = g.rng.unit();
+            g.gaussianStep(static_cast<uint32_t>(u * u * symbols));
+        }
+    }
+}
+
+
+
+const std::vector<WorkloadProfile>& workloadProfiles() {
+    static const std::vector<WorkloadProfile> profiles = {
+        {"uniform", "new orders only, uniform prices 1.00-1000.00 (what order_generation writes)"},
+        {"gaussian", "prices normally distributed around a drifting mid, 12% cancels, 8% modifies"},
+        {"sweeps", "passive quoting near the mid broken up by bursts of large orders that walk the book"},
+        {"cancel", "quote and pull: 55% cancels and 8% modifies of very recent orders"},
+        {"deep", "95% resting orders spread over 20000 levels each side, few trades"},
+        {"multi", "gaussian flow over many symbols, skewed towards a few hot ones"},
+        {"types", "post-only quotes (some crossing), ioc, fill-or-kill and market takers, 20% cancels"},
+    };
+    return profiles;
+}
+
+
+
+bool generateWorkload(const WorkloadSpec &spec, std::vector<Order> &orders) {
+    orders.clear();
+    orders.reserve(spec.count);
+    uint32_t symbols = (spec.profile == "multi") ? (spec.symbols == 0 ? 1 : spec.symbols) : 1;
+    Generator g(spec.seed, symbols, orders);
+
+    if (spec.profile == "uniform") uniform(g, spec.count);
+    else if (spec.profile == "gaussian") gaussian(g, spec.count);
+    else if (spec.profile == "sweeps") sweeps(g, spec.count);
+    else if (spec.profile == "cancel") cancelHeavy(g, spec.count);
+    else if (spec.profile == "deep") deepBook(g, spec.count);
+    else if (spec.profile == "multi") multiSymbol(g, spec.count);
+    else if (spec.profile == "types") orderTypes(g, spec.count);
+    else return false;
+    return true;
+}